@@ -2,9 +2,60 @@
  * UM.c
  *      the main for the universal machine
  *      reads in a file from the command line,
- *      calls functions in segments.h and unpack.h to:
+ *      calls functions in segments.h and one of the engines to:
  *              store the instructions (32 bit words) in a memory struct,
  *              loop through the instructions performing each desired operation
+ *      usage: um [options] program.um
+ *              a program.um that is not a regular file (a pipe, say) runs
+ *              as its words arrive, and a program.um of - is read from
+ *              stdin, in which case input is always at its end
+ *              --reference runs the original unpack/switch loop instead of
+ *              the direct-threaded engine
+ *              --jit translates hot straight-line code to native x86-64
+ *              --specialized runs the engine with a handler for every
+ *              opcode and register triple
+ *              --async-output has a writer thread do all output writes
+ *              --flush-bytes=N writes output once N bytes are buffered
+ *              --flush-ms=N writes output once it has waited N milliseconds
+ *              --profile[=FILE] runs a profiling build of the threaded
+ *              engine and writes its report to FILE (default stderr)
+ *              --checkpoint=FILE runs a checkpointing build of the threaded
+ *              engine that saves snapshots to FILE on SIGUSR2 and SIGTERM
+ *              --checkpoint-every=N also saves every N instructions
+ *              --trace=FILE runs a tracing build of the threaded engine
+ *              that writes binary records to FILE for umtrace to read
+ *              --trace-every=N records every Nth instruction rather than
+ *              every one
+ *              --trace-records=N keeps the last N records (default 1M)
+ *              --huge-pages asks for transparent huge pages on very large
+ *              segments, for programs that fill them densely
+ *              --retain-bytes=N keeps at most about N bytes of unmapped
+ *              segments for reuse and gives the rest back
+ *              --background-free has a thread do that giving back
+ *              --max-words=N stops the program with an error if it maps
+ *              more than N words at once
+ *              --cache=DIR keeps the converted and decoded program in DIR
+ *              (see progcache.h), so later runs of the same image start
+ *              without loading it again
+ *              --stats-socket=PATH serves the live counters (see stats.h)
+ *              to every connection to a Unix socket at PATH
+ *              a SIGUSR1 writes the live counters to stderr
+ *              at most one of --reference, --jit, --specialized,
+ *              --profile, --checkpoint (or --resume), --trace, --batch and
+ *              --pipeline may be given, since each picks what runs the
+ *              program
+ *      usage: um [options] --resume=SNAPSHOT
+ *              carries on from a snapshot instead of loading a program,
+ *              saving later snapshots over it unless --checkpoint says
+ *              otherwise
+ *      usage: um [options] --batch=MANIFEST [--threads=N] [--lockstep]
+ *              runs every job in the manifest (see batch.h) on N threads,
+ *              one per processor by default
+ *              --lockstep runs jobs of the same program together, several
+ *              instances to a thread (see lockstep.h)
+ *      usage: um [options] --pipeline first.um ... last.um
+ *              runs the programs as a pipeline (see pipeline.h), each
+ *              one's output feeding the next one's input, on a thread each
  *
  * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
  * Date: 8 April 2015
@@ -12,28 +63,237 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include "unpack.h"
+#include "threaded.h"
+#include "jit.h"
+#include "specialized.h"
+#include "umio.h"
+#include "profile.h"
+#include "snapshot.h"
+#include "batch.h"
+#include "segalloc.h"
+#include "trace.h"
+#include "stats.h"
+#include "progcache.h"
+#include "pipeline.h"
+
+/* exits after printing the usual complaint about the command line */
+static void incorrect_input(void)
+{
+        printf("Incorrect input\n");
+        exit(1);
+}
+
+/* returns the number following the '=' in an option like --flush-ms=N */
+static unsigned long option_value(const char *option)
+{
+        const char *value = strchr(option, '=');
+        char *end;
+
+        if (value == NULL || value[1] == '\0') {
+                incorrect_input();
+        }
+        unsigned long number = strtoul(value + 1, &end, 10);
+        if (*end != '\0') {
+                incorrect_input();
+        }
+        return number;
+}
 
 int main(int argc, char *argv[])
 {
-        /* the .um file with the instructions must be the second argument
-           on the command line */
-        if(argc != 2) {
-                printf("Incorrect input\n");
-                exit(1);
+        void (*engine)(UM_memory mem, UM_io io) = run_threaded;
+        struct io_options io_options = { 0, 0, 0 };
+        FILE *profile_out = NULL;
+        const char *checkpoint_path = NULL;
+        const char *resume_path = NULL;
+        const char *batch_path = NULL;
+        unsigned long threads = 0;
+        int lockstep = 0;
+        int pipeline = 0;
+        struct reclaim_policy reclaim = { SIZE_MAX, 0 };
+        uint64_t max_words = UINT64_MAX;
+        unsigned long checkpoint_every = 0;
+        const char *trace_path = NULL;
+        unsigned long trace_every = 1;
+        unsigned long trace_records = 1 << 20;
+        const char *stats_path = NULL;
+        const char *cache_dir = NULL;
+        int arg = 1;
+
+        /* options come before the .um file */
+        for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+                if (strcmp(argv[arg], "--reference") == 0) {
+                        engine = unpack_instructions;
+                } else if (strcmp(argv[arg], "--jit") == 0) {
+                        engine = run_jit;
+                } else if (strcmp(argv[arg], "--specialized") == 0) {
+                        engine = run_specialized;
+                } else if (strcmp(argv[arg], "--async-output") == 0) {
+                        io_options.async = 1;
+                } else if (strncmp(argv[arg], "--flush-bytes=", 14) == 0) {
+                        io_options.flush_bytes = option_value(argv[arg]);
+                } else if (strncmp(argv[arg], "--flush-ms=", 11) == 0) {
+                        io_options.flush_ms = option_value(argv[arg]);
+                } else if (strcmp(argv[arg], "--profile") == 0) {
+                        profile_out = stderr;
+                } else if (strncmp(argv[arg], "--profile=", 10) == 0) {
+                        profile_out = fopen(argv[arg] + 10, "w");
+                        if (profile_out == NULL) {
+                                printf("Could not open file\n");
+                                exit(1);
+                        }
+                } else if (strncmp(argv[arg], "--checkpoint=", 13) == 0) {
+                        checkpoint_path = argv[arg] + 13;
+                } else if (strncmp(argv[arg], "--checkpoint-every=", 19)
+                           == 0) {
+                        checkpoint_every = option_value(argv[arg]);
+                } else if (strncmp(argv[arg], "--trace=", 8) == 0) {
+                        trace_path = argv[arg] + 8;
+                } else if (strncmp(argv[arg], "--trace-every=", 14) == 0) {
+                        trace_every = option_value(argv[arg]);
+                } else if (strncmp(argv[arg], "--trace-records=", 16) == 0) {
+                        trace_records = option_value(argv[arg]);
+                } else if (strncmp(argv[arg], "--resume=", 9) == 0) {
+                        resume_path = argv[arg] + 9;
+                } else if (strcmp(argv[arg], "--huge-pages") == 0) {
+                        allocator_huge_pages(1);
+                } else if (strncmp(argv[arg], "--retain-bytes=", 15) == 0) {
+                        reclaim.retain_bytes = option_value(argv[arg]);
+                } else if (strcmp(argv[arg], "--background-free") == 0) {
+                        reclaim.background = 1;
+                } else if (strncmp(argv[arg], "--max-words=", 12) == 0) {
+                        max_words = option_value(argv[arg]);
+                } else if (strncmp(argv[arg], "--cache=", 8) == 0) {
+                        cache_dir = argv[arg] + 8;
+                } else if (strncmp(argv[arg], "--stats-socket=", 15) == 0) {
+                        stats_path = argv[arg] + 15;
+                } else if (strncmp(argv[arg], "--batch=", 8) == 0) {
+                        batch_path = argv[arg] + 8;
+                } else if (strncmp(argv[arg], "--threads=", 10) == 0) {
+                        threads = option_value(argv[arg]);
+                } else if (strcmp(argv[arg], "--lockstep") == 0) {
+                        lockstep = 1;
+                } else if (strcmp(argv[arg], "--pipeline") == 0) {
+                        pipeline = 1;
+                } else {
+                        incorrect_input();
+                }
         }
 
-        FILE *input = fopen(argv[1], "rb");
-        if (input == NULL) {
-                printf("Could not open file\n");
-                exit(1);
+        /* the engine options and the profiling, checkpointing and tracing
+           builds each choose what runs the program, and a batch or a
+           pipeline always runs the threaded engine, so at most one may be
+           asked for */
+        int choices = (engine != run_threaded) + (profile_out != NULL) +
+                      (checkpoint_path != NULL || resume_path != NULL) +
+                      (trace_path != NULL) + (batch_path != NULL) + pipeline;
+        if (choices > 1) {
+                incorrect_input();
         }
 
-        UM_memory mem = initialize_memory();
-        load_instructions(mem, input);
+        allocator_reclaim(&reclaim);
 
-        fclose(input);
-        unpack_instructions(mem);
+        /* a batch names its programs in the manifest */
+        if (batch_path != NULL) {
+                if (argc - arg != 0) {
+                        incorrect_input();
+                }
+                return run_batch(batch_path, threads, &io_options,
+                                 max_words, lockstep);
+        }
+
+        /* a pipeline is every program after the options */
+        if (pipeline == 1) {
+                if (argc - arg < 1) {
+                        incorrect_input();
+                }
+                int status = run_pipeline(argv + arg, argc - arg,
+                                          &io_options, max_words);
+                if (status < 0) {
+                        printf("Could not open file\n");
+                        exit(1);
+                }
+                return status;
+        }
+
+        /* the .um file with the instructions must be the last argument
+           on the command line, unless the machine comes from a snapshot */
+        UM_memory mem;
+        struct checkpoint *checkpoint = NULL;
+        int in_fd = STDIN_FILENO;
+        if (resume_path != NULL) {
+                if (argc - arg != 0) {
+                        incorrect_input();
+                }
+                if (checkpoint_path == NULL) {
+                        checkpoint_path = resume_path;
+                }
+                checkpoint = checkpoint_new(checkpoint_path,
+                                            checkpoint_every);
+                mem = snapshot_restore(resume_path, checkpoint->registers);
+                if (mem == NULL) {
+                        printf("Could not restore snapshot\n");
+                        exit(1);
+                }
+        } else {
+                if(argc - arg != 1) {
+                        incorrect_input();
+                }
+
+                FILE *input = stdin;
+                if (strcmp(argv[arg], "-") == 0) {
+                        in_fd = open("/dev/null", O_RDONLY);
+                } else {
+                        input = fopen(argv[arg], "rb");
+                }
+                if (input == NULL || in_fd < 0) {
+                        printf("Could not open file\n");
+                        exit(1);
+                }
+
+                if (cache_dir != NULL) {
+                        mem = cache_load(input, cache_dir);
+                } else {
+                        mem = initialize_memory();
+                        stream_instructions(mem, input);
+                }
+
+                if (checkpoint_path != NULL) {
+                        checkpoint = checkpoint_new(checkpoint_path,
+                                                    checkpoint_every);
+                }
+        }
+
+        memory_limit(mem, max_words);
+        UM_io io = io_new(in_fd, STDOUT_FILENO, &io_options);
+        stats_watch(mem, io);
+        if (stats_path != NULL && stats_listen(stats_path) == 0) {
+                printf("Could not open socket\n");
+                exit(1);
+        }
+        if (checkpoint != NULL) {
+                run_checkpointed(mem, io, checkpoint);
+                checkpoint_free(checkpoint);
+        } else if (profile_out != NULL) {
+                struct profile *profile = profile_new(profile_out);
+                run_profiled(mem, io, profile);
+                profile_free(profile);
+        } else if (trace_path != NULL) {
+                struct trace *trace = trace_open(trace_path, trace_records,
+                                                 trace_every);
+                if (trace == NULL) {
+                        printf("Could not open file\n");
+                        exit(1);
+                }
+                run_traced(mem, io, trace);
+                trace_close(trace);
+        } else {
+                engine(mem, io);
+        }
        
         return 0;
 }
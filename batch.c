@@ -0,0 +1,619 @@
+/*
+ * batch.c
+ *      the implementation for running many UM jobs in one process
+ *      the manifest is read, and every program it names loaded, before any
+ *      thread starts -- programs are told apart by device and inode, so two
+ *      paths to one file share one UM_program
+ *      jobs are grouped into gangs -- in lockstep, jobs of one program are
+ *      ganged together in manifest order, LOCKSTEP_LANES at a time, and
+ *      otherwise every job is a gang of its own
+ *      gangs are dealt out round robin to one deque per worker; a worker
+ *      takes gangs from the back of its own deque and, once that is empty,
+ *      steals from the front of the others'
+ *      a lane that leaves a lockstep gang goes on the back of its worker's
+ *      deque as a gang of its own, where any worker may take it up while the
+ *      rest of the gang runs on -- so a worker out of gangs waits, rather
+ *      than stopping, while some gang is still running
+ *      gangs are long next to a lock, so each deque has a plain mutex
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "lockstep.h"
+#include "operations.h"
+#include "peephole.h"
+#include "stats.h"
+
+#define JOB_FAILED 1
+#define JOB_NOT_RUN -1
+#define NO_GANG UINT32_MAX
+#define FIELD_SEPARATORS " \t\r\n"
+
+/* one line of the manifest -- status is 0 for success, JOB_FAILED for an
+ * invalid opcode, a refused map or a fault and JOB_NOT_RUN if the job could
+ * not be started
+ * split is where the job left its lockstep gang, or NULL if it has not
+ */
+struct job {
+        char *program_path;
+        char *input_path;
+        char *output_path;
+        UM_program program;
+        unsigned line;
+        int status;
+        struct split *split;
+};
+
+/* a job that has left its gang, to be finished alone from its registers */
+struct split {
+        UM_memory mem;
+        UM_io io;
+        uint32_t registers[8];
+        int in_fd;
+        int out_fd;
+};
+
+/* a loaded program file */
+struct loaded {
+        dev_t device;
+        ino_t inode;
+        UM_program program;
+};
+
+/* the indices of jobs run together, all of one program */
+struct gang {
+        uint32_t jobs[LOCKSTEP_LANES];
+        unsigned size;
+};
+
+/* the gang indices dealt to one worker -- the owner takes from bottom - 1,
+ * thieves from top, and there is room for capacity of them
+ */
+struct deque {
+        pthread_mutex_t lock;
+        uint32_t *gangs;
+        uint32_t top;
+        uint32_t bottom;
+        uint32_t capacity;
+};
+
+/* everything the workers share -- gangs has room after the num_gangs
+ * formed for one more per job, gangs[num_gangs + i] being job i alone once
+ * it leaves its gang
+ * pending counts the gangs queued or running, and pushes the gangs queued
+ * since the workers started; both are kept under idle_lock, and idle is
+ * signalled whenever either changes
+ */
+struct batch {
+        struct job *jobs;
+        uint32_t num_jobs;
+        struct loaded *loaded;
+        uint32_t num_loaded;
+        struct gang *gangs;
+        uint32_t num_gangs;
+        struct deque *deques;
+        unsigned num_workers;
+        const struct io_options *options;
+        uint64_t max_words;
+        pthread_mutex_t idle_lock;
+        pthread_cond_t idle;
+        uint32_t pending;
+        uint64_t pushes;
+};
+
+/* what each worker thread is started with */
+struct worker {
+        struct batch *batch;
+        unsigned id;
+        pthread_t thread;
+};
+
+/* the jobs of a gang being run, for leave_gang -- left has a bit set for
+ * each lane that has left
+ */
+struct running {
+        struct batch *batch;
+        unsigned id;
+        struct job *jobs[LOCKSTEP_LANES];
+        int fds[2 * LOCKSTEP_LANES];
+        UM_memory mems[LOCKSTEP_LANES];
+        UM_io ios[LOCKSTEP_LANES];
+        unsigned left;
+};
+
+/****** private helper function declarations ******/
+
+/* reads the manifest into batch->jobs, loading each program the first time
+ * it is named -- returns -1 if the manifest cannot be read
+ */
+int read_manifest(struct batch *batch, const char *manifest);
+
+/* returns the loaded program at path, loading it if it is new -- returns
+ * NULL if it cannot be opened
+ */
+UM_program find_program(struct batch *batch, const char *path);
+
+/* groups the jobs into gangs of up to lanes jobs each */
+void form_gangs(struct batch *batch, unsigned lanes);
+
+/* deals the gangs out to the workers' deques */
+void deal_gangs(struct batch *batch);
+
+/* returns the next gang for the given worker, stealing if it has to, or
+ * NO_GANG if every deque is empty
+ */
+uint32_t next_gang(struct batch *batch, unsigned id);
+
+/* puts the gang on the back of the given worker's deque */
+void push_gang(struct batch *batch, unsigned id, uint32_t gang);
+
+/* the worker thread: runs gangs until there are none left and none
+ * running
+ */
+void *worker_main(void *arg);
+
+/* opens the files of the gang's jobs and runs the ones that open, in
+ * lockstep if there is more than one -- or finishes a job that has left
+ * its gang
+ */
+void run_gang(struct batch *batch, unsigned id, struct gang *gang);
+
+/* run_lockstep's lockstep_leave: queues the lane's job as a gang of its
+ * own on the worker's deque
+ */
+void leave_gang(void *arg, unsigned lane, const uint32_t *registers);
+
+/* opens path with the given flags, or /dev/null for - */
+int open_job_file(const char *path, int flags);
+
+/**************************************************/
+
+#define ENGINE_NAME run_job
+#define ENGINE_EXTRA_PARAMS , int *status
+#define ENGINE_CHECKS 1
+#define ENGINE_HANDLER(inst) (inst)->handler
+#define ENGINE_START(registers)
+#define ENGINE_FETCH(pc, inst)
+#define ENGINE_STORE(segment, offset)
+#define ENGINE_PROGRAM(length)
+#define ENGINE_MAP(index, size)
+#define ENGINE_UNMAP(index)
+#define ENGINE_JUMP(segment, offset)
+#define ENGINE_TARGET(pc)
+#define ENGINE_OUTPUT(value)
+#define ENGINE_INPUT(value)
+#define ENGINE_EXIT()
+#define ENGINE_STOP(exit_status)                                        \
+        do {                                                            \
+                if ((exit_status) != 0) {                               \
+                        *status = JOB_FAILED;                           \
+                }                                                       \
+        } while (0)
+
+#include "threaded_body.h"
+
+/* the calling thread only waits, so the pool is num_threads workers */
+int run_batch(const char *manifest, unsigned num_threads,
+              const struct io_options *options, uint64_t max_words,
+              int lockstep)
+{
+        struct batch batch;
+        int failed = 0;
+
+        memset(&batch, 0, sizeof(batch));
+        batch.options = options;
+        batch.max_words = max_words;
+        if (read_manifest(&batch, manifest) != 0) {
+                printf("Could not open file\n");
+                return 1;
+        }
+
+        if (num_threads == 0) {
+                long online = sysconf(_SC_NPROCESSORS_ONLN);
+                num_threads = online > 0 ? online : 1;
+        }
+        form_gangs(&batch, lockstep != 0 ? LOCKSTEP_LANES : 1);
+        if (num_threads > batch.num_gangs && batch.num_gangs > 0) {
+                num_threads = batch.num_gangs;
+        }
+        batch.num_workers = num_threads;
+        deal_gangs(&batch);
+        pthread_mutex_init(&batch.idle_lock, NULL);
+        pthread_cond_init(&batch.idle, NULL);
+        batch.pending = batch.num_gangs;
+        batch.pushes = 0;
+
+        struct worker *workers = malloc(num_threads * sizeof(struct worker));
+        for (unsigned i = 0; i < num_threads; i++) {
+                workers[i].batch = &batch;
+                workers[i].id = i;
+                pthread_create(&workers[i].thread, NULL, worker_main,
+                               &workers[i]);
+        }
+        for (unsigned i = 0; i < num_threads; i++) {
+                pthread_join(workers[i].thread, NULL);
+        }
+        free(workers);
+
+        for (uint32_t i = 0; i < batch.num_jobs; i++) {
+                struct job *job = &batch.jobs[i];
+                if (job->status != 0) {
+                        fprintf(stderr, "%s:%u: %s: %s\n", manifest,
+                                job->line, job->program_path,
+                                job->status == JOB_FAILED
+                                ? "program failed" : "could not run");
+                        failed = 1;
+                }
+                free(job->program_path);
+                free(job->input_path);
+                free(job->output_path);
+        }
+        for (uint32_t i = 0; i < batch.num_loaded; i++) {
+                program_free(batch.loaded[i].program);
+        }
+        for (unsigned i = 0; i < batch.num_workers; i++) {
+                pthread_mutex_destroy(&batch.deques[i].lock);
+                free(batch.deques[i].gangs);
+        }
+        pthread_mutex_destroy(&batch.idle_lock);
+        pthread_cond_destroy(&batch.idle);
+        free(batch.deques);
+        free(batch.gangs);
+        free(batch.loaded);
+        free(batch.jobs);
+        return failed;
+}
+
+/****** private helper function definitions ******/
+
+/* a line with fewer than three fields is a job that cannot run */
+int read_manifest(struct batch *batch, const char *manifest)
+{
+        FILE *in = fopen(manifest, "r");
+        uint32_t capacity = 0;
+        char *line = NULL;
+        size_t line_size = 0;
+        unsigned line_number = 0;
+
+        if (in == NULL) {
+                return -1;
+        }
+        while (getline(&line, &line_size, in) != -1) {
+                char *fields[3];
+                char *save;
+
+                line_number++;
+                fields[0] = strtok_r(line, FIELD_SEPARATORS, &save);
+                if (fields[0] == NULL || fields[0][0] == '#') {
+                        continue;
+                }
+                fields[1] = strtok_r(NULL, FIELD_SEPARATORS, &save);
+                fields[2] = fields[1] == NULL
+                            ? NULL : strtok_r(NULL, FIELD_SEPARATORS, &save);
+
+                if (batch->num_jobs == capacity) {
+                        capacity = capacity == 0 ? 64 : capacity * 2;
+                        batch->jobs = realloc(batch->jobs,
+                                              capacity * sizeof(struct job));
+                }
+                struct job *job = &batch->jobs[batch->num_jobs++];
+                job->program_path = strdup(fields[0]);
+                job->input_path = strdup(fields[1] == NULL ? "-"
+                                                           : fields[1]);
+                job->output_path = strdup(fields[2] == NULL ? "-"
+                                                            : fields[2]);
+                job->line = line_number;
+                job->program = NULL;
+                job->status = JOB_NOT_RUN;
+                job->split = NULL;
+                if (fields[2] != NULL) {
+                        job->program = find_program(batch, fields[0]);
+                }
+        }
+        free(line);
+        fclose(in);
+        return 0;
+}
+
+/* a linear search is plenty next to loading even one program */
+UM_program find_program(struct batch *batch, const char *path)
+{
+        FILE *input = fopen(path, "rb");
+        struct stat info;
+
+        if (input == NULL) {
+                return NULL;
+        }
+        if (fstat(fileno(input), &info) != 0) {
+                fclose(input);
+                return NULL;
+        }
+        for (uint32_t i = 0; i < batch->num_loaded; i++) {
+                if (batch->loaded[i].device == info.st_dev &&
+                    batch->loaded[i].inode == info.st_ino) {
+                        fclose(input);
+                        return batch->loaded[i].program;
+                }
+        }
+
+        batch->loaded = realloc(batch->loaded, (batch->num_loaded + 1) *
+                                               sizeof(struct loaded));
+        struct loaded *loaded = &batch->loaded[batch->num_loaded++];
+        loaded->device = info.st_dev;
+        loaded->inode = info.st_ino;
+        loaded->program = program_load(input);
+        fclose(input);
+        return loaded->program;
+}
+
+/* each program's gang still filling up is kept by its place in
+ * batch->loaded, found by a linear search as find_program finds it -- a job
+ * that cannot run is a gang of its own
+ */
+void form_gangs(struct batch *batch, unsigned lanes)
+{
+        uint32_t *filling = malloc((batch->num_loaded + 1) *
+                                   sizeof(uint32_t));
+
+        for (uint32_t i = 0; i < batch->num_loaded; i++) {
+                filling[i] = NO_GANG;
+        }
+        batch->gangs = malloc((2 * batch->num_jobs + 1) *
+                              sizeof(struct gang));
+        batch->num_gangs = 0;
+        for (uint32_t i = 0; i < batch->num_jobs; i++) {
+                UM_program program = batch->jobs[i].program;
+                uint32_t *open = NULL;
+
+                for (uint32_t p = 0; program != NULL &&
+                     p < batch->num_loaded; p++) {
+                        if (batch->loaded[p].program == program) {
+                                open = &filling[p];
+                                break;
+                        }
+                }
+                if (open == NULL || *open == NO_GANG) {
+                        batch->gangs[batch->num_gangs].size = 0;
+                        if (open != NULL) {
+                                *open = batch->num_gangs;
+                        }
+                        batch->num_gangs++;
+                }
+                struct gang *gang = open == NULL
+                                    ? &batch->gangs[batch->num_gangs - 1]
+                                    : &batch->gangs[*open];
+                gang->jobs[gang->size++] = i;
+                if (open != NULL && gang->size == lanes) {
+                        *open = NO_GANG;
+                }
+        }
+        free(filling);
+}
+
+/* round robin, so every worker starts with a share of each part of the
+ * manifest
+ */
+void deal_gangs(struct batch *batch)
+{
+        unsigned n = batch->num_workers;
+
+        batch->deques = malloc(n * sizeof(struct deque));
+        for (unsigned i = 0; i < n; i++) {
+                struct deque *deque = &batch->deques[i];
+                pthread_mutex_init(&deque->lock, NULL);
+                deque->capacity = batch->num_gangs / n + 1;
+                deque->gangs = malloc(deque->capacity * sizeof(uint32_t));
+                deque->top = 0;
+                deque->bottom = 0;
+        }
+        for (uint32_t i = 0; i < batch->num_gangs; i++) {
+                struct deque *deque = &batch->deques[i % n];
+                deque->gangs[deque->bottom++] = i;
+        }
+}
+
+uint32_t next_gang(struct batch *batch, unsigned id)
+{
+        struct deque *own = &batch->deques[id];
+        uint32_t gang = NO_GANG;
+
+        pthread_mutex_lock(&own->lock);
+        if (own->top < own->bottom) {
+                gang = own->gangs[--own->bottom];
+        }
+        pthread_mutex_unlock(&own->lock);
+
+        for (unsigned i = 1; gang == NO_GANG && i < batch->num_workers; i++) {
+                struct deque *victim =
+                        &batch->deques[(id + i) % batch->num_workers];
+                pthread_mutex_lock(&victim->lock);
+                if (victim->top < victim->bottom) {
+                        gang = victim->gangs[victim->top++];
+                }
+                pthread_mutex_unlock(&victim->lock);
+        }
+        return gang;
+}
+
+/* the space thieves have left at the front is used before the deque grows
+ * -- the gang is counted as pending before it is queued, so a thief that
+ * finishes it at once cannot take pending to 0 while it is still counted
+ */
+void push_gang(struct batch *batch, unsigned id, uint32_t gang)
+{
+        struct deque *own = &batch->deques[id];
+
+        pthread_mutex_lock(&batch->idle_lock);
+        batch->pending++;
+        pthread_mutex_unlock(&batch->idle_lock);
+
+        pthread_mutex_lock(&own->lock);
+        if (own->bottom == own->capacity) {
+                if (own->top > 0) {
+                        memmove(own->gangs, own->gangs + own->top,
+                                (own->bottom - own->top) * sizeof(uint32_t));
+                        own->bottom -= own->top;
+                        own->top = 0;
+                } else {
+                        own->capacity *= 2;
+                        own->gangs = realloc(own->gangs, own->capacity *
+                                                         sizeof(uint32_t));
+                }
+        }
+        own->gangs[own->bottom++] = gang;
+        pthread_mutex_unlock(&own->lock);
+
+        pthread_mutex_lock(&batch->idle_lock);
+        batch->pushes++;
+        pthread_cond_broadcast(&batch->idle);
+        pthread_mutex_unlock(&batch->idle_lock);
+}
+
+/* a worker that finds every deque empty waits until a gang is queued or
+ * none is pending -- pushes is read before the deques are looked at, so a
+ * gang queued in between is not missed
+ */
+void *worker_main(void *arg)
+{
+        struct worker *worker = arg;
+        struct batch *batch = worker->batch;
+
+        for (;;) {
+                pthread_mutex_lock(&batch->idle_lock);
+                uint64_t seen = batch->pushes;
+                pthread_mutex_unlock(&batch->idle_lock);
+
+                uint32_t gang = next_gang(batch, worker->id);
+                if (gang != NO_GANG) {
+                        run_gang(batch, worker->id, &batch->gangs[gang]);
+                        pthread_mutex_lock(&batch->idle_lock);
+                        if (--batch->pending == 0) {
+                                pthread_cond_broadcast(&batch->idle);
+                        }
+                        pthread_mutex_unlock(&batch->idle_lock);
+                        continue;
+                }
+
+                pthread_mutex_lock(&batch->idle_lock);
+                while (batch->pending > 0 && batch->pushes == seen) {
+                        pthread_cond_wait(&batch->idle, &batch->idle_lock);
+                }
+                int done = batch->pending == 0;
+                pthread_mutex_unlock(&batch->idle_lock);
+                if (done) {
+                        return NULL;
+                }
+        }
+}
+
+/* a job's output file is only created once its input has opened -- the
+ * files stay open until every job of the gang is done, but for those of
+ * the jobs that leave, which go with them
+ */
+void run_gang(struct batch *batch, unsigned id, struct gang *gang)
+{
+        struct running running;
+        int status[LOCKSTEP_LANES];
+        unsigned n = 0;
+
+        if (gang->size == 1 && batch->jobs[gang->jobs[0]].split != NULL) {
+                struct job *job = &batch->jobs[gang->jobs[0]];
+                struct split *split = job->split;
+
+                run_lane(split->mem, split->io, split->registers,
+                         &job->status);
+                close(split->in_fd);
+                close(split->out_fd);
+                free(split);
+                job->split = NULL;
+                return;
+        }
+
+        running.batch = batch;
+        running.id = id;
+        running.left = 0;
+        for (unsigned i = 0; i < gang->size; i++) {
+                struct job *job = &batch->jobs[gang->jobs[i]];
+                if (job->program == NULL) {
+                        continue;
+                }
+                int in_fd = open_job_file(job->input_path, O_RDONLY);
+                if (in_fd < 0) {
+                        continue;
+                }
+                int out_fd = open_job_file(job->output_path,
+                                           O_WRONLY | O_CREAT | O_TRUNC);
+                if (out_fd < 0) {
+                        close(in_fd);
+                        continue;
+                }
+                running.mems[n] = memory_from_program(job->program);
+                memory_limit(running.mems[n], batch->max_words);
+                running.ios[n] = io_new(in_fd, out_fd, batch->options);
+                running.jobs[n] = job;
+                running.fds[2 * n] = in_fd;
+                running.fds[2 * n + 1] = out_fd;
+                job->status = 0;
+                status[n] = 0;
+                n++;
+        }
+
+        if (n == 1) {
+                run_job(running.mems[0], running.ios[0], &status[0]);
+        } else if (n > 1) {
+                run_lockstep(running.mems, running.ios, status, n,
+                             leave_gang, &running);
+        }
+        for (unsigned i = 0; i < n; i++) {
+                if ((running.left >> i & 1) != 0) {
+                        continue;
+                }
+                running.jobs[i]->status = status[i];
+                close(running.fds[2 * i]);
+                close(running.fds[2 * i + 1]);
+        }
+}
+
+/* the lane's job status stays 0 until its own run says otherwise */
+void leave_gang(void *arg, unsigned lane, const uint32_t *registers)
+{
+        struct running *running = arg;
+        struct batch *batch = running->batch;
+        struct job *job = running->jobs[lane];
+        struct split *split = malloc(sizeof(struct split));
+        uint32_t index = job - batch->jobs;
+
+        split->mem = running->mems[lane];
+        split->io = running->ios[lane];
+        memcpy(split->registers, registers, sizeof(split->registers));
+        split->in_fd = running->fds[2 * lane];
+        split->out_fd = running->fds[2 * lane + 1];
+        job->split = split;
+        running->left |= 1u << lane;
+
+        struct gang *alone = &batch->gangs[batch->num_gangs + index];
+        alone->jobs[0] = index;
+        alone->size = 1;
+        push_gang(batch, running->id, batch->num_gangs + index);
+}
+
+/* - reads as empty and swallows writes */
+int open_job_file(const char *path, int flags)
+{
+        if (strcmp(path, "-") == 0) {
+                path = "/dev/null";
+        }
+        return open(path, flags, 0666);
+}
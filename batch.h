@@ -0,0 +1,50 @@
+/*
+ * batch.h
+ *      the interface for running many UM jobs in one process
+ *      a manifest lists one job per line -- a .um program, a file to read
+ *      its input from and a file to write its output to, separated by
+ *      white space, with - meaning no input or discarded output; blank
+ *      lines and lines starting with # are skipped
+ *      each program file is loaded once however many jobs name it, and the
+ *      jobs run on a pool of threads that steal work from each other, each
+ *      job with its own memory and registers
+ *      a job that halts or runs off the end of its program succeeds; one
+ *      that hits an invalid opcode, would fault (dividing by zero, or
+ *      loading outside a mapped segment, say), or cannot be started, fails
+ *      without disturbing the others
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef BATCH_H_INCLUDED_
+#define BATCH_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "segments.h"
+#include "umio.h"
+
+/* runs every job in the manifest on the given number of threads (0 for one
+ * per online processor), giving each job's output the given options and
+ * each job's memory a limit of max_words mapped words (see memory_limit) --
+ * jobs of one program run several to a thread in lockstep (see lockstep.h)
+ * if lockstep is not 0, and failed jobs are listed on stderr by manifest
+ * line
+ * returns 0 if every job succeeded and 1 otherwise
+ */
+int run_batch(const char *manifest, unsigned num_threads,
+              const struct io_options *options, uint64_t max_words,
+              int lockstep);
+
+/* Executes the instructions in the given UM_memory exactly as run_threaded
+ * does, except that it returns rather than exiting the process, storing 1 in
+ * *status if the program hit an invalid opcode, a refused map or an
+ * instruction that would fault (see ENGINE_CHECKS in threaded_body.h), and
+ * leaving it alone otherwise -- the memory and the UM_io are freed either
+ * way
+ */
+void run_job(UM_memory mem, UM_io io, int *status);
+
+#endif /* BATCH_H_INCLUDED_ */
@@ -0,0 +1,84 @@
+/*
+ * byteswap.c
+ *      the implementation for bulk big-endian to host-order conversion
+ *      on x86-64 hosts that support SSSE3 (checked at run time), 4 words at
+ *      a time are byte-reversed with a single pshufb; everywhere else, and
+ *      for the last few words, the words are assembled byte by byte
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#include <stdint.h>
+#include "byteswap.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <tmmintrin.h>
+#define HAVE_SSSE3_KERNEL 1
+#endif
+
+#define WORDS_PER_VECTOR 4
+
+/****** private helper function declarations ******/
+
+/* assembles each word from its four bytes, most significant first */
+void swap_words_scalar(uint32_t *words, const unsigned char *bytes,
+                       uint32_t num_words);
+
+#ifdef HAVE_SSSE3_KERNEL
+/* reverses the bytes of each word 4 words at a time, returns how many words
+ * it converted
+ */
+uint32_t swap_words_ssse3(uint32_t *words, const unsigned char *bytes,
+                          uint32_t num_words)
+        __attribute__((target("ssse3")));
+#endif
+
+/**************************************************/
+
+/* uses the vector kernel for as much of the input as the host allows and
+ * finishes the rest one word at a time
+ */
+void swap_words(uint32_t *words, const unsigned char *bytes,
+                uint32_t num_words)
+{
+        uint32_t done = 0;
+#ifdef HAVE_SSSE3_KERNEL
+        if (__builtin_cpu_supports("ssse3")) {
+                done = swap_words_ssse3(words, bytes, num_words);
+        }
+#endif
+        swap_words_scalar(words + done, bytes + done * sizeof(uint32_t),
+                          num_words - done);
+}
+
+/****** private helper function definitions ******/
+
+/* big-endian: the first byte of each word is the most significant */
+void swap_words_scalar(uint32_t *words, const unsigned char *bytes,
+                       uint32_t num_words)
+{
+        for (uint32_t i = 0; i < num_words; i++) {
+                const unsigned char *b = bytes + i * sizeof(uint32_t);
+                words[i] = (uint32_t) b[0] << 24 | (uint32_t) b[1] << 16 |
+                           (uint32_t) b[2] << 8 | (uint32_t) b[3];
+        }
+}
+
+#ifdef HAVE_SSSE3_KERNEL
+/* the shuffle mask maps byte i of each word to byte 3 - i */
+uint32_t swap_words_ssse3(uint32_t *words, const unsigned char *bytes,
+                          uint32_t num_words)
+{
+        const __m128i reverse = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+                                             4, 5, 6, 7, 0, 1, 2, 3);
+        uint32_t i = 0;
+        for (; i + WORDS_PER_VECTOR <= num_words; i += WORDS_PER_VECTOR) {
+                __m128i v = _mm_loadu_si128((const __m128i *)
+                                            (bytes + i * sizeof(uint32_t)));
+                _mm_storeu_si128((__m128i *) (words + i),
+                                 _mm_shuffle_epi8(v, reverse));
+        }
+        return i;
+}
+#endif
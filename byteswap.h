@@ -0,0 +1,21 @@
+/*
+ * byteswap.h
+ *      the interface for converting big-endian UM program images into
+ *      host-order words in bulk
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef BYTESWAP_H_INCLUDED_
+#define BYTESWAP_H_INCLUDED_
+
+#include <stdint.h>
+
+/* reads num_words big-endian 32 bit words from bytes and stores them, in
+ * host order, in words -- the two buffers must not overlap
+ */
+void swap_words(uint32_t *words, const unsigned char *bytes,
+                uint32_t num_words);
+
+#endif /* BYTESWAP_H_INCLUDED_ */
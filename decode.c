@@ -0,0 +1,52 @@
+/*
+ * decode.c
+ *      the implementation for the instruction decoder of the UM
+ *      the fields are pulled out with shifts and masks rather than Bitpack,
+ *      since a whole 0-segment is decoded at once
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#include <stdint.h>
+#include "decode.h"
+
+#define OPCODE_LSB 28
+#define REG_MASK 0x7
+#define A_LSB 6
+#define B_LSB 3
+#define LOAD_VAL_OPCODE 13
+#define LOAD_VAL_A_LSB 25
+#define LOAD_VAL_MASK 0x1ffffff
+#define SPECIAL_OPCODE_LSB 9
+
+/* splits the word into its opcode and either its three register fields or
+ * its load_value register and immediate
+ */
+void decode_word(uint32_t word, struct decoded *inst)
+{
+        inst->opcode = word >> OPCODE_LSB;
+        if (inst->opcode == LOAD_VAL_OPCODE) {
+                inst->a = (word >> LOAD_VAL_A_LSB) & REG_MASK;
+                inst->b = 0;
+                inst->c = 0;
+                inst->value = word & LOAD_VAL_MASK;
+        } else {
+                inst->a = (word >> A_LSB) & REG_MASK;
+                inst->b = (word >> B_LSB) & REG_MASK;
+                inst->c = word & REG_MASK;
+                inst->value = 0;
+        }
+        inst->handler = inst->opcode;
+        inst->special = inst->opcode << SPECIAL_OPCODE_LSB |
+                        inst->a << A_LSB | inst->b << B_LSB | inst->c;
+}
+
+/* decodes every word in the array into the matching decoded entry */
+void decode_words(const uint32_t *words, struct decoded *insts,
+                  uint32_t num_words)
+{
+        for (uint32_t i = 0; i < num_words; i++) {
+                decode_word(words[i], &insts[i]);
+        }
+}
@@ -0,0 +1,48 @@
+/*
+ * decode.h
+ *      the interface for the instruction decoder of the UM
+ *      splits 32 bit instruction words into their opcode and operand fields
+ *      once, so that an engine can execute the same word many times without
+ *      unpacking it again
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef DECODE_H_INCLUDED_
+#define DECODE_H_INCLUDED_
+
+#include <stdint.h>
+
+/* an unpacked instruction -- for load_value (opcode 13), a is the register
+ * being loaded and value is the 25 bit immediate; for every other opcode,
+ * a, b and c are the register fields and value is unused
+ * handler is what the direct-threaded engines dispatch on: the opcode, or a
+ * superinstruction that peephole.c has found starting at this word (see
+ * peephole.h) -- every other field always describes this word alone
+ * special is what the specialized engine dispatches on: opcode * 512 +
+ * a * 64 + b * 8 + c, naming the handler built for exactly this opcode and
+ * these registers (b and c are 0 for load_value)
+ */
+struct decoded {
+        uint8_t opcode;
+        uint8_t a;
+        uint8_t b;
+        uint8_t c;
+        uint32_t value;
+        uint8_t handler;
+        uint16_t special;
+};
+
+/* unpacks the given instruction word into *inst, with the opcode as its
+ * handler and its opcode and registers as its special handler
+ */
+void decode_word(uint32_t word, struct decoded *inst);
+
+/* unpacks each of the num_words instruction words into the matching entry
+ * of the insts array, which must have room for num_words entries
+ */
+void decode_words(const uint32_t *words, struct decoded *insts,
+                  uint32_t num_words);
+
+#endif /* DECODE_H_INCLUDED_ */
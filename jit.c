@@ -0,0 +1,763 @@
+/*
+ * jit.c
+ *      the implementation for the x86-64 JIT tier of the UM
+ *      cold code runs in the direct-threaded engine of threaded_body.h,
+ *      instantiated here with hooks that count how often each load_program
+ *      target is reached; once one has been reached JIT_THRESHOLD times, the
+ *      run of the 0-segment starting there is translated into native code
+ *      and every later load_program to it enters that code instead
+ *      a run goes on through every instruction but halt, the invalid
+ *      opcodes and load_program: loads, stores, map, unmap, output and input
+ *      call the same segments.c and umio.c functions the engines do, so a
+ *      run is a whole basic block of the program, however much it does
+ *      native code holds UM registers 0-7 in r8d-r15d from the moment it is
+ *      entered until it returns to the engine, and load_program to segment
+ *      0 jumps straight from one run to the next through the table of
+ *      translated targets -- so a hot loop stays in native code, with its
+ *      registers in host registers, across any number of jumps
+ *      native code returns to the engine, at the instruction it cannot run,
+ *      for halt and the invalid opcodes, a store that might hit the
+ *      0-segment, a refused map, a load_program that installs a new program
+ *      or goes to a target not translated yet, and every JIT_CHAIN jumps, so
+ *      that io_tick and the live counters (see stats.h) are never far behind
+ *      translations are thrown away when the engine stores into a word some
+ *      run covers, and when load_program installs a 0-segment that is not
+ *      word for word the one they were made from; the tables and the code
+ *      region are kept and reused rather than made again
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "jit.h"
+#include "threaded.h"
+#include "stats.h"
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+#include "operations.h"
+#include "peephole.h"
+
+#define JIT_CODE_SIZE (16 * 1024 * 1024)
+#define JIT_THRESHOLD 32
+#define JIT_MAX_BLOCK 4096
+#define JIT_CHAIN 1024
+
+/* worst case bytes: the entry and exit stubs, the jump at the end of a
+ * run, and for each instruction its code and its way out
+ */
+#define STUB_BYTES 128
+#define BLOCK_OVERHEAD 256
+#define MAX_INST_BYTES 128
+
+/* host register numbers, as used in ModRM and REX encodings */
+#define EAX 0
+#define ECX 1
+#define EDX 2
+#define EBX 3
+#define ESI 6
+#define RDI 7
+#define UM_REG(r) (8 + (r))
+
+/* the UM registers held in registers a call may clobber: r8d-r11d */
+#define CLOBBERED_UM_REGS 4
+
+/* what native code works on, reached through rbx -- registers hold the UM
+ * registers whenever the engine has them, chain is how many more jumps the
+ * code may take before it goes back to the engine, and executed and jumps
+ * are how many instructions and load_programs it has run since it was
+ * entered
+ */
+struct native_state {
+        uint32_t registers[8];
+        UM_memory mem;
+        UM_io io;
+        uint8_t **blocks;
+        uint32_t length;
+        uint32_t chain;
+        uint64_t executed;
+        uint64_t jumps;
+};
+
+/* enters the run at block, returning the offset of the instruction the
+ * engine is to dispatch next
+ */
+typedef uint32_t (*enter_fn)(struct native_state *state, uint8_t *block);
+
+/* translation state for one run of the machine -- the tables have an entry
+ * per word of the 0-segment, and room for capacity entries
+ */
+struct jit {
+        uint8_t *code;          /* executable region runs are emitted to */
+        uint32_t used;          /* bytes of the region in use */
+        uint32_t length;        /* length of the 0-segment the tables cover */
+        uint32_t capacity;      /* entries the tables have room for */
+        uint8_t **blocks;       /* native entry for a run starting here */
+        uint16_t *counts;       /* times a load_program has come here */
+        uint8_t *covered;       /* 1 for each word some run depends on */
+        int replaced;           /* 1 once load_program is installing a
+                                   0-segment unlike the translated one */
+        enter_fn enter;         /* the stub that enters native code */
+        uint8_t *exit;          /* the stub native code leaves through */
+        struct native_state state;
+};
+
+/* a place in a run's code that leaves for the engine at the given
+ * instruction, through a stub emitted after the run
+ */
+struct way_out {
+        uint8_t *patch;
+        uint32_t offset;
+};
+
+/****** private helper function declarations ******/
+
+/* maps the executable region and emits the entry and exit stubs into it --
+ * returns 0 if executable memory is not allowed
+ */
+int jit_init(struct jit *jit, UM_memory mem, UM_io io);
+
+/* frees the region and the tables */
+void jit_free(struct jit *jit);
+
+/* the engine's ENGINE_JUMP hook: notes whether load_program from the given
+ * segment will install a 0-segment with other words than the current one
+ */
+void jit_jump(struct jit *jit, UM_memory mem, uint32_t segment);
+
+/* the engine's ENGINE_PROGRAM hook: sizes the tables for a 0-segment of the
+ * given length, discarding every translation if it has been replaced
+ */
+void jit_program(struct jit *jit, uint32_t length);
+
+/* the engine's ENGINE_STORE hook: discards every translation if a store
+ * into the 0-segment changed a word some run depends on
+ */
+void jit_store(struct jit *jit, uint32_t segment, uint32_t offset);
+
+/* the engine's ENGINE_TARGET hook: counts a load_program to pc, translating
+ * the run there once it is hot, and runs it natively if it is translated,
+ * adding the instructions it ran to the live counters -- returns the offset
+ * of the next instruction for the engine
+ */
+uint32_t jit_enter(struct jit *jit, const struct decoded *code,
+                   uint32_t *registers, uint32_t pc,
+                   struct live_counters *live);
+
+/* discards all translations, keeping the tables and the region */
+void jit_flush(struct jit *jit);
+
+/* translates the run of the 0-segment starting at pc */
+void translate(struct jit *jit, const struct decoded *code, uint32_t length,
+               uint32_t pc);
+
+/* emits native code for one move, add, multiply, divide, nand or
+ * load_value
+ */
+uint8_t *emit_instruction(uint8_t *p, const struct decoded *inst);
+
+/* emits the native code for load_program at the given offset: a jump
+ * straight into the run at its target, when that is in segment 0 and
+ * translated -- each way back to the engine is added to outs
+ */
+uint8_t *emit_jump(uint8_t *p, const struct decoded *inst, uint32_t offset,
+                   struct way_out *outs, uint32_t *num_outs);
+
+/* emits a call to fn, saving and restoring the UM registers in r8d-r11d
+ * around it -- arguments are set up by setup, a function emitting the
+ * moves into edi, esi, edx and ecx, given inst
+ */
+uint8_t *emit_call(uint8_t *p, void (*fn)(void),
+                   uint8_t *(*setup)(uint8_t *, const struct decoded *),
+                   const struct decoded *inst);
+
+/* argument set-ups for emit_call: the memory and the registers b and c (a
+ * load), the memory and registers a, b and c (a store), the memory and
+ * register c (map and unmap), the UM_io and register c (output), and the
+ * UM_io alone (input)
+ */
+uint8_t *args_load(uint8_t *p, const struct decoded *inst);
+uint8_t *args_store(uint8_t *p, const struct decoded *inst);
+uint8_t *args_segment(uint8_t *p, const struct decoded *inst);
+uint8_t *args_output(uint8_t *p, const struct decoded *inst);
+uint8_t *args_input(uint8_t *p, const struct decoded *inst);
+
+/* emits a conditional jump (condition code cc, or an unconditional one if
+ * cc is -1) back to the engine at the given offset, added to outs
+ */
+uint8_t *emit_out(uint8_t *p, int cc, uint32_t offset, struct way_out *outs,
+                  uint32_t *num_outs);
+
+/* emits a conditional jump with a 32 bit displacement to be patched once
+ * the target is known, returning where the displacement goes
+ */
+uint8_t *emit_jcc(uint8_t **p, int cc);
+
+/* points the displacement at patch to target */
+void patch_jump(uint8_t *patch, const uint8_t *target);
+
+/* emits a register to register instruction with the given opcode bytes,
+ * choosing the REX prefix for the reg and rm operands
+ */
+uint8_t *emit_rr(uint8_t *p, const uint8_t *opcode, int opcode_len, int reg,
+                 int rm);
+
+/* emits an instruction on [rbx + offset], the native state -- wide is 1
+ * for a 64 bit operand, and reg is the register or opcode extension
+ */
+uint8_t *emit_state(uint8_t *p, int wide, uint8_t opcode, int reg,
+                    size_t offset);
+
+/**************************************************/
+
+/* the engine, with native code entered from its load_program */
+#define ENGINE_NAME run_native
+#define ENGINE_EXTRA_PARAMS , struct jit *jit
+#define ENGINE_CHECKS 0
+#define ENGINE_HANDLER(inst) (inst)->handler
+#define ENGINE_START(registers)
+#define ENGINE_FETCH(pc, inst)
+#define ENGINE_STORE(segment, offset) jit_store(jit, segment, offset)
+#define ENGINE_PROGRAM(length) jit_program(jit, length)
+#define ENGINE_MAP(index, size)
+#define ENGINE_UNMAP(index)
+#define ENGINE_JUMP(segment, offset) jit_jump(jit, mem, segment)
+#define ENGINE_TARGET(pc) pc = jit_enter(jit, code, registers, pc, live)
+#define ENGINE_OUTPUT(value)
+#define ENGINE_INPUT(value)
+#define ENGINE_EXIT()
+#define ENGINE_STOP(status)                                             \
+        do {                                                            \
+                jit_free(jit);                                          \
+                exit(status);                                           \
+        } while (0)
+
+#include "threaded_body.h"
+
+/* the tables are sized by the engine's first ENGINE_PROGRAM */
+void run_jit(UM_memory mem, UM_io io)
+{
+        struct jit jit;
+
+        if (jit_init(&jit, mem, io) == 0) {
+                run_threaded(mem, io);
+                return;
+        }
+        run_native(mem, io, &jit);
+        jit_free(&jit);
+}
+
+/****** private helper function definitions ******/
+
+/* the entry stub saves the callee-saved registers it uses, points rbx at
+ * the state and loads the UM registers; the exit stub undoes all that --
+ * five pushes leave the stack 16 byte aligned for the calls native code
+ * makes
+ */
+int jit_init(struct jit *jit, UM_memory mem, UM_io io)
+{
+        static const uint8_t pushes[] = { 0x53, 0x41, 0x54, 0x41, 0x55,
+                                          0x41, 0x56, 0x41, 0x57 };
+        static const uint8_t pops[] = { 0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d,
+                                        0x41, 0x5c, 0x5b, 0xc3 };
+        static const uint8_t mov_rbx_rdi[] = { 0x48, 0x89, 0xfb };
+        static const uint8_t jmp_rsi[] = { 0xff, 0xe6 };
+
+        memset(jit, 0, sizeof(*jit));
+        void *region = mmap(NULL, JIT_CODE_SIZE,
+                            PROT_READ | PROT_WRITE | PROT_EXEC,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) {
+                return 0;
+        }
+        jit->code = region;
+        jit->state.mem = mem;
+        jit->state.io = io;
+
+        uint8_t *p = jit->code;
+        memcpy(p, pushes, sizeof(pushes));
+        p += sizeof(pushes);
+        memcpy(p, mov_rbx_rdi, sizeof(mov_rbx_rdi));
+        p += sizeof(mov_rbx_rdi);
+        for (int r = 0; r < 8; r++) {
+                p = emit_state(p, 0, 0x8b, UM_REG(r),
+                               r * sizeof(uint32_t));
+        }
+        memcpy(p, jmp_rsi, sizeof(jmp_rsi));
+        p += sizeof(jmp_rsi);
+
+        jit->exit = p;
+        for (int r = 0; r < 8; r++) {
+                p = emit_state(p, 0, 0x89, UM_REG(r),
+                               r * sizeof(uint32_t));
+        }
+        memcpy(p, pops, sizeof(pops));
+        p += sizeof(pops);
+        jit->used = STUB_BYTES;
+
+        /* ISO C has no object to function pointer cast, so copy the bits */
+        void *entry = jit->code;
+        memcpy(&jit->enter, &entry, sizeof(jit->enter));
+        return 1;
+}
+
+/* unmaps the region and frees the tables */
+void jit_free(struct jit *jit)
+{
+        munmap(jit->code, JIT_CODE_SIZE);
+        free(jit->blocks);
+        free(jit->counts);
+        free(jit->covered);
+}
+
+/* a program that reloads a copy of itself keeps its translations */
+void jit_jump(struct jit *jit, UM_memory mem, uint32_t segment)
+{
+        if (segment != 0) {
+                jit->replaced = segment_is_program(mem, segment) == 0;
+        }
+}
+
+/* the tables only ever grow, and are cleared rather than made again */
+void jit_program(struct jit *jit, uint32_t length)
+{
+        if (jit->replaced == 1) {
+                jit_flush(jit);
+                jit->replaced = 0;
+        }
+        if (length + 1 > jit->capacity) {
+                uint32_t old = jit->capacity;
+                uint32_t capacity = length + 1;
+
+                jit->blocks = realloc(jit->blocks,
+                                      capacity * sizeof(uint8_t *));
+                jit->counts = realloc(jit->counts,
+                                      capacity * sizeof(uint16_t));
+                jit->covered = realloc(jit->covered, capacity);
+                memset(jit->blocks + old, 0,
+                       (capacity - old) * sizeof(uint8_t *));
+                memset(jit->counts + old, 0,
+                       (capacity - old) * sizeof(uint16_t));
+                memset(jit->covered + old, 0, capacity - old);
+                jit->capacity = capacity;
+        }
+        jit->length = length;
+}
+
+void jit_store(struct jit *jit, uint32_t segment, uint32_t offset)
+{
+        if (segment == 0 && offset < jit->length &&
+            jit->covered[offset] == 1) {
+                jit_flush(jit);
+        }
+}
+
+/* the registers go into the state for native code, and come back out of
+ * it once native code returns
+ */
+uint32_t jit_enter(struct jit *jit, const struct decoded *code,
+                   uint32_t *registers, uint32_t pc,
+                   struct live_counters *live)
+{
+        struct native_state *state = &jit->state;
+
+        if (pc >= jit->length) {
+                return pc;
+        }
+        if (jit->blocks[pc] == NULL) {
+                if (++jit->counts[pc] < JIT_THRESHOLD) {
+                        return pc;
+                }
+                translate(jit, code, jit->length, pc);
+        }
+
+        memcpy(state->registers, registers, sizeof(state->registers));
+        state->blocks = jit->blocks;
+        state->length = jit->length;
+        state->chain = JIT_CHAIN;
+        state->executed = 0;
+        state->jumps = 0;
+        pc = jit->enter(state, jit->blocks[pc]);
+        memcpy(registers, state->registers, sizeof(state->registers));
+        live->instructions += state->executed;
+        live->load_programs += state->jumps;
+        return pc;
+}
+
+/* clears every table and starts emitting just after the stubs again */
+void jit_flush(struct jit *jit)
+{
+        memset(jit->blocks, 0, jit->capacity * sizeof(uint8_t *));
+        memset(jit->counts, 0, jit->capacity * sizeof(uint16_t));
+        memset(jit->covered, 0, jit->capacity);
+        jit->used = STUB_BYTES;
+}
+
+/* emits the run starting at pc up to and including its last instruction,
+ * then a stub for each way back to the engine, which returns its offset
+ * through the exit stub
+ * the run counts all its instructions as executed on entry, and each stub
+ * takes back the ones from its offset on, which the engine will run
+ */
+void translate(struct jit *jit, const struct decoded *code, uint32_t length,
+               uint32_t pc)
+{
+        static const uint8_t test[] = { 0x85 };     /* test r/m32, r32 */
+        static const uint8_t mov[] = { 0x89 };      /* mov r/m32, r32 */
+        static const uint8_t cmp_imm[] = { 0x81 };  /* cmp = /7, imm32 */
+        static const uint8_t cmp_eax_refused[] = { 0x83, 0xf8, 0xff };
+        static const uint32_t max_byte = 255;
+        uint32_t n = 0;
+        int ended = 0;
+
+        while (pc + n < length && n < JIT_MAX_BLOCK && ended == 0) {
+                uint8_t opcode = code[pc + n].opcode;
+                ended = opcode == 7 || opcode == 12 || opcode > 13;
+                n++;
+        }
+        uint32_t needed = BLOCK_OVERHEAD + n * MAX_INST_BYTES;
+        if (jit->used + needed > JIT_CODE_SIZE) {
+                jit_flush(jit);
+        }
+
+        /* load_program has the most ways out, four */
+        struct way_out *outs = malloc((n + 4) * sizeof(struct way_out));
+        uint32_t num_outs = 0;
+        uint8_t *start = jit->code + jit->used;
+        uint8_t *p = start;
+
+        p = emit_state(p, 1, 0x81, 0,
+                       offsetof(struct native_state, executed));
+        memcpy(p, &n, sizeof(n));                  /* add qword, imm32 */
+        p += sizeof(n);
+
+        for (uint32_t offset = pc; offset < pc + n; offset++) {
+                const struct decoded *inst = &code[offset];
+                uint8_t *skip;
+
+                switch (inst->opcode) {
+                case 1:
+                        p = emit_call(p, (void (*)(void)) segments_load,
+                                      args_load, inst);
+                        p = emit_rr(p, mov, 1, EAX, UM_REG(inst->a));
+                        break;
+                case 2:
+                        /* a store that might hit the 0-segment is left to
+                           the engine, which keeps the translations right */
+                        p = emit_rr(p, test, 1, UM_REG(inst->a),
+                                    UM_REG(inst->a));
+                        p = emit_out(p, 0x4, offset, outs, &num_outs);
+                        p = emit_call(p, (void (*)(void)) segments_store,
+                                      args_store, inst);
+                        break;
+                case 8:
+                        /* the engine maps again and reports the refusal */
+                        p = emit_call(p, (void (*)(void)) map_segment,
+                                      args_segment, inst);
+                        memcpy(p, cmp_eax_refused, sizeof(cmp_eax_refused));
+                        p += sizeof(cmp_eax_refused);
+                        p = emit_out(p, 0x4, offset, outs, &num_outs);
+                        p = emit_rr(p, mov, 1, EAX, UM_REG(inst->b));
+                        break;
+                case 9:
+                        p = emit_call(p, (void (*)(void)) unmap_segment,
+                                      args_segment, inst);
+                        break;
+                case 10:
+                        /* values over 255 are not output, as in output() */
+                        p = emit_rr(p, cmp_imm, 1, 7, UM_REG(inst->c));
+                        memcpy(p, &max_byte, sizeof(max_byte));
+                        p += sizeof(max_byte);
+                        skip = emit_jcc(&p, 0x7);
+                        p = emit_call(p, (void (*)(void)) io_put,
+                                      args_output, inst);
+                        patch_jump(skip, p);
+                        break;
+                case 11:
+                        /* io_get's EOF is -1, which is ~0 as input() leaves
+                           it, and anything else is a byte */
+                        p = emit_call(p, (void (*)(void)) io_get,
+                                      args_input, inst);
+                        p = emit_rr(p, mov, 1, EAX, UM_REG(inst->c));
+                        break;
+                case 12:
+                        p = emit_jump(p, inst, offset, outs, &num_outs);
+                        break;
+                case 0: case 3: case 4: case 5: case 6: case 13:
+                        p = emit_instruction(p, inst);
+                        break;
+                default:
+                        /* halt and the invalid opcodes */
+                        p = emit_out(p, -1, offset, outs, &num_outs);
+                        break;
+                }
+        }
+        if (ended == 0) {
+                /* the run stopped at the end of the segment or the cap */
+                p = emit_out(p, -1, pc + n, outs, &num_outs);
+        }
+
+        for (uint32_t i = 0; i < num_outs; i++) {
+                uint32_t not_run = pc + n - outs[i].offset;
+
+                patch_jump(outs[i].patch, p);
+                if (not_run > 0) {
+                        p = emit_state(p, 1, 0x81, 5,
+                                       offsetof(struct native_state,
+                                                executed));
+                        memcpy(p, &not_run, sizeof(not_run));
+                        p += sizeof(not_run);     /* sub qword, imm32 */
+                }
+                *p++ = 0xb8;                    /* mov eax, imm32 */
+                memcpy(p, &outs[i].offset, sizeof(uint32_t));
+                p += sizeof(uint32_t);
+                patch_jump(emit_jcc(&p, -1), jit->exit);
+        }
+        free(outs);
+
+        jit->used += p - start;
+        jit->blocks[pc] = start;
+        memset(&jit->covered[pc], 1, n);
+}
+
+/* results are built in eax and then moved to the target register, so a
+ * target that is also a source is handled correctly
+ */
+uint8_t *emit_instruction(uint8_t *p, const struct decoded *inst)
+{
+        static const uint8_t mov[] = { 0x89 };       /* mov r/m32, r32 */
+        static const uint8_t add[] = { 0x01 };       /* add r/m32, r32 */
+        static const uint8_t imul[] = { 0x0f, 0xaf }; /* imul r32, r/m32 */
+        static const uint8_t and_rm[] = { 0x21 };    /* and r/m32, r32 */
+        static const uint8_t xor_rm[] = { 0x31 };    /* xor r/m32, r32 */
+        static const uint8_t group3[] = { 0xf7 };    /* not = /2, div = /6 */
+        static const uint8_t test[] = { 0x85 };      /* test r/m32, r32 */
+        static const uint8_t cmovne[] = { 0x0f, 0x45 };
+        int a = UM_REG(inst->a), b = UM_REG(inst->b), c = UM_REG(inst->c);
+
+        switch (inst->opcode) {
+        case 0:
+                p = emit_rr(p, test, 1, c, c);
+                p = emit_rr(p, cmovne, 2, a, b);
+                break;
+        case 3:
+                p = emit_rr(p, mov, 1, b, EAX);
+                p = emit_rr(p, add, 1, c, EAX);
+                p = emit_rr(p, mov, 1, EAX, a);
+                break;
+        case 4:
+                p = emit_rr(p, mov, 1, b, EAX);
+                p = emit_rr(p, imul, 2, EAX, c);
+                p = emit_rr(p, mov, 1, EAX, a);
+                break;
+        case 5:
+                p = emit_rr(p, mov, 1, b, EAX);
+                p = emit_rr(p, xor_rm, 1, EDX, EDX);
+                p = emit_rr(p, group3, 1, 6, c);
+                p = emit_rr(p, mov, 1, EAX, a);
+                break;
+        case 6:
+                p = emit_rr(p, mov, 1, b, EAX);
+                p = emit_rr(p, and_rm, 1, c, EAX);
+                p = emit_rr(p, group3, 1, 2, EAX);
+                p = emit_rr(p, mov, 1, EAX, a);
+                break;
+        case 13:
+                /* mov r32, imm32 with REX.B for r8d-r15d */
+                *p++ = 0x41;
+                *p++ = 0xb8 + (a & 7);
+                memcpy(p, &inst->value, sizeof(uint32_t));
+                p += sizeof(uint32_t);
+                break;
+        }
+        return p;
+}
+
+/* the target's native entry is read from the table through rax, with the
+ * UM register c (zero-extended, as every 32 bit write leaves it) as the
+ * index; every JIT_CHAIN jumps the run goes back to the engine anyway
+ */
+uint8_t *emit_jump(uint8_t *p, const struct decoded *inst, uint32_t offset,
+                   struct way_out *outs, uint32_t *num_outs)
+{
+        static const uint8_t test[] = { 0x85 };      /* test r/m32, r32 */
+        static const uint8_t test_rax[] = { 0x48, 0x85, 0xc0 };
+        static const uint8_t jmp_rax[] = { 0xff, 0xe0 };
+        int b = UM_REG(inst->b), c = UM_REG(inst->c);
+
+        p = emit_rr(p, test, 1, b, b);
+        p = emit_out(p, 0x5, offset, outs, num_outs);
+        p = emit_state(p, 0, 0x83, 5,
+                       offsetof(struct native_state, chain));
+        *p++ = 1;                                  /* sub dword, 1 */
+        p = emit_out(p, 0x4, offset, outs, num_outs);
+        p = emit_state(p, 0, 0x3b, c,
+                       offsetof(struct native_state, length));
+        p = emit_out(p, 0x3, offset, outs, num_outs);
+        p = emit_state(p, 1, 0x8b, EAX,
+                       offsetof(struct native_state, blocks));
+        /* mov rax, [rax + index * 8]: REX.W and REX.X, then a SIB byte */
+        *p++ = 0x4a;
+        *p++ = 0x8b;
+        *p++ = 0x04;
+        *p++ = 0xc0 | ((c & 7) << 3) | EAX;
+        memcpy(p, test_rax, sizeof(test_rax));
+        p += sizeof(test_rax);
+        p = emit_out(p, 0x4, offset, outs, num_outs);
+        p = emit_state(p, 1, 0x83, 0,
+                       offsetof(struct native_state, jumps));
+        *p++ = 1;                                  /* add qword, 1 */
+        memcpy(p, jmp_rax, sizeof(jmp_rax));
+        p += sizeof(jmp_rax);
+        return p;
+}
+
+/* r12d-r15d are callee-saved, so only r8d-r11d go through the state */
+uint8_t *emit_call(uint8_t *p, void (*fn)(void),
+                   uint8_t *(*setup)(uint8_t *, const struct decoded *),
+                   const struct decoded *inst)
+{
+        static const uint8_t call_rax[] = { 0xff, 0xd0 };
+        uint64_t address;
+
+        for (int r = 0; r < CLOBBERED_UM_REGS; r++) {
+                p = emit_state(p, 0, 0x89, UM_REG(r), r * sizeof(uint32_t));
+        }
+        p = setup(p, inst);
+
+        /* ISO C has no function pointer to integer cast, so copy the bits */
+        memcpy(&address, &fn, sizeof(address));
+        *p++ = 0x48;                               /* mov rax, imm64 */
+        *p++ = 0xb8;
+        memcpy(p, &address, sizeof(address));
+        p += sizeof(address);
+        memcpy(p, call_rax, sizeof(call_rax));
+        p += sizeof(call_rax);
+
+        for (int r = 0; r < CLOBBERED_UM_REGS; r++) {
+                p = emit_state(p, 0, 0x8b, UM_REG(r), r * sizeof(uint32_t));
+        }
+        return p;
+}
+
+uint8_t *args_load(uint8_t *p, const struct decoded *inst)
+{
+        static const uint8_t mov[] = { 0x89 };
+
+        p = emit_state(p, 1, 0x8b, RDI, offsetof(struct native_state, mem));
+        p = emit_rr(p, mov, 1, UM_REG(inst->b), ESI);
+        p = emit_rr(p, mov, 1, UM_REG(inst->c), EDX);
+        return p;
+}
+
+uint8_t *args_store(uint8_t *p, const struct decoded *inst)
+{
+        static const uint8_t mov[] = { 0x89 };
+
+        p = emit_state(p, 1, 0x8b, RDI, offsetof(struct native_state, mem));
+        p = emit_rr(p, mov, 1, UM_REG(inst->a), ESI);
+        p = emit_rr(p, mov, 1, UM_REG(inst->b), EDX);
+        p = emit_rr(p, mov, 1, UM_REG(inst->c), ECX);
+        return p;
+}
+
+uint8_t *args_segment(uint8_t *p, const struct decoded *inst)
+{
+        static const uint8_t mov[] = { 0x89 };
+
+        p = emit_state(p, 1, 0x8b, RDI, offsetof(struct native_state, mem));
+        p = emit_rr(p, mov, 1, UM_REG(inst->c), ESI);
+        return p;
+}
+
+uint8_t *args_output(uint8_t *p, const struct decoded *inst)
+{
+        static const uint8_t mov[] = { 0x89 };
+
+        p = emit_state(p, 1, 0x8b, RDI, offsetof(struct native_state, io));
+        p = emit_rr(p, mov, 1, UM_REG(inst->c), ESI);
+        return p;
+}
+
+uint8_t *args_input(uint8_t *p, const struct decoded *inst)
+{
+        (void) inst;
+        return emit_state(p, 1, 0x8b, RDI,
+                          offsetof(struct native_state, io));
+}
+
+/* the stub it leads to is emitted, and the jump patched, after the run */
+uint8_t *emit_out(uint8_t *p, int cc, uint32_t offset, struct way_out *outs,
+                  uint32_t *num_outs)
+{
+        outs[*num_outs].patch = emit_jcc(&p, cc);
+        outs[*num_outs].offset = offset;
+        (*num_outs)++;
+        return p;
+}
+
+/* jcc rel32 is 0f 80+cc, and jmp rel32 is e9 */
+uint8_t *emit_jcc(uint8_t **p, int cc)
+{
+        if (cc < 0) {
+                *(*p)++ = 0xe9;
+        } else {
+                *(*p)++ = 0x0f;
+                *(*p)++ = 0x80 + cc;
+        }
+        uint8_t *patch = *p;
+        *p += sizeof(int32_t);
+        return patch;
+}
+
+/* displacements count from the end of the instruction, just after them */
+void patch_jump(uint8_t *patch, const uint8_t *target)
+{
+        int32_t displacement = target - (patch + sizeof(int32_t));
+        memcpy(patch, &displacement, sizeof(displacement));
+}
+
+/* REX.R extends the reg field and REX.B the rm field */
+uint8_t *emit_rr(uint8_t *p, const uint8_t *opcode, int opcode_len, int reg,
+                 int rm)
+{
+        uint8_t rex = 0x40 | ((reg >> 3) << 2) | (rm >> 3);
+        if (rex != 0x40) {
+                *p++ = rex;
+        }
+        memcpy(p, opcode, opcode_len);
+        p += opcode_len;
+        *p++ = 0xc0 | ((reg & 7) << 3) | (rm & 7);
+        return p;
+}
+
+/* [rbx + disp8] addressing: mod 01, rm 011 -- every offset in the state
+ * is under 128
+ */
+uint8_t *emit_state(uint8_t *p, int wide, uint8_t opcode, int reg,
+                    size_t offset)
+{
+        *p++ = 0x40 | (wide << 3) | ((reg >> 3) << 2);
+        *p++ = opcode;
+        *p++ = 0x40 | ((reg & 7) << 3) | EBX;
+        *p++ = offset;
+        return p;
+}
+
+#else
+
+/* no native code generator for this host -- use the threaded engine */
+void run_jit(UM_memory mem, UM_io io)
+{
+        run_threaded(mem, io);
+}
+
+#endif
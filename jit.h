@@ -0,0 +1,29 @@
+/*
+ * jit.h
+ *      the interface for the x86-64 JIT tier of the UM
+ *      runs the program in the UM_memory in the direct-threaded engine,
+ *      translating the hot basic blocks of the 0-segment into native code
+ *      that jumps from block to block with the UM registers in host ones
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef JIT_H_INCLUDED_
+#define JIT_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "segments.h"
+#include "umio.h"
+
+/* Executes the instructions in the given UM_memory exactly as
+ * unpack_instructions would, including freeing the memory and the UM_io at
+ * the end
+ * on hosts other than x86-64 (or if executable memory cannot be mapped) it
+ * simply runs the direct-threaded engine
+ */
+void run_jit(UM_memory mem, UM_io io);
+
+#endif /* JIT_H_INCLUDED_ */
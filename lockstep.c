@@ -0,0 +1,376 @@
+/*
+ * lockstep.c
+ *      the implementation for running many instances of one UM program in
+ *      lockstep
+ *      the registers of the gang are kept register by register rather than
+ *      lane by lane, so each register of every lane is one row of
+ *      LOCKSTEP_LANES words: move, add, multiply, nand and load_value are
+ *      branch-free loops of a fixed length over whole rows, and they run
+ *      for every lane, in step or not, since a lane that has left the gang
+ *      no longer reads its row
+ *      everything that can fault -- divide, the memory operations and
+ *      load_program -- runs lane by lane, for the lanes in step only, and a
+ *      lane that would fault fails alone as it would under run_job
+ *      the gang runs from the 0-segment and decoding of its leader, the
+ *      lowest lane still in step -- the lanes' 0-segments start out the
+ *      same, and a lane leaves the gang the moment its own could differ:
+ *      when it jumps somewhere else, when it stores into its 0-segment
+ *      where or what the leader does not, and when a load_program gives it
+ *      words unlike the leader's
+ *      superinstructions are not used, since a lane can leave the gang
+ *      between any two instructions
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "lockstep.h"
+#include "operations.h"
+#include "peephole.h"
+#include "stats.h"
+
+/* loops over every lane, and over only the lanes still in step */
+#define EACH_LANE(lane)                                                 \
+        for (unsigned lane = 0; lane < LOCKSTEP_LANES; lane++)
+#define EACH_ACTIVE(gang, lane)                                         \
+        EACH_LANE(lane) if (((gang)->active >> lane & 1) != 0)
+
+/* sets the given register of every lane to the expression, worked out for
+ * every lane before any is stored -- gcc -O2 vectorizes each of these loops
+ * (see -fopt-info-vec), but not when each lane is stored as it goes, since
+ * it cannot then tell that the row written is not read further along
+ */
+#define SET_ROW(row, expression)                                        \
+        do {                                                            \
+                uint32_t result[LOCKSTEP_LANES];                        \
+                EACH_LANE(lane) {                                       \
+                        result[lane] = (expression);                    \
+                }                                                       \
+                memcpy(registers[row], result, sizeof(result));         \
+        } while (0)
+
+/* all ones where register c of a lane is not 0, for a branch-free move */
+#define MOVE_MASK(c, lane) (-(uint32_t) (registers[c][lane] != 0))
+
+/* the lanes of one run_lockstep -- registers[r][lane] is register r of the
+ * given lane, active has a bit set for each lane still in step, and leader
+ * is the lowest of those
+ */
+struct gang {
+        UM_memory *mems;
+        UM_io *ios;
+        int *status;
+        lockstep_leave leave;
+        void *arg;
+        unsigned active;
+        unsigned leader;
+        uint32_t registers[8][LOCKSTEP_LANES];
+};
+
+/****** private helper function declarations ******/
+
+/* takes the given lane out of the gang and, after a load_program of the
+ * given segment and offset in its memory, hands it to gang->leave
+ */
+void split_lane(struct gang *gang, unsigned lane, uint32_t segment,
+                uint32_t offset);
+
+/* takes the given lane out of the gang as its program ends, freeing its
+ * memory and UM_io and storing 1 in its status if failed is not 0
+ */
+void end_lane(struct gang *gang, unsigned lane, int failed);
+
+/* returns 1 if the 0-segments of the two memories hold the same words */
+int same_program(UM_memory mem, UM_memory other);
+
+/**************************************************/
+
+#define ENGINE_NAME run_lane
+#define ENGINE_EXTRA_PARAMS , const uint32_t *lane_registers, int *status
+#define ENGINE_CHECKS 1
+#define ENGINE_HANDLER(inst) (inst)->handler
+#define ENGINE_START(registers)                                         \
+        memcpy(registers, lane_registers, 8 * sizeof(uint32_t))
+#define ENGINE_FETCH(pc, inst)
+#define ENGINE_STORE(segment, offset)
+#define ENGINE_PROGRAM(length)
+#define ENGINE_MAP(index, size)
+#define ENGINE_UNMAP(index)
+#define ENGINE_JUMP(segment, offset)
+#define ENGINE_TARGET(pc)
+#define ENGINE_OUTPUT(value)
+#define ENGINE_INPUT(value)
+#define ENGINE_EXIT()
+#define ENGINE_STOP(exit_status)                                        \
+        do {                                                            \
+                if ((exit_status) != 0) {                               \
+                        *status = 1;                                    \
+                }                                                       \
+        } while (0)
+
+#include "threaded_body.h"
+
+/* every instruction is dispatched on its opcode alone; the memories were
+ * made from one program, so the decoding of any of them will do until the
+ * first store or load_program -- the leader's is fetched again whenever the
+ * leader changes, since an ended leader's memory is freed
+ */
+void run_lockstep(UM_memory *mems, UM_io *ios, int *status,
+                  unsigned num_lanes, lockstep_leave leave, void *arg)
+{
+        struct gang gang;
+        uint32_t (*registers)[LOCKSTEP_LANES] = gang.registers;
+        uint32_t length;
+        const struct decoded *code = decoded_program(mems[0], &length);
+        uint32_t pc = get_prog_counter(mems[0]);
+
+        memset(&gang, 0, sizeof(gang));
+        gang.mems = mems;
+        gang.ios = ios;
+        gang.status = status;
+        gang.leave = leave;
+        gang.arg = arg;
+        gang.active = (1u << num_lanes) - 1;
+        gang.leader = 0;
+
+        while (gang.active != 0) {
+                if (pc >= length) {
+                        EACH_ACTIVE(&gang, lane) {
+                                end_lane(&gang, lane, 0);
+                        }
+                        break;
+                }
+                const struct decoded *inst = &code[pc++];
+                uint32_t a = inst->a;
+                uint32_t b = inst->b;
+                uint32_t c = inst->c;
+                unsigned leader = gang.leader;
+                unsigned lead;
+                uint32_t segment, offset, value;
+
+                switch (inst->opcode) {
+                case 0:
+                        SET_ROW(a, (registers[b][lane] & MOVE_MASK(c, lane)) |
+                                   (registers[a][lane] &
+                                    ~MOVE_MASK(c, lane)));
+                        break;
+                case 1:
+                        EACH_ACTIVE(&gang, lane) {
+                                if (!segment_contains(mems[lane],
+                                                      registers[b][lane],
+                                                      registers[c][lane])) {
+                                        end_lane(&gang, lane, 1);
+                                        continue;
+                                }
+                                registers[a][lane] =
+                                        segments_load(mems[lane],
+                                                      registers[b][lane],
+                                                      registers[c][lane]);
+                        }
+                        break;
+                case 2:
+                        /* a lane whose 0-segment store is not exactly the
+                           leader's leaves, right after its store */
+                        value = 0;
+                        EACH_ACTIVE(&gang, lane) {
+                                if (!segment_contains(mems[lane],
+                                                      registers[a][lane],
+                                                      registers[b][lane])) {
+                                        end_lane(&gang, lane, 1);
+                                        continue;
+                                }
+                                segments_store(mems[lane], registers[a][lane],
+                                               registers[b][lane],
+                                               registers[c][lane]);
+                                value |= registers[a][lane] == 0;
+                        }
+                        if (value == 0 || gang.active == 0) {
+                                break;
+                        }
+                        lead = gang.leader;
+                        EACH_ACTIVE(&gang, lane) {
+                                if ((registers[a][lane] == 0) !=
+                                    (registers[a][lead] == 0) ||
+                                    (registers[a][lead] == 0 &&
+                                     (registers[b][lane] != registers[b][lead]
+                                      || registers[c][lane] !=
+                                         registers[c][lead]))) {
+                                        split_lane(&gang, lane, 0, pc);
+                                }
+                        }
+                        code = decoded_program(mems[lead], &length);
+                        break;
+                case 3:
+                        SET_ROW(a, registers[b][lane] + registers[c][lane]);
+                        break;
+                case 4:
+                        SET_ROW(a, registers[b][lane] * registers[c][lane]);
+                        break;
+                case 5:
+                        EACH_ACTIVE(&gang, lane) {
+                                if (registers[c][lane] == 0) {
+                                        end_lane(&gang, lane, 1);
+                                        continue;
+                                }
+                                registers[a][lane] = registers[b][lane] /
+                                                     registers[c][lane];
+                        }
+                        break;
+                case 6:
+                        SET_ROW(a, ~(registers[b][lane] & registers[c][lane]));
+                        break;
+                case 7:
+                        EACH_ACTIVE(&gang, lane) {
+                                end_lane(&gang, lane, 0);
+                        }
+                        break;
+                case 8:
+                        EACH_ACTIVE(&gang, lane) {
+                                value = map_segment(mems[lane],
+                                                    registers[c][lane]);
+                                if (value == SEGMENT_REFUSED) {
+                                        fprintf(stderr, "Segment limit "
+                                                        "exceeded\n");
+                                        end_lane(&gang, lane, 1);
+                                        continue;
+                                }
+                                registers[b][lane] = value;
+                        }
+                        break;
+                case 9:
+                        EACH_ACTIVE(&gang, lane) {
+                                if (registers[c][lane] == 0 ||
+                                    !segment_mapped(mems[lane],
+                                                    registers[c][lane])) {
+                                        end_lane(&gang, lane, 1);
+                                        continue;
+                                }
+                                unmap_segment(mems[lane], registers[c][lane]);
+                        }
+                        break;
+                case 10:
+                        EACH_ACTIVE(&gang, lane) {
+                                if (registers[c][lane] < 256) {
+                                        io_put(ios[lane], registers[c][lane]);
+                                }
+                        }
+                        break;
+                case 11:
+                        EACH_ACTIVE(&gang, lane) {
+                                value = io_get(ios[lane]);
+                                if (value == (uint32_t) EOF) {
+                                        registers[c][lane] = ~0;
+                                } else if (value < 256) {
+                                        registers[c][lane] = value;
+                                }
+                        }
+                        break;
+                case 12:
+                        /* a lane going anywhere the leader is not leaves;
+                           one loading other words than the leader's leaves
+                           once it has loaded them */
+                        EACH_ACTIVE(&gang, lane) {
+                                io_tick(ios[lane]);
+                                if (registers[b][lane] != 0 &&
+                                    !segment_mapped(mems[lane],
+                                                    registers[b][lane])) {
+                                        end_lane(&gang, lane, 1);
+                                }
+                        }
+                        if (gang.active == 0) {
+                                break;
+                        }
+                        lead = gang.leader;
+                        segment = registers[b][lead];
+                        offset = registers[c][lead];
+                        EACH_ACTIVE(&gang, lane) {
+                                if ((registers[b][lane] == 0) !=
+                                    (segment == 0) ||
+                                    registers[c][lane] != offset) {
+                                        split_lane(&gang, lane,
+                                                   registers[b][lane],
+                                                   registers[c][lane]);
+                                }
+                        }
+                        if (segment != 0) {
+                                EACH_ACTIVE(&gang, lane) {
+                                        segments_load_program(
+                                                mems[lane],
+                                                registers[b][lane], offset);
+                                }
+                                EACH_ACTIVE(&gang, lane) {
+                                        if (!same_program(mems[lane],
+                                                          mems[lead])) {
+                                                split_lane(&gang, lane, 0,
+                                                           offset);
+                                        }
+                                }
+                                code = decoded_program(mems[lead], &length);
+                        }
+                        pc = offset;
+                        break;
+                case 13:
+                        SET_ROW(a, inst->value);
+                        break;
+                default:
+                        /* op code must be 14 or 15 which is invalid so
+                           every lane fails */
+                        EACH_ACTIVE(&gang, lane) {
+                                end_lane(&gang, lane, 1);
+                        }
+                        break;
+                }
+
+                if (gang.active != 0 && gang.leader != leader) {
+                        code = decoded_program(mems[gang.leader], &length);
+                }
+        }
+}
+
+/****** private helper function definitions ******/
+
+/* the leader never leaves this way, since it always agrees with itself */
+void split_lane(struct gang *gang, unsigned lane, uint32_t segment,
+                uint32_t offset)
+{
+        uint32_t registers[8];
+
+        for (unsigned r = 0; r < 8; r++) {
+                registers[r] = gang->registers[r][lane];
+        }
+        gang->active &= ~(1u << lane);
+        segments_load_program(gang->mems[lane], segment, offset);
+        gang->leave(gang->arg, lane, registers);
+}
+
+/* the next lane in step takes over from a leader that ends */
+void end_lane(struct gang *gang, unsigned lane, int failed)
+{
+        io_free(gang->ios[lane]);
+        free_memory(gang->mems[lane]);
+        if (failed != 0) {
+                gang->status[lane] = 1;
+        }
+        gang->active &= ~(1u << lane);
+        while (gang->active != 0 && (gang->active >> gang->leader & 1) == 0) {
+                gang->leader++;
+        }
+}
+
+/* memories made from one program share its words until they store to
+ * them, so the words are often the very same
+ */
+int same_program(UM_memory mem, UM_memory other)
+{
+        uint32_t length, other_length;
+        const uint32_t *words = program_segment(mem, &length);
+        const uint32_t *other_words = program_segment(other, &other_length);
+
+        return length == other_length &&
+               (words == other_words ||
+                memcmp(words, other_words, length * sizeof(uint32_t)) == 0);
+}
@@ -0,0 +1,56 @@
+/*
+ * lockstep.h
+ *      the interface for running many instances of one UM program in
+ *      lockstep
+ *      each instance is a lane with its own memory, UM_io and registers;
+ *      every instruction is fetched and dispatched once for all the lanes,
+ *      the register operations are done for every lane at once, and the
+ *      memory and I/O operations for each lane in turn
+ *      a lane stays in step only while its control flow and its 0-segment
+ *      match the others'; one that jumps elsewhere, or changes its
+ *      0-segment differently, is split off and handed back to the caller,
+ *      to be finished alone by run_lane
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef LOCKSTEP_H_INCLUDED_
+#define LOCKSTEP_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "segments.h"
+#include "umio.h"
+
+/* the most instances run_lockstep runs at once */
+#define LOCKSTEP_LANES 8
+
+/* what run_lockstep calls with a lane as it leaves the gang, with the arg
+ * run_lockstep was given and the lane's eight registers -- the lane's
+ * memory, UM_io and status are the callee's from then on, the memory set
+ * to go on from where the lane left, and the registers must be copied
+ */
+typedef void (*lockstep_leave)(void *arg, unsigned lane,
+                               const uint32_t *registers);
+
+/* Executes num_lanes instances of one program, at most LOCKSTEP_LANES --
+ * mems[i] and ios[i] are the memory and UM_io of instance i, the memories
+ * made by memory_from_program from the same UM_program and not yet run
+ * each instance behaves exactly as it would under run_job (see batch.h),
+ * storing 1 in status[i] if it hits an invalid opcode, a refused map or an
+ * instruction that would fault and leaving status[i] alone otherwise --
+ * every memory and UM_io is freed, but for those of lanes handed to leave
+ */
+void run_lockstep(UM_memory *mems, UM_io *ios, int *status,
+                  unsigned num_lanes, lockstep_leave leave, void *arg);
+
+/* Executes the instructions in the given UM_memory exactly as run_job
+ * does, but from the given registers rather than from zeros -- finishes a
+ * lane that has left its gang
+ */
+void run_lane(UM_memory mem, UM_io io, const uint32_t *lane_registers,
+              int *status);
+
+#endif /* LOCKSTEP_H_INCLUDED_ */
@@ -8,8 +8,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include "seq.h"
-#include "stack.h"
 #include "operations.h"
 #include "segments.h"
 #include <inttypes.h>
@@ -71,9 +69,10 @@ void nand(uint32_t *registers,uint32_t a, uint32_t b, uint32_t c)
         registers[a] = ~(registers[b] & registers[c]);
 }
 
-/*stops the computation and frees the associated memory */
-void halt(UM_memory mem)
+/*stops the computation, flushes output and frees the associated memory */
+void halt(UM_memory mem, UM_io io)
 {
+        io_free(io);
         free_memory(mem);
         exit(0);
 }
@@ -81,9 +80,14 @@ void halt(UM_memory mem)
 /* calls map_segment and passes it the number of words to be stored. The
  * location of the new memory is stored in registers[b]
  */
-void map(UM_memory mem, uint32_t *registers, uint32_t b, uint32_t c)
+int map(UM_memory mem, uint32_t *registers, uint32_t b, uint32_t c)
 {
-        registers[b] = map_segment(mem, registers[c]);
+        uint32_t index = map_segment(mem, registers[c]);
+        if (index == SEGMENT_REFUSED) {
+                return -1;
+        }
+        registers[b] = index;
+        return 0;
 }
 
 /* calls unmap_segment and passes it the memory index */
@@ -92,19 +96,19 @@ void unmap(UM_memory mem, uint32_t *registers, uint32_t c)
         unmap_segment(mem, registers[c]);
 }
 
-/* the value in registers[c] is displayed to standard output */
-void output(uint32_t *registers, uint32_t c)
+/* the value in registers[c] is buffered for output by the UM_io */
+void output(UM_io io, uint32_t *registers, uint32_t c)
 {
         if (registers[c] < 256) {
                 uint32_t value = registers[c];
-                putchar(value);
+                io_put(io, value);
         }
 }
 
 /*a value from stdin is loaded into registers[c] as long as the value */
-void input(uint32_t *registers, uint32_t c)
+void input(UM_io io, uint32_t *registers, uint32_t c)
 {
-        uint32_t value = getc(stdin);
+        uint32_t value = io_get(io);
         if (value == (uint32_t) EOF) {
                 registers[c] = ~0;
         }
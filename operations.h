@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include "segments.h"
+#include "umio.h"
 
 /*if registers[c]!= 0, then if moves the contents of registers[b] into
  *registers[a]
@@ -45,29 +46,31 @@ void divide(uint32_t *registers, uint32_t a, uint32_t b, uint32_t c);
   of registers[b] and registers[c] */
 void nand(uint32_t *registers, uint32_t a, uint32_t b, uint32_t c);
 
-/*stops the computation and frees the memory associated with the sequence and
-  the stack */
-void halt(UM_memory mem);
+/*stops the computation, writes any buffered output and frees the memory
+  associated with the segments and the I/O layer */
+void halt(UM_memory mem, UM_io io);
 
 /*creates a new segment in the sequence with the number of words equal to the
  *value in registers[c]. Each word is initialized to zero. The location in the
  *sequence of the new mapped segment is placed into registers[b]
+ *returns 0, or -1 (leaving registers[b] alone) if the memory refused the
+ *segment for going over its limit
  */
-void map(UM_memory mem, uint32_t *registers, uint32_t b, uint32_t c);
+int map(UM_memory mem, uint32_t *registers, uint32_t b, uint32_t c);
 
 /*the segment in memory location at registers[c] is unmapped and the location
   is freed for future mapping use */
 void unmap(UM_memory mem, uint32_t *registers, uint32_t c);
 
-/*the value in registers[c] is displayed to standard output as long as the
+/*the value in registers[c] is written to the UM_io's output as long as the
   value is in the range of 0 to 255 */
-void output(uint32_t *registers, uint32_t c);
+void output(UM_io io, uint32_t *registers, uint32_t c);
 
-/*a value from standard input is loaded into registers[c] as long as the value
- *is between 0 and 255. If it is at the end of input, a value of 32 bits of
- *all ones is loaded into registers[c]
+/*a value from the UM_io's input is loaded into registers[c] as long as the
+ *value is between 0 and 255. If it is at the end of input, a value of 32 bits
+ *of all ones is loaded into registers[c]
  */
-void input(uint32_t *registers, uint32_t c);
+void input(UM_io io, uint32_t *registers, uint32_t c);
 
 /*the segment at memory location in registers[b] is put at memory location 0,
  *and the program counter is set to an offset of the value in registers[c] in
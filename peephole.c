@@ -0,0 +1,150 @@
+/*
+ * peephole.c
+ *      the implementation for the peephole optimizer of the UM
+ *      each word's superinstruction depends only on the decoding of that
+ *      word and the few after it, so words can be (re)optimized one at a
+ *      time and in any order -- a store only has to look back
+ *      SUPER_MAX_LENGTH - 1 words
+ *      every pattern is checked against the exact register fields the
+ *      engine's handler relies on, so that running the superinstruction
+ *      always leaves the registers just as the plain instructions would
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#include <stdint.h>
+#include "peephole.h"
+
+#define OP_MOVE 0
+#define OP_LOAD 1
+#define OP_ADD 3
+#define OP_MULTIPLY 4
+#define OP_NAND 6
+#define OP_LOAD_PROGRAM 12
+#define OP_LOAD_VALUE 13
+
+/****** private helper function declarations ******/
+
+/* returns the handler for the word at offset -- the longest
+ * superinstruction that starts there, or its own opcode
+ */
+uint8_t choose_handler(const struct decoded *code, uint32_t num_words,
+                       uint32_t offset);
+
+/* returns 1 if the two register fields are x and y in either order */
+int operands_are(const struct decoded *inst, uint8_t x, uint8_t y);
+
+/* returns 1 if exactly one of the inst's b and c is the given register */
+int reads_once(const struct decoded *inst, uint8_t reg);
+
+/**************************************************/
+
+/* every word is looked at on its own */
+void peephole_program(struct decoded *code, uint32_t num_words)
+{
+        for (uint32_t i = 0; i < num_words; i++) {
+                code[i].handler = choose_handler(code, num_words, i);
+        }
+}
+
+/* the changed word can be covered by a superinstruction starting at most
+ * SUPER_MAX_LENGTH - 1 words before it
+ */
+void peephole_update(struct decoded *code, uint32_t num_words,
+                     uint32_t offset)
+{
+        uint32_t first = offset < SUPER_MAX_LENGTH - 1
+                         ? 0 : offset - (SUPER_MAX_LENGTH - 1);
+
+        for (uint32_t i = first; i <= offset; i++) {
+                code[i].handler = choose_handler(code, num_words, i);
+        }
+}
+
+/* used on decodings that were not made here, so that no engine runs a
+ * superinstruction whose words are not all in the program
+ */
+int peephole_verify(const struct decoded *code, uint32_t num_words)
+{
+        for (uint32_t i = 0; i < num_words; i++) {
+                if (code[i].handler != choose_handler(code, num_words, i)) {
+                        return 0;
+                }
+        }
+        return 1;
+}
+
+/****** private helper function definitions ******/
+
+/* longer patterns are tried first; a pattern is only tried when all of its
+ * words are inside the program
+ */
+uint8_t choose_handler(const struct decoded *code, uint32_t num_words,
+                       uint32_t offset)
+{
+        const struct decoded *w = &code[offset];
+        uint32_t left = num_words - offset;
+
+        if (left >= 5 && w[0].opcode == OP_LOAD_VALUE &&
+            w[1].opcode == OP_LOAD_VALUE && w[1].a != w[0].a &&
+            w[2].opcode == OP_MULTIPLY && w[2].a == w[0].a &&
+            operands_are(&w[2], w[0].a, w[1].a) &&
+            w[3].opcode == OP_LOAD_VALUE && w[3].a == w[1].a &&
+            w[4].opcode == OP_ADD && w[4].a == w[0].a &&
+            operands_are(&w[4], w[0].a, w[1].a)) {
+                return SUPER_CONST;
+        }
+        if (left >= 4 && w[0].opcode == OP_LOAD_VALUE &&
+            w[1].opcode == OP_LOAD_VALUE && w[2].opcode == OP_MOVE &&
+            w[3].opcode == OP_LOAD_PROGRAM) {
+                return SUPER_BRANCH;
+        }
+        if (left >= 3 && w[0].opcode == OP_NAND && w[0].b == w[0].c &&
+            w[1].opcode == OP_NAND && w[1].b == w[1].c &&
+            w[2].opcode == OP_NAND) {
+                return SUPER_OR;
+        }
+        if (left < 2) {
+                return w[0].opcode;
+        }
+        if (w[0].opcode == OP_NAND && w[1].opcode == OP_NAND &&
+            w[1].b == w[0].a && w[1].c == w[0].a) {
+                return SUPER_AND;
+        }
+        if (w[0].opcode != OP_LOAD_VALUE) {
+                return w[0].opcode;
+        }
+        switch (w[1].opcode) {
+        case OP_LOAD_VALUE:
+                return SUPER_LV2;
+        case OP_LOAD_PROGRAM:
+                return SUPER_JUMP;
+        case OP_LOAD:
+                return SUPER_LV_LOAD;
+        case OP_ADD:
+                return reads_once(&w[1], w[0].a) ? SUPER_LV_ADD
+                                                 : w[0].opcode;
+        case OP_MULTIPLY:
+                return reads_once(&w[1], w[0].a) ? SUPER_LV_MUL
+                                                 : w[0].opcode;
+        case OP_NAND:
+                return reads_once(&w[1], w[0].a) ? SUPER_LV_NAND
+                                                 : w[0].opcode;
+        default:
+                return w[0].opcode;
+        }
+}
+
+/* for the commutative add and multiply */
+int operands_are(const struct decoded *inst, uint8_t x, uint8_t y)
+{
+        return (inst->b == x && inst->c == y) ||
+               (inst->b == y && inst->c == x);
+}
+
+/* then the other operand is b ^ c ^ reg, which the engine relies on */
+int reads_once(const struct decoded *inst, uint8_t reg)
+{
+        return (inst->b == reg) != (inst->c == reg);
+}
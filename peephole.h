@@ -0,0 +1,68 @@
+/*
+ * peephole.h
+ *      the interface for the peephole optimizer of the UM
+ *      looks for the instruction sequences UM compilers emit over and over
+ *      and marks the first word of each with a superinstruction, which the
+ *      direct-threaded engines run with one dispatch:
+ *              SUPER_LV2       two load_values
+ *              SUPER_CONST     a 32 bit constant built from load_values:
+ *                              a = hi, b = m, a = a * b, b = lo, a = a + b
+ *              SUPER_JUMP      load_value t, then load_program of t
+ *              SUPER_BRANCH    two load_values, a conditional move, then
+ *                              load_program -- the usual loop test
+ *              SUPER_AND       nand t x y, then nand d t t
+ *              SUPER_OR        nand p x x, nand q y y, then nand d p q
+ *              SUPER_LV_ADD    load_value k, then add, multiply or nand
+ *              SUPER_LV_MUL    reading k -- the engine uses the immediate
+ *              SUPER_LV_NAND   rather than reloading the register
+ *              SUPER_LV_LOAD   load_value k, then a segmented load
+ *      the words a superinstruction covers keep their own decoding, so a
+ *      jump into the middle of one runs the plain instructions from there
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef PEEPHOLE_H_INCLUDED_
+#define PEEPHOLE_H_INCLUDED_
+
+#include <stdint.h>
+#include "decode.h"
+
+/* the superinstruction handlers, numbered after the 16 opcodes */
+enum super {
+        SUPER_LV2 = 16,
+        SUPER_CONST,
+        SUPER_JUMP,
+        SUPER_BRANCH,
+        SUPER_AND,
+        SUPER_OR,
+        SUPER_LV_ADD,
+        SUPER_LV_MUL,
+        SUPER_LV_NAND,
+        SUPER_LV_LOAD,
+        NUM_HANDLERS
+};
+
+/* the most words any superinstruction covers */
+#define SUPER_MAX_LENGTH 5
+
+/* sets the handler of each of the num_words decoded instructions to the
+ * longest superinstruction starting there, if there is one
+ */
+void peephole_program(struct decoded *code, uint32_t num_words);
+
+/* redoes the handlers of every instruction whose superinstruction could
+ * cover the word at offset, after that word has been stored to and
+ * re-decoded -- a superinstruction the store broke is undone, and one it
+ * completed is found
+ */
+void peephole_update(struct decoded *code, uint32_t num_words,
+                     uint32_t offset);
+
+/* returns 1 if the handler of each of the num_words decoded instructions
+ * is the one peephole_program would give it, and 0 if any is not
+ */
+int peephole_verify(const struct decoded *code, uint32_t num_words);
+
+#endif /* PEEPHOLE_H_INCLUDED_ */
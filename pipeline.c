@@ -0,0 +1,113 @@
+/*
+ * pipeline.c
+ *      the implementation for running UM programs as a pipeline in one
+ *      process
+ *      every program is loaded before any stage starts, so a missing one
+ *      runs nothing; each stage then runs on a thread of its own, under
+ *      run_job, which returns rather than exiting the process
+ *      the stages between the ends make their UM_ios with no descriptors
+ *      and link them to the rings on either side; output to a ring is
+ *      always synchronous, since the ring itself does what the writer
+ *      thread would
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "pipeline.h"
+#include "segments.h"
+#include "batch.h"
+#include "ring.h"
+
+#define PIPE_RING_SIZE (1024 * 1024)
+
+/* one program of the pipeline */
+struct stage {
+        UM_memory mem;
+        UM_io io;
+        int status;
+        pthread_t thread;
+};
+
+/****** private helper function declarations ******/
+
+/* the stage thread: runs the stage's program to its end */
+void *stage_main(void *arg);
+
+/**************************************************/
+
+/* ring i joins stage i to stage i + 1 */
+int run_pipeline(char *const *paths, unsigned num_stages,
+                 const struct io_options *options, uint64_t max_words)
+{
+        struct stage *stages = calloc(num_stages, sizeof(struct stage));
+        UM_ring *rings = malloc(num_stages * sizeof(UM_ring));
+        struct io_options linked;
+        int failed = 0;
+
+        for (unsigned i = 0; i < num_stages; i++) {
+                FILE *input = fopen(paths[i], "rb");
+                if (input == NULL) {
+                        for (unsigned j = 0; j < i; j++) {
+                                free_memory(stages[j].mem);
+                        }
+                        free(rings);
+                        free(stages);
+                        return -1;
+                }
+                stages[i].mem = initialize_memory();
+                stream_instructions(stages[i].mem, input);
+                memory_limit(stages[i].mem, max_words);
+        }
+
+        memset(&linked, 0, sizeof(linked));
+        if (options != NULL) {
+                linked = *options;
+        }
+        for (unsigned i = 0; i < num_stages; i++) {
+                int last = i == num_stages - 1;
+                struct io_options own = linked;
+
+                own.async = last ? own.async : 0;
+                stages[i].io = io_new(i == 0 ? STDIN_FILENO : -1,
+                                      last ? STDOUT_FILENO : -1, &own);
+                rings[i] = last ? NULL : ring_new(PIPE_RING_SIZE);
+                io_link(stages[i].io, i == 0 ? NULL : rings[i - 1],
+                        rings[i]);
+        }
+
+        for (unsigned i = 0; i < num_stages; i++) {
+                pthread_create(&stages[i].thread, NULL, stage_main,
+                               &stages[i]);
+        }
+        for (unsigned i = 0; i < num_stages; i++) {
+                pthread_join(stages[i].thread, NULL);
+                if (stages[i].status != 0) {
+                        failed = 1;
+                }
+        }
+
+        for (unsigned i = 0; i + 1 < num_stages; i++) {
+                ring_free(rings[i]);
+        }
+        free(rings);
+        free(stages);
+        return failed;
+}
+
+/****** private helper function definitions ******/
+
+/* run_job frees the memory and the UM_io, which closes the output ring */
+void *stage_main(void *arg)
+{
+        struct stage *stage = arg;
+
+        run_job(stage->mem, stage->io, &stage->status);
+        return NULL;
+}
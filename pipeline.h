@@ -0,0 +1,37 @@
+/*
+ * pipeline.h
+ *      the interface for running UM programs as a pipeline in one process
+ *      each program is a stage with its own memory, registers and thread;
+ *      the first stage reads the process's input, the last writes the
+ *      process's output, and every other stage's output instruction feeds
+ *      the next stage's input instruction directly, through a ring (see
+ *      ring.h) -- as a shell pipeline of um processes would, but without a
+ *      pipe, a system call or a copy for each byte passed on
+ *      a stage that ends closes its output, so the next stage reads end of
+ *      input once it has read everything before; output sent to a stage
+ *      that has ended is dropped
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef PIPELINE_H_INCLUDED_
+#define PIPELINE_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "umio.h"
+
+/* runs the num_stages programs at the given paths as a pipeline, in order,
+ * until every stage has ended -- the first stage's input and the last
+ * stage's output get the given options, and each stage's memory a limit
+ * of max_words mapped words (see memory_limit)
+ * returns 0 if every stage halted or ran off the end of its program, 1 if
+ * one hit an invalid opcode or a refused map, and -1 (running nothing) if
+ * a program cannot be opened
+ */
+int run_pipeline(char *const *paths, unsigned num_stages,
+                 const struct io_options *options, uint64_t max_words);
+
+#endif /* PIPELINE_H_INCLUDED_ */
@@ -0,0 +1,241 @@
+/*
+ * profile.c
+ *      the implementation for the execution profiler
+ *      instantiates threaded_body.h with hooks that fill in a struct
+ *      profile, and formats the report
+ *      live segments start at 1 (the 0-segment) and live words at the length
+ *      of the loaded program
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "profile.h"
+#include "operations.h"
+#include "peephole.h"
+#include "stats.h"
+
+#define HOT_PCS 20
+
+static const char *const opcode_names[16] = {
+        "move", "load", "store", "add", "multiply", "divide", "nand", "halt",
+        "map", "unmap", "output", "input", "load_program", "load_value",
+        "invalid", "invalid"
+};
+
+/****** private helper function declarations ******/
+
+/* returns the size histogram bucket for the given size */
+int size_bucket(uint32_t size);
+
+/* writes one size histogram, skipping empty buckets */
+void report_sizes(FILE *out, const char *title, const uint64_t *buckets);
+
+/* writes the HOT_PCS most executed 0-segment offsets */
+void report_hot_pcs(struct profile *profile);
+
+/**************************************************/
+
+#define ENGINE_NAME run_profiled
+#define ENGINE_EXTRA_PARAMS , struct profile *profile
+#define ENGINE_CHECKS 0
+#define ENGINE_HANDLER(inst) (inst)->opcode
+#define ENGINE_START(registers)
+#define ENGINE_FETCH(pc, inst)                                          \
+        do {                                                            \
+                profile->opcodes[(inst)->opcode]++;                     \
+                profile->pc_counts[pc]++;                               \
+        } while (0)
+#define ENGINE_STORE(segment, offset)
+#define ENGINE_PROGRAM(length) profile_program(profile, length)
+#define ENGINE_MAP(index, size) profile_map(profile, size)
+#define ENGINE_UNMAP(index) profile_unmap(profile, segment_length(mem, index))
+#define ENGINE_JUMP(segment, offset)                                    \
+        do {                                                            \
+                if ((segment) == 0) {                                   \
+                        profile->jumps++;                               \
+                } else {                                                \
+                        profile->replacements++;                        \
+                }                                                       \
+        } while (0)
+#define ENGINE_TARGET(pc)
+#define ENGINE_OUTPUT(value)
+#define ENGINE_INPUT(value)
+#define ENGINE_EXIT() profile_report(profile, mem)
+#define ENGINE_STOP(status) exit(status)
+
+#include "threaded_body.h"
+
+/* starts with only the 0-segment live */
+struct profile *profile_new(FILE *out)
+{
+        struct profile *profile = calloc(1, sizeof(struct profile));
+
+        profile->out = out;
+        profile->live_segments = 1;
+        profile->peak_segments = 1;
+        return profile;
+}
+
+/* frees the histogram and the profile */
+void profile_free(struct profile *profile)
+{
+        free(profile->pc_counts);
+        free(profile);
+}
+
+/* grows the pc histogram to cover the new program -- counts for offsets
+ * past the old program's end start at zero -- and moves the live word count
+ * from the old program's length to the new one's
+ */
+void profile_program(struct profile *profile, uint32_t length)
+{
+        if (length > profile->pc_capacity || profile->pc_counts == NULL) {
+                profile->pc_counts = realloc(profile->pc_counts,
+                                             (length + 1) * sizeof(uint64_t));
+                memset(profile->pc_counts + profile->pc_capacity, 0,
+                       (length + 1 - profile->pc_capacity) *
+                       sizeof(uint64_t));
+                profile->pc_capacity = length + 1;
+        }
+        profile->live_words += length;
+        profile->live_words -= profile->program_words;
+        profile->program_words = length;
+        if (profile->live_words > profile->peak_words) {
+                profile->peak_words = profile->live_words;
+        }
+}
+
+/* counts the size and updates the live and peak totals */
+void profile_map(struct profile *profile, uint32_t size)
+{
+        profile->map_sizes[size_bucket(size)]++;
+        profile->live_segments++;
+        profile->live_words += size;
+        if (profile->live_segments > profile->peak_segments) {
+                profile->peak_segments = profile->live_segments;
+        }
+        if (profile->live_words > profile->peak_words) {
+                profile->peak_words = profile->live_words;
+        }
+}
+
+/* counts the size and takes the segment out of the live totals */
+void profile_unmap(struct profile *profile, uint32_t size)
+{
+        profile->unmap_sizes[size_bucket(size)]++;
+        profile->live_segments--;
+        profile->live_words -= size;
+}
+
+/* writes each section of the report in turn */
+void profile_report(struct profile *profile, UM_memory mem)
+{
+        FILE *out = profile->out;
+        uint64_t total = 0;
+        struct allocator_stats stats;
+
+        for (int op = 0; op < 16; op++) {
+                total += profile->opcodes[op];
+        }
+        fprintf(out, "=== UM profile ===\n");
+        fprintf(out, "instructions retired: %llu\n",
+                (unsigned long long) total);
+        for (int op = 0; op < 16; op++) {
+                if (profile->opcodes[op] == 0) {
+                        continue;
+                }
+                fprintf(out, "  %2d %-13s %14llu  %5.1f%%\n", op,
+                        opcode_names[op],
+                        (unsigned long long) profile->opcodes[op],
+                        100.0 * profile->opcodes[op] / total);
+        }
+
+        report_hot_pcs(profile);
+
+        fprintf(out, "load_program: %llu jumps within segment 0, "
+                "%llu program replacements\n",
+                (unsigned long long) profile->jumps,
+                (unsigned long long) profile->replacements);
+        report_sizes(out, "map sizes", profile->map_sizes);
+        report_sizes(out, "unmap sizes", profile->unmap_sizes);
+        fprintf(out, "peak live segments: %llu\n",
+                (unsigned long long) profile->peak_segments);
+        fprintf(out, "peak live words: %llu\n",
+                (unsigned long long) profile->peak_words);
+
+        memory_alloc_stats(mem, &stats);
+        fprintf(out, "segment allocator: %llu hits, %llu misses, "
+                "%llu large (%llu lazy), %zu bytes retained, "
+                "%zu slab bytes, %zu released\n",
+                (unsigned long long) stats.hits,
+                (unsigned long long) stats.misses,
+                (unsigned long long) stats.large,
+                (unsigned long long) stats.lazy, stats.bytes_retained,
+                stats.bytes_slabs, stats.bytes_released);
+        fflush(out);
+}
+
+/****** private helper function definitions ******/
+
+/* the bucket is the bit length of the size */
+int size_bucket(uint32_t size)
+{
+        int bucket = 0;
+        while (size != 0) {
+                bucket++;
+                size >>= 1;
+        }
+        return bucket;
+}
+
+/* buckets are labelled with the range of sizes they hold */
+void report_sizes(FILE *out, const char *title, const uint64_t *buckets)
+{
+        fprintf(out, "%s:\n", title);
+        for (int k = 0; k < PROFILE_BUCKETS; k++) {
+                if (buckets[k] == 0) {
+                        continue;
+                }
+                unsigned long long low = k == 0 ? 0 : 1ULL << (k - 1);
+                unsigned long long high = k == 0 ? 0 : (1ULL << k) - 1;
+                fprintf(out, "  %10llu - %-10llu %14llu\n", low, high,
+                        (unsigned long long) buckets[k]);
+        }
+}
+
+/* repeatedly picks the largest count not yet reported -- HOT_PCS passes
+ * over the histogram is cheap next to running the program
+ */
+void report_hot_pcs(struct profile *profile)
+{
+        uint32_t chosen[HOT_PCS];
+        int num_chosen = 0;
+
+        fprintf(profile->out, "hottest segment 0 offsets:\n");
+        for (; num_chosen < HOT_PCS; num_chosen++) {
+                uint64_t best = 0;
+                uint32_t best_pc = 0;
+                for (uint32_t pc = 0; pc < profile->pc_capacity; pc++) {
+                        uint64_t count = profile->pc_counts[pc];
+                        int taken = 0;
+                        for (int i = 0; i < num_chosen; i++) {
+                                taken |= chosen[i] == pc;
+                        }
+                        if (count > best && taken == 0) {
+                                best = count;
+                                best_pc = pc;
+                        }
+                }
+                if (best == 0) {
+                        break;
+                }
+                chosen[num_chosen] = best_pc;
+                fprintf(profile->out, "  %10u %14llu\n", best_pc,
+                        (unsigned long long) best);
+        }
+}
@@ -0,0 +1,73 @@
+/*
+ * profile.h
+ *      the interface for the execution profiler of the UM
+ *      run_profiled is the direct-threaded engine compiled with counting
+ *      hooks; it records retired instructions per opcode, a histogram of the
+ *      0-segment offsets executed, load_program jumps and replacements,
+ *      map and unmap size histograms, and the peak number of live segments
+ *      and words, then writes a report when the program ends
+ *      run_threaded is compiled without the hooks, so profiling costs
+ *      nothing when it is off
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef PROFILE_H_INCLUDED_
+#define PROFILE_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "segments.h"
+#include "umio.h"
+
+/* size histograms have one bucket per bit length: bucket 0 counts size 0,
+ * bucket k counts sizes from 2^(k-1) up to 2^k - 1
+ */
+#define PROFILE_BUCKETS 33
+
+/* the counters -- the per-instruction ones are bumped directly by the
+ * profiled engine, the rest through the functions below
+ */
+struct profile {
+        uint64_t opcodes[16];
+        uint64_t *pc_counts;            /* one per 0-segment offset */
+        uint32_t pc_capacity;
+        uint32_t program_words;         /* length of the current program */
+        uint64_t jumps;                 /* load_program of segment 0 */
+        uint64_t replacements;          /* load_program of any other */
+        uint64_t map_sizes[PROFILE_BUCKETS];
+        uint64_t unmap_sizes[PROFILE_BUCKETS];
+        uint64_t live_segments;
+        uint64_t peak_segments;
+        uint64_t live_words;
+        uint64_t peak_words;
+        FILE *out;
+};
+
+/* creates a profile whose report will be written to out */
+struct profile *profile_new(FILE *out);
+
+/* frees the profile -- out is left open */
+void profile_free(struct profile *profile);
+
+/* notes that a program of the given length is now the 0-segment */
+void profile_program(struct profile *profile, uint32_t length);
+
+/* counts a segment of the given size being mapped */
+void profile_map(struct profile *profile, uint32_t size);
+
+/* counts a segment of the given size being unmapped */
+void profile_unmap(struct profile *profile, uint32_t size);
+
+/* writes the report, including the segment allocator's counters */
+void profile_report(struct profile *profile, UM_memory mem);
+
+/* Executes the instructions in the given UM_memory exactly as run_threaded
+ * does while filling in the profile, and writes the report before the
+ * program ends
+ */
+void run_profiled(UM_memory mem, UM_io io, struct profile *profile);
+
+#endif /* PROFILE_H_INCLUDED_ */
@@ -0,0 +1,322 @@
+/*
+ * progcache.c
+ *      the implementation for the on-disk cache of loaded UM programs
+ *      an entry is a header, then the program's words in host order, then
+ *      one struct decoded per word, exactly as load_instructions leaves them
+ *      -- it is named by a 128 bit hash of the image's bytes, and the header
+ *      repeats the hash and the image's length, so an entry is only used
+ *      for the image it was made from
+ *      the byte order mark, the size of struct decoded and the number of
+ *      handlers refuse entries from another host or another build, and the
+ *      version refuses any other layout -- it must be bumped whenever
+ *      decode.c or peephole.c would decode a word differently
+ *      the header is a multiple of 8 bytes long, so the words and their
+ *      decoding are aligned where they lie and the entry is used in place
+ *      from a private mapping, without being copied
+ *      an entry is written to a temporary file and renamed, so its name
+ *      only ever refers to a complete entry
+ *      the cache directory may be written by anyone, so nothing in an entry
+ *      is believed until it is checked: every word must be the matching
+ *      word of the image being run, and every decoded word exactly what
+ *      decode_word and peephole_program make of it -- an entry that fails
+ *      any check is ignored and written again, and can never make an engine
+ *      dispatch or read outside its tables and its program
+ *      checking goes over every word once more, which gives back a good
+ *      part of the time the cache saves -- a hit on a 64 MB image costs
+ *      about half of loading it, rather than almost nothing -- but it is
+ *      what lets a cache directory be shared
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "progcache.h"
+#include "decode.h"
+#include "peephole.h"
+
+#define CACHE_MAGIC "UMCACHE\n"
+#define CACHE_VERSION 1
+#define BYTE_ORDER_MARK 0x01020304
+#define TEMP_SUFFIX ".XXXXXX"
+#define LOAD_VALUE 13
+#define VALUE_MASK 0x1ffffff
+
+/* the start of every entry */
+struct cache_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint32_t decoded_size;
+        uint32_t num_handlers;
+        uint64_t key[2];
+        uint64_t image_bytes;
+        uint32_t num_words;
+        uint32_t reserved;
+};
+
+/****** private helper function declarations ******/
+
+/* hashes the num_bytes bytes of an image into key[0] and key[1] */
+void hash_image(const unsigned char *bytes, size_t num_bytes,
+                uint64_t *key);
+
+/* returns 1 if each of the num_words words is the matching big-endian word
+ * of bytes, and each decoded instruction exactly what decode_word and
+ * peephole_program make of its word
+ */
+int valid_entry(const unsigned char *bytes, const uint32_t *words,
+                const struct decoded *decoded, uint32_t num_words);
+
+/* returns the malloc'd path of the entry for the given key in dir */
+char *entry_path(const char *dir, const uint64_t *key);
+
+/* returns a memory made from the entry at path if it holds the image of
+ * image_bytes bytes with the given key, or NULL if there is no such entry
+ */
+UM_memory open_entry(const char *path, const uint64_t *key,
+                     const unsigned char *bytes, uint64_t image_bytes);
+
+/* saves the program in the given memory, just loaded, as the entry at
+ * path, returning 0 on success
+ */
+int write_entry(const char *path, UM_memory mem, const uint64_t *key,
+                uint64_t image_bytes);
+
+/**************************************************/
+
+/* the image is mapped just long enough to hash it and check the entry
+ * against it -- load_instructions maps it again itself on a miss
+ * an image too short to hold a word is not worth an entry
+ */
+UM_memory cache_load(FILE *input, const char *dir)
+{
+        struct stat info;
+        int fd = fileno(input);
+        unsigned char *bytes = MAP_FAILED;
+        UM_memory mem;
+
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+            info.st_size >= (off_t) sizeof(uint32_t)) {
+                bytes = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd,
+                             0);
+        }
+        if (bytes == MAP_FAILED) {
+                mem = initialize_memory();
+                stream_instructions(mem, input);
+                return mem;
+        }
+
+        uint64_t key[2];
+        size_t num_bytes = info.st_size;
+        madvise(bytes, num_bytes, MADV_SEQUENTIAL);
+        hash_image(bytes, num_bytes, key);
+
+        char *path = entry_path(dir, key);
+        mem = open_entry(path, key, bytes, num_bytes);
+        munmap(bytes, num_bytes);
+        if (mem == NULL) {
+                mem = initialize_memory();
+                load_instructions(mem, input);
+                mkdir(dir, 0777);
+                write_entry(path, mem, key, num_bytes);
+        }
+        free(path);
+        fclose(input);
+        return mem;
+}
+
+/****** private helper function definitions ******/
+
+/* two independent multiply-and-mix lanes over 8 bytes at a time, folded
+ * together at the end -- fast rather than cryptographic, which is all a
+ * cache of one's own programs needs
+ */
+void hash_image(const unsigned char *bytes, size_t num_bytes,
+                uint64_t *key)
+{
+        uint64_t a = 0x9e3779b97f4a7c15u;
+        uint64_t b = 0xc2b2ae3d27d4eb4fu ^ num_bytes;
+        uint64_t chunk;
+        size_t i = 0;
+
+        for (; i + sizeof(chunk) <= num_bytes; i += sizeof(chunk)) {
+                memcpy(&chunk, bytes + i, sizeof(chunk));
+                a = (a ^ chunk) * 0xff51afd7ed558ccdu;
+                a ^= a >> 32;
+                b = (b + chunk) * 0xc4ceb9fe1a85ec53u;
+                b = b << 31 | b >> 33;
+        }
+        chunk = 0;
+        memcpy(&chunk, bytes + i, num_bytes - i);
+        a = (a ^ chunk) * 0xff51afd7ed558ccdu;
+        b = (b + chunk) * 0xc4ceb9fe1a85ec53u;
+
+        key[0] = a ^ (b >> 29);
+        key[0] = (key[0] ^ key[0] >> 33) * 0xff51afd7ed558ccdu;
+        key[0] ^= key[0] >> 33;
+        key[1] = b ^ (a >> 31);
+        key[1] = (key[1] ^ key[1] >> 33) * 0xc4ceb9fe1a85ec53u;
+        key[1] ^= key[1] >> 33;
+}
+
+/* the words are decoded again as they are compared, without branches --
+ * the fields are compared one by one, since the padding of a struct
+ * decoded is whatever it happened to be when the entry was written
+ */
+int valid_entry(const unsigned char *bytes, const uint32_t *words,
+                const struct decoded *decoded, uint32_t num_words)
+{
+        uint32_t wrong = 0;
+
+        for (uint32_t i = 0; i < num_words; i++) {
+                const unsigned char *word_bytes = bytes + i * 4;
+                const struct decoded *inst = &decoded[i];
+                uint32_t word = (uint32_t) word_bytes[0] << 24 |
+                                (uint32_t) word_bytes[1] << 16 |
+                                (uint32_t) word_bytes[2] << 8 |
+                                (uint32_t) word_bytes[3];
+                uint32_t opcode = word >> 28;
+                uint32_t plain = -(uint32_t) (opcode != LOAD_VALUE);
+                uint32_t a = (((word >> 6) & plain) |
+                              ((word >> 25) & ~plain)) & 7;
+                uint32_t b = (word >> 3) & 7 & plain;
+                uint32_t c = word & 7 & plain;
+
+                wrong |= (words[i] ^ word) | (inst->opcode ^ opcode) |
+                         (inst->a ^ a) | (inst->b ^ b) | (inst->c ^ c) |
+                         (inst->value ^ (word & VALUE_MASK & ~plain)) |
+                         (inst->special ^ (opcode << 9 | a << 6 | b << 3 |
+                                           c));
+        }
+        return wrong == 0 && peephole_verify(decoded, num_words) == 1;
+}
+
+char *entry_path(const char *dir, const uint64_t *key)
+{
+        char *path = malloc(strlen(dir) + 40);
+
+        sprintf(path, "%s/%016" PRIx64 "%016" PRIx64 ".umc", dir, key[0],
+                key[1]);
+        return path;
+}
+
+/* every length is checked against the size of the file before any word is
+ * used, so a truncated entry is refused rather than read past, and every
+ * word and its decoding are checked before the memory is made
+ */
+UM_memory open_entry(const char *path, const uint64_t *key,
+                     const unsigned char *bytes, uint64_t image_bytes)
+{
+        struct stat info;
+        int fd = open(path, O_RDONLY);
+
+        if (fd < 0) {
+                return NULL;
+        }
+        if (fstat(fd, &info) != 0 ||
+            (size_t) info.st_size < sizeof(struct cache_header)) {
+                close(fd);
+                return NULL;
+        }
+        size_t size = info.st_size;
+        unsigned char *image = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (image == MAP_FAILED) {
+                return NULL;
+        }
+
+        struct cache_header *header = (struct cache_header *) image;
+        uint64_t num_words = image_bytes / sizeof(uint32_t);
+        if (memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != CACHE_VERSION ||
+            header->byte_order != BYTE_ORDER_MARK ||
+            header->decoded_size != sizeof(struct decoded) ||
+            header->num_handlers != NUM_HANDLERS ||
+            header->key[0] != key[0] || header->key[1] != key[1] ||
+            header->image_bytes != image_bytes ||
+            header->num_words != num_words ||
+            size != sizeof(struct cache_header) +
+                    num_words * (sizeof(uint32_t) + sizeof(struct decoded))) {
+                munmap(image, size);
+                return NULL;
+        }
+
+        uint32_t *words = (uint32_t *) (header + 1);
+        struct decoded *decoded = (struct decoded *) (words + num_words);
+        if (valid_entry(bytes, words, decoded, num_words) == 0) {
+                munmap(image, size);
+                return NULL;
+        }
+        return memory_from_image(words, decoded, num_words, image, size);
+}
+
+/* the temporary file is fsync'd before the rename, as snapshot_save does,
+ * and is unique, so runs filling the cache at once never mix their writes
+ */
+int write_entry(const char *path, UM_memory mem, const uint64_t *key,
+                uint64_t image_bytes)
+{
+        char *temp = malloc(strlen(path) + sizeof(TEMP_SUFFIX));
+        struct cache_header header;
+        uint32_t num_words, num_decoded;
+        const uint32_t *words = program_segment(mem, &num_words);
+        const struct decoded *decoded = decoded_program(mem, &num_decoded);
+        int failed = -1;
+
+        sprintf(temp, "%s%s", path, TEMP_SUFFIX);
+        int fd = mkstemp(temp);
+        FILE *out = fd < 0 ? NULL : fdopen(fd, "wb");
+        if (out == NULL) {
+                if (fd >= 0) {
+                        close(fd);
+                        unlink(temp);
+                }
+                free(temp);
+                return failed;
+        }
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+        header.version = CACHE_VERSION;
+        header.byte_order = BYTE_ORDER_MARK;
+        header.decoded_size = sizeof(struct decoded);
+        header.num_handlers = NUM_HANDLERS;
+        header.key[0] = key[0];
+        header.key[1] = key[1];
+        header.image_bytes = image_bytes;
+        header.num_words = num_words;
+        if (num_decoded == num_words &&
+            fwrite(&header, sizeof(header), 1, out) == 1 &&
+            fwrite(words, sizeof(uint32_t), num_words, out) == num_words &&
+            fwrite(decoded, sizeof(struct decoded), num_words, out)
+            == num_words) {
+                failed = 0;
+        }
+        if (fflush(out) != 0 || fsync(fileno(out)) != 0) {
+                failed = -1;
+        }
+        if (fclose(out) != 0) {
+                failed = -1;
+        }
+        if (failed == 0 && rename(temp, path) != 0) {
+                failed = -1;
+        }
+        if (failed != 0) {
+                unlink(temp);
+        }
+        free(temp);
+        return failed;
+}
@@ -0,0 +1,31 @@
+/*
+ * progcache.h
+ *      the interface for the on-disk cache of loaded UM programs
+ *      the first run of a .um image saves its host-order words and their
+ *      decoding in a cache directory, under a hash of the image's bytes;
+ *      every later run of the same bytes, from whatever path, maps that
+ *      entry and starts at once instead of converting and decoding the
+ *      image again
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef PROGCACHE_H_INCLUDED_
+#define PROGCACHE_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "segments.h"
+
+/* creates a memory holding the program in the given FILE *, as
+ * initialize_memory and stream_instructions would, taking it from the
+ * cache in the directory dir when the cache has it and adding it when not
+ * -- anything but a regular file is streamed as usual, without the cache
+ * a cache that cannot be read or written only costs the time it would have
+ * saved; the FILE * is closed, as stream_instructions closes it
+ */
+UM_memory cache_load(FILE *input, const char *dir);
+
+#endif /* PROGCACHE_H_INCLUDED_ */
@@ -0,0 +1,179 @@
+/*
+ * ring.c
+ *      the implementation for the single-producer single-consumer byte ring
+ *      head counts bytes ever written and is only stored by the producer;
+ *      tail counts bytes ever read and is only stored by the consumer, so
+ *      head - tail is always the number of bytes waiting
+ *      each side publishes its counter with a release store after copying,
+ *      and reads the other's with an acquire load before copying
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+
+#define CACHE_LINE 64
+
+/* head and tail sit on their own cache lines so the two threads do not
+ * keep stealing one line from each other
+ */
+struct UM_ring {
+        unsigned char *bytes;
+        size_t capacity;
+        size_t mask;
+        char pad0[CACHE_LINE];
+        size_t head;
+        char pad1[CACHE_LINE - sizeof(size_t)];
+        size_t tail;
+        char pad2[CACHE_LINE - sizeof(size_t)];
+        int closed;
+        int detached;
+};
+
+/* rounds the capacity up to a power of two so indices can be masked */
+UM_ring ring_new(size_t capacity)
+{
+        UM_ring ring = malloc(sizeof(struct UM_ring));
+        size_t size = 1;
+
+        while (size < capacity) {
+                size *= 2;
+        }
+        ring->bytes = malloc(size);
+        ring->capacity = size;
+        ring->mask = size - 1;
+        ring->head = 0;
+        ring->tail = 0;
+        ring->closed = 0;
+        ring->detached = 0;
+        return ring;
+}
+
+/* frees the buffer and the ring itself */
+void ring_free(UM_ring ring)
+{
+        free(ring->bytes);
+        free(ring);
+}
+
+/* copies into the free space, in two pieces if it wraps around the end */
+size_t ring_write(UM_ring ring, const unsigned char *bytes, size_t n)
+{
+        size_t head = ring->head;
+        size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        size_t space = ring->capacity - (head - tail);
+
+        if (n > space) {
+                n = space;
+        }
+        size_t start = head & ring->mask;
+        size_t first = ring->capacity - start;
+        if (first > n) {
+                first = n;
+        }
+        memcpy(ring->bytes + start, bytes, first);
+        memcpy(ring->bytes, bytes + first, n - first);
+
+        __atomic_store_n(&ring->head, head + n, __ATOMIC_RELEASE);
+        return n;
+}
+
+/* copies out of the waiting bytes, in two pieces if they wrap */
+size_t ring_read(UM_ring ring, unsigned char *bytes, size_t max)
+{
+        size_t tail = ring->tail;
+        size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        size_t n = head - tail;
+
+        if (n > max) {
+                n = max;
+        }
+        size_t start = tail & ring->mask;
+        size_t first = ring->capacity - start;
+        if (first > n) {
+                first = n;
+        }
+        memcpy(bytes, ring->bytes + start, first);
+        memcpy(bytes + first, ring->bytes, n - first);
+
+        __atomic_store_n(&ring->tail, tail + n, __ATOMIC_RELEASE);
+        return n;
+}
+
+/* the free space is offered only up to the end of the buffer, so it is
+ * always one piece -- the rest is offered once the producer wraps around
+ */
+size_t ring_reserve(UM_ring ring, unsigned char **bytes)
+{
+        size_t head = ring->head;
+        size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        size_t space = ring->capacity - (head - tail);
+        size_t start = head & ring->mask;
+
+        if (space > ring->capacity - start) {
+                space = ring->capacity - start;
+        }
+        *bytes = ring->bytes + start;
+        return space;
+}
+
+/* release, so the consumer sees the bytes before the new head */
+void ring_commit(UM_ring ring, size_t n)
+{
+        __atomic_store_n(&ring->head, ring->head + n, __ATOMIC_RELEASE);
+}
+
+/* like ring_reserve, only the bytes up to the end of the buffer are shown */
+size_t ring_peek(UM_ring ring, unsigned char **bytes)
+{
+        size_t tail = ring->tail;
+        size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        size_t n = head - tail;
+        size_t start = tail & ring->mask;
+
+        if (n > ring->capacity - start) {
+                n = ring->capacity - start;
+        }
+        *bytes = ring->bytes + start;
+        return n;
+}
+
+/* release, so the producer only reuses the bytes once they are read */
+void ring_consume(UM_ring ring, size_t n)
+{
+        __atomic_store_n(&ring->tail, ring->tail + n, __ATOMIC_RELEASE);
+}
+
+/* either side may ask, so both counters are loaded atomically */
+size_t ring_used(UM_ring ring)
+{
+        return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) -
+               __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/* release, so a reader that sees the close also sees every byte before it */
+void ring_close(UM_ring ring)
+{
+        __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+}
+
+/* returns whether the producer has closed the ring */
+int ring_closed(UM_ring ring)
+{
+        return __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+}
+
+/* a producer that sees it stops writing, so it needs no ordering */
+void ring_detach(UM_ring ring)
+{
+        __atomic_store_n(&ring->detached, 1, __ATOMIC_RELAXED);
+}
+
+/* returns whether the consumer has detached */
+int ring_detached(UM_ring ring)
+{
+        return __atomic_load_n(&ring->detached, __ATOMIC_RELAXED);
+}
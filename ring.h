@@ -0,0 +1,79 @@
+/*
+ * ring.h
+ *      the interface for a lock-free single-producer single-consumer byte
+ *      ring, used to hand bytes from one thread to another without locks
+ *      exactly one thread may write to a ring and exactly one may read it
+ *      either side may also work on the ring's own bytes in place, rather
+ *      than copying through a buffer of its own
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef RING_H_INCLUDED_
+#define RING_H_INCLUDED_
+
+#include <stddef.h>
+
+typedef struct UM_ring *UM_ring;
+
+/* creates an empty ring holding at least the given number of bytes (the
+ * capacity is rounded up to a power of two)
+ */
+UM_ring ring_new(size_t capacity);
+
+/* frees the ring -- neither side may use it afterwards */
+void ring_free(UM_ring ring);
+
+/* copies as many of the n bytes as there is room for into the ring and
+ * returns how many were copied -- called only by the producer
+ */
+size_t ring_write(UM_ring ring, const unsigned char *bytes, size_t n);
+
+/* copies up to max bytes out of the ring and returns how many were copied,
+ * 0 if it was empty -- called only by the consumer
+ */
+size_t ring_read(UM_ring ring, unsigned char *bytes, size_t max);
+
+/* stores in *bytes where the producer may write next and returns how many
+ * bytes it may write there, which is 0 if the ring is full -- they are not
+ * passed on until ring_commit is called; called only by the producer
+ */
+size_t ring_reserve(UM_ring ring, unsigned char **bytes);
+
+/* passes on the first n bytes written where ring_reserve said, n being no
+ * more than it returned -- called only by the producer
+ */
+void ring_commit(UM_ring ring, size_t n);
+
+/* stores in *bytes where the next waiting bytes are and returns how many of
+ * them lie there, which is 0 if the ring is empty -- they stay in the ring
+ * until ring_consume is called; called only by the consumer
+ */
+size_t ring_peek(UM_ring ring, unsigned char **bytes);
+
+/* gives back the first n bytes ring_peek showed, n being no more than it
+ * returned -- called only by the consumer
+ */
+void ring_consume(UM_ring ring, size_t n);
+
+/* returns the number of bytes written to the ring and not yet read */
+size_t ring_used(UM_ring ring);
+
+/* marks the ring as having no more bytes coming -- called by the producer */
+void ring_close(UM_ring ring);
+
+/* returns 1 if the producer has closed the ring, 0 otherwise -- bytes
+ * written before the close may still be waiting to be read
+ */
+int ring_closed(UM_ring ring);
+
+/* marks the ring as having no one left to read it -- called by the
+ * consumer
+ */
+void ring_detach(UM_ring ring);
+
+/* returns 1 if the consumer has detached from the ring, 0 otherwise */
+int ring_detached(UM_ring ring);
+
+#endif /* RING_H_INCLUDED_ */
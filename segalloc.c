@@ -0,0 +1,445 @@
+/*
+ * segalloc.c
+ *      the implementation for the segment allocator
+ *      a request of up to SMALL_MAX_WORDS words is rounded up to one of
+ *      NUM_CLASSES size classes (two per power of two, so at most a third
+ *      is wasted); each class carves blocks out of SLAB_BYTES slabs, and
+ *      each slab keeps its freed blocks on a last-in first-out list threaded
+ *      through the blocks themselves
+ *      a class hands out blocks from the slab most recently freed into, so
+ *      the most recently unmapped storage, still warm in the cache, is
+ *      handed out first
+ *      slabs are aligned to their size, so the slab a block belongs to is
+ *      found from the block's address alone, and each slab counts the
+ *      blocks it has handed out -- once a slab has none left and the free
+ *      blocks retained are over the limit of the reclamation policy, the
+ *      whole slab is given back
+ *      bigger requests go straight to calloc and free, except for those of
+ *      LAZY_MIN_BYTES or more, which get a private anonymous mapping of
+ *      their own: the kernel supplies its pages zeroed on first touch, so a
+ *      huge segment that is filled sparsely costs neither the time to zero
+ *      it nor the memory for pages never used
+ *      transparent huge pages can be asked for on those mappings (see
+ *      allocator_huge_pages), which suits big segments that are filled
+ *      densely but wastes memory on sparse ones, so they are off by default
+ *      memory given back can be handed to a reclaimer thread instead of
+ *      being freed on the spot, since unmapping a large mapping that has
+ *      been touched takes time in proportion to its size
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "segalloc.h"
+
+#define SMALL_MAX_WORDS 1024
+#define NUM_CLASSES 18
+#define SLAB_BYTES (64 * 1024)
+#define LAZY_MIN_BYTES (1024 * 1024)
+#define HUGE_PAGE_BYTES (2 * 1024 * 1024)
+
+/* whether lazy mappings of at least a huge page ask for huge pages -- one
+ * setting for the whole process, like the kernel's own
+ */
+static int huge_pages = 0;
+
+/* the reclamation policy, which is also one setting for the whole process */
+static struct reclaim_policy policy = { SIZE_MAX, 0 };
+
+/* block sizes in words -- all even, so every block in a slab stays aligned
+ * for the free list pointer stored in it
+ */
+static const uint32_t class_words[NUM_CLASSES] = {
+        2, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512,
+        768, 1024
+};
+
+/* a freed block, reused to link the free list */
+struct free_block {
+        struct free_block *next;
+};
+
+/* the start of every slab -- next and prev link every slab of the
+ * allocator; next_free and prev_free link the slabs of one class that have
+ * free blocks, most recently freed into first
+ * live counts the blocks handed out and num_free the blocks on free_list
+ */
+struct slab {
+        struct slab *next;
+        struct slab *prev;
+        struct slab *next_free;
+        struct slab *prev_free;
+        struct free_block *free_list;
+        uint32_t live;
+        uint32_t num_free;
+};
+
+/* the unused tail of the newest slab and the slabs with free blocks of one
+ * class
+ */
+struct size_class {
+        char *slab_next;
+        char *slab_end;
+        struct slab *carving;
+        struct slab *free_slabs;
+};
+
+struct Seg_allocator {
+        struct size_class classes[NUM_CLASSES];
+        uint8_t class_of[SMALL_MAX_WORDS + 1];
+        struct slab *slabs;
+        struct allocator_stats stats;
+};
+
+/* memory waiting for the reclaimer thread, described in its own first
+ * bytes -- mapped is 1 for a mapping and 0 for memory from the heap
+ */
+struct deferred {
+        struct deferred *next;
+        size_t num_bytes;
+        int mapped;
+};
+
+/* the queue of the reclaimer thread, which is started the first time it is
+ * needed and runs for as long as the process does
+ */
+static pthread_mutex_t reclaim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reclaim_ready = PTHREAD_COND_INITIALIZER;
+static struct deferred *reclaim_queue = NULL;
+static int reclaimer_started = 0;
+
+/****** private helper function declarations ******/
+
+/* carves a block of the given class out of its slab, starting a new slab
+ * if the current one is used up
+ */
+uint32_t *carve_block(Seg_allocator alloc, int class);
+
+/* returns a zero-filled private mapping of the given number of bytes, or
+ * NULL if there is no room for one
+ */
+uint32_t *map_lazy(size_t num_bytes);
+
+/* returns the slab that the given block was carved from */
+struct slab *slab_of(void *block);
+
+/* takes the given slab off the list of its class's slabs with free blocks */
+void unlink_free_slab(struct size_class *size_class, struct slab *slab);
+
+/* gives the given slab, which has no live blocks, back -- its free blocks
+ * stop counting as retained
+ */
+void release_slab(Seg_allocator alloc, int class, struct slab *slab);
+
+/* frees num_bytes of memory at the given address, now or on the reclaimer
+ * thread as the policy says
+ */
+void release_memory(void *memory, size_t num_bytes, int mapped);
+
+/* frees whatever is queued, for as long as the process runs */
+void *reclaimer(void *unused);
+
+/**************************************************/
+
+/* builds the table that maps every small word count to its class */
+Seg_allocator allocator_new(void)
+{
+        Seg_allocator alloc = calloc(1, sizeof(struct Seg_allocator));
+        int class = 0;
+
+        for (uint32_t n = 0; n <= SMALL_MAX_WORDS; n++) {
+                if (n > class_words[class]) {
+                        class++;
+                }
+                alloc->class_of[n] = class;
+        }
+        return alloc;
+}
+
+/* frees the slabs, which hold every small block whether in use or not */
+void allocator_free(Seg_allocator alloc)
+{
+        struct slab *slab = alloc->slabs;
+        while (slab != NULL) {
+                struct slab *next = slab->next;
+                free(slab);
+                slab = next;
+        }
+        free(alloc);
+}
+
+/* reuses the newest free block of the slab most recently freed into if
+ * there is one, else carves a fresh (and already zero) block from a slab
+ */
+uint32_t *allocator_get(Seg_allocator alloc, uint32_t num_words)
+{
+        if (num_words == 0) {
+                return NULL;
+        }
+        if (num_words > SMALL_MAX_WORDS) {
+                size_t num_bytes = (size_t) num_words * sizeof(uint32_t);
+
+                alloc->stats.large++;
+                if (num_bytes >= LAZY_MIN_BYTES) {
+                        alloc->stats.lazy++;
+                        return map_lazy(num_bytes);
+                }
+                return calloc(num_words, sizeof(uint32_t));
+        }
+
+        int class = alloc->class_of[num_words];
+        struct size_class *size_class = &alloc->classes[class];
+        struct slab *slab = size_class->free_slabs;
+        if (slab == NULL) {
+                alloc->stats.misses++;
+                return carve_block(alloc, class);
+        }
+
+        struct free_block *block = slab->free_list;
+        slab->free_list = block->next;
+        slab->live++;
+        if (--slab->num_free == 0) {
+                unlink_free_slab(size_class, slab);
+        }
+        alloc->stats.hits++;
+        alloc->stats.bytes_retained -= class_words[class] * sizeof(uint32_t);
+
+        uint32_t *words = (uint32_t *) block;
+        memset(words, 0, num_words * sizeof(uint32_t));
+        return words;
+}
+
+/* pushes a small block onto its slab's free list, putting the slab at the
+ * front of its class, and gives the slab back if that leaves it empty while
+ * too much is retained -- the slab still being carved is always kept
+ */
+void allocator_put(Seg_allocator alloc, uint32_t *words, uint32_t num_words)
+{
+        if (words == NULL) {
+                return;
+        }
+        if (num_words > SMALL_MAX_WORDS) {
+                size_t num_bytes = (size_t) num_words * sizeof(uint32_t);
+
+                release_memory(words, num_bytes, num_bytes >= LAZY_MIN_BYTES);
+                return;
+        }
+
+        int class = alloc->class_of[num_words];
+        struct size_class *size_class = &alloc->classes[class];
+        struct slab *slab = slab_of(words);
+        struct free_block *block = (struct free_block *) words;
+
+        block->next = slab->free_list;
+        slab->free_list = block;
+        slab->live--;
+        slab->num_free++;
+        alloc->stats.bytes_retained += class_words[class] * sizeof(uint32_t);
+
+        if (slab != size_class->free_slabs) {
+                if (slab->num_free > 1) {
+                        unlink_free_slab(size_class, slab);
+                }
+                slab->prev_free = NULL;
+                slab->next_free = size_class->free_slabs;
+                if (slab->next_free != NULL) {
+                        slab->next_free->prev_free = slab;
+                }
+                size_class->free_slabs = slab;
+        }
+
+        if (slab->live == 0 && slab != size_class->carving &&
+            alloc->stats.bytes_retained > policy.retain_bytes) {
+                release_slab(alloc, class, slab);
+        }
+}
+
+void allocator_huge_pages(int enabled)
+{
+        huge_pages = enabled;
+}
+
+void allocator_reclaim(const struct reclaim_policy *new_policy)
+{
+        policy = *new_policy;
+}
+
+/* copies the counters */
+void allocator_stats(Seg_allocator alloc, struct allocator_stats *stats)
+{
+        *stats = alloc->stats;
+}
+
+/****** private helper function definitions ******/
+
+/* slabs are zeroed when they are made, so carved blocks need no zeroing --
+ * the slab header and every block are multiples of 8 bytes, so blocks stay
+ * aligned
+ */
+uint32_t *carve_block(Seg_allocator alloc, int class)
+{
+        struct size_class *size_class = &alloc->classes[class];
+        size_t block_bytes = class_words[class] * sizeof(uint32_t);
+
+        if (size_class->slab_next == NULL ||
+            (size_t) (size_class->slab_end - size_class->slab_next) <
+            block_bytes) {
+                void *memory;
+                if (posix_memalign(&memory, SLAB_BYTES, SLAB_BYTES) != 0) {
+                        return NULL;
+                }
+                memset(memory, 0, SLAB_BYTES);
+
+                struct slab *slab = memory;
+                slab->next = alloc->slabs;
+                if (slab->next != NULL) {
+                        slab->next->prev = slab;
+                }
+                alloc->slabs = slab;
+
+                /* the slab carved before this one may already be empty, in
+                   which case it was kept only for being carved */
+                struct slab *old = size_class->carving;
+                size_class->carving = slab;
+                if (old != NULL && old->live == 0 &&
+                    alloc->stats.bytes_retained > policy.retain_bytes) {
+                        release_slab(alloc, class, old);
+                }
+
+                size_class->slab_next = (char *) slab + sizeof(struct slab);
+                size_class->slab_end = (char *) slab + SLAB_BYTES;
+                alloc->stats.bytes_slabs += SLAB_BYTES;
+        }
+
+        uint32_t *words = (uint32_t *) size_class->slab_next;
+        size_class->slab_next += block_bytes;
+        size_class->carving->live++;
+        return words;
+}
+
+/* MAP_NORESERVE keeps a mapping far bigger than the pages it will ever use
+ * from being refused under strict overcommit accounting
+ */
+uint32_t *map_lazy(size_t num_bytes)
+{
+        void *words = mmap(NULL, num_bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1,
+                           0);
+
+        if (words == MAP_FAILED) {
+                return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        if (huge_pages && num_bytes >= HUGE_PAGE_BYTES) {
+                madvise(words, num_bytes, MADV_HUGEPAGE);
+        }
+#endif
+        return words;
+}
+
+struct slab *slab_of(void *block)
+{
+        return (struct slab *) ((uintptr_t) block &
+                                ~(uintptr_t) (SLAB_BYTES - 1));
+}
+
+void unlink_free_slab(struct size_class *size_class, struct slab *slab)
+{
+        if (slab->prev_free != NULL) {
+                slab->prev_free->next_free = slab->next_free;
+        } else {
+                size_class->free_slabs = slab->next_free;
+        }
+        if (slab->next_free != NULL) {
+                slab->next_free->prev_free = slab->prev_free;
+        }
+}
+
+void release_slab(Seg_allocator alloc, int class, struct slab *slab)
+{
+        if (slab->num_free > 0) {
+                unlink_free_slab(&alloc->classes[class], slab);
+        }
+        if (slab->prev != NULL) {
+                slab->prev->next = slab->next;
+        } else {
+                alloc->slabs = slab->next;
+        }
+        if (slab->next != NULL) {
+                slab->next->prev = slab->prev;
+        }
+        alloc->stats.bytes_retained -= slab->num_free * class_words[class] *
+                                       sizeof(uint32_t);
+        alloc->stats.bytes_released += SLAB_BYTES;
+        release_memory(slab, SLAB_BYTES, 0);
+}
+
+/* the description is written into the memory itself, so deferring never
+ * allocates -- if the reclaimer thread cannot be started, the memory is
+ * freed here after all
+ */
+void release_memory(void *memory, size_t num_bytes, int mapped)
+{
+        if (policy.background) {
+                struct deferred *deferred = memory;
+
+                deferred->num_bytes = num_bytes;
+                deferred->mapped = mapped;
+                pthread_mutex_lock(&reclaim_lock);
+                if (!reclaimer_started) {
+                        pthread_t thread;
+                        if (pthread_create(&thread, NULL, reclaimer, NULL)
+                            == 0) {
+                                pthread_detach(thread);
+                                reclaimer_started = 1;
+                        }
+                }
+                if (reclaimer_started) {
+                        deferred->next = reclaim_queue;
+                        reclaim_queue = deferred;
+                        pthread_cond_signal(&reclaim_ready);
+                        pthread_mutex_unlock(&reclaim_lock);
+                        return;
+                }
+                pthread_mutex_unlock(&reclaim_lock);
+        }
+
+        if (mapped) {
+                munmap(memory, num_bytes);
+        } else {
+                free(memory);
+        }
+}
+
+/* takes the whole queue at once, so the lock is never held while freeing */
+void *reclaimer(void *unused)
+{
+        (void) unused;
+        for (;;) {
+                pthread_mutex_lock(&reclaim_lock);
+                while (reclaim_queue == NULL) {
+                        pthread_cond_wait(&reclaim_ready, &reclaim_lock);
+                }
+                struct deferred *deferred = reclaim_queue;
+                reclaim_queue = NULL;
+                pthread_mutex_unlock(&reclaim_lock);
+
+                while (deferred != NULL) {
+                        struct deferred *next = deferred->next;
+                        if (deferred->mapped) {
+                                munmap(deferred, deferred->num_bytes);
+                        } else {
+                                free(deferred);
+                        }
+                        deferred = next;
+                }
+        }
+        return NULL;
+}
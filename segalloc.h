@@ -0,0 +1,83 @@
+/*
+ * segalloc.h
+ *      the interface for the allocator that supplies the words of mapped
+ *      segments
+ *      small segments are carved from per-size-class slabs and recycled
+ *      through per-class free lists; large segments get their own
+ *      allocation, and very large ones a mapping whose pages are only
+ *      committed once they are touched
+ *      how much freed memory is kept for reuse, and whether giving the rest
+ *      back happens on a thread of its own, is set by a reclamation policy
+ *      uses an incomplete struct definition called Seg_allocator
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef SEGALLOC_H_INCLUDED_
+#define SEGALLOC_H_INCLUDED_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef struct Seg_allocator *Seg_allocator;
+
+/* counters kept by an allocator since it was created */
+struct allocator_stats {
+        uint64_t hits;          /* small requests served from a free list */
+        uint64_t misses;        /* small requests carved from a slab */
+        uint64_t large;         /* requests too big for any size class */
+        uint64_t lazy;          /* large requests given a lazy mapping */
+        size_t bytes_retained;  /* bytes sitting in free lists right now */
+        size_t bytes_slabs;     /* bytes of slab memory obtained so far */
+        size_t bytes_released;  /* bytes of slab memory given back so far */
+};
+
+/* what allocators do with the memory of unmapped segments */
+struct reclaim_policy {
+        size_t retain_bytes;    /* free small blocks kept for reuse before
+                                   emptied slabs are given back; SIZE_MAX,
+                                   the default, keeps every slab */
+        int background;         /* 1 to have a thread free what is given
+                                   back, so unmapping never waits for it */
+};
+
+/* creates an allocator with empty slabs and free lists */
+Seg_allocator allocator_new(void);
+
+/* frees every slab and the allocator itself -- any words still handed out
+ * by allocator_get become invalid, except large ones, which the caller must
+ * have returned
+ */
+void allocator_free(Seg_allocator alloc);
+
+/* returns an array of the given number of words, all zero -- returns NULL
+ * for 0 words, and if the words cannot be allocated
+ */
+uint32_t *allocator_get(Seg_allocator alloc, uint32_t num_words);
+
+/* gives back an array from allocator_get, with the length it was requested
+ * with, for reuse -- NULL is ignored
+ */
+void allocator_put(Seg_allocator alloc, uint32_t *words, uint32_t num_words);
+
+/* asks for transparent huge pages (1) or not (0, the default) on the lazy
+ * mappings that any allocator makes from now on -- worth it for big segments
+ * that are filled densely, since it cuts TLB misses, but a sparse segment
+ * then commits a whole huge page for every word it touches
+ */
+void allocator_huge_pages(int enabled);
+
+/* sets the reclamation policy of every allocator from now on -- it must not
+ * be changed while allocators are in use on other threads
+ * a slab is given back once every block in it is free, if the free blocks
+ * of its allocator are then over retain_bytes, so blocks that share slabs
+ * with live ones can keep an allocator over the limit; large segments are
+ * never retained
+ */
+void allocator_reclaim(const struct reclaim_policy *policy);
+
+/* copies the allocator's counters into *stats */
+void allocator_stats(Seg_allocator alloc, struct allocator_stats *stats);
+
+#endif /* SEGALLOC_H_INCLUDED_ */
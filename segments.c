@@ -1,7 +1,22 @@
 /*
  * segments.c
  *      the implementation for the segmented memory of the UM
- *      defines the components of the struct UM_memory
+ *      defines the components of the struct UM_memory -- a dense table
+ *      of segments, each one a contiguous array of words
+ *      load_program does not copy: the new 0-segment shares its words (and
+ *      their decoding) with the segment it came from, and whichever of them
+ *      is stored to first takes a private copy
+ *      a memory made from a UM_program borrows the program's words as a
+ *      shared 0-segment, so any number of memories in any number of threads
+ *      can run one loaded program without copying it
+ *      a restored memory uses the words of its snapshot image in place; they
+ *      are written directly (the mapping is private) and never handed to the
+ *      segment allocator -- a memory made from a cached image uses its words
+ *      and their decoding in place just the same
+ *      a program streamed in from a pipe grows its 0-segment as it arrives;
+ *      its words are only decoded when the engine runs out of decoded ones,
+ *      so a load or store that waits for a word never moves the decoding
+ *      out from under an engine
  *      defines functions that manipulate the memory
  *
  * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
@@ -9,27 +24,168 @@
  *
  */
 
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include "seq.h"
-#include "stack.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "segments.h"
-#include "bitpack.h"
+#include "decode.h"
+#include "peephole.h"
+#include "byteswap.h"
+#include "segalloc.h"
+#include "stats.h"
 
-#define BYTE 8
 #define BYTES_IN_WORD 4
+#define READ_CHUNK (1 << 20)
+#define NO_SEGMENT UINT32_MAX
+#define MAPPED (NO_SEGMENT - 1)
+
+/* words that more than one segment is reading, after a load_program --
+ * refs counts the segments using them, and decoded is their predecoded form,
+ * made the first time they are installed as the 0-segment and kept so that
+ * loading the same words again costs nothing
+ * shared words are never written; a store goes to a private copy
+ * borrowed words belong to a UM_program rather than to this memory, so they
+ * are never given back, and a store copies them even with one reference
+ */
+struct shared {
+        uint32_t *words;
+        uint32_t length;
+        uint32_t refs;
+        int borrowed;
+        struct decoded *decoded;
+};
+
+/* one entry in the segment table: a contiguous array of words from the
+ * segment allocator and its length -- a segment of length 0, and every
+ * unmapped segment, has a NULL words pointer
+ * if shared is not NULL the words belong to it rather than to the segment
+ * while an entry is unmapped, next_unmapped holds the index of the entry
+ * that was unmapped before it (NO_SEGMENT for none), so the unmapped entries
+ * form a stack threaded through the table itself; a mapped entry holds
+ * MAPPED there instead
+ */
+struct segment {
+        uint32_t *words;
+        uint32_t length;
+        uint32_t next_unmapped;
+        struct shared *shared;
+};
+
+/* a 0-segment that is still arriving -- its words have room for capacity
+ * words, of which its length have arrived and the first decoded have been
+ * decoded; buffer holds what each read returns, after the num_partial bytes
+ * of a word that had only partly arrived
+ */
+struct stream {
+        FILE *input;
+        int ended;
+        uint32_t capacity;
+        uint32_t decoded;
+        size_t num_partial;
+        unsigned char *buffer;
+};
+
+/* a program loaded once, for memory_from_program */
+struct UM_program {
+        uint32_t *words;
+        uint32_t length;
+        struct decoded *decoded;
+};
 
+/* unmapped is the most recently unmapped index, the top of the stack of
+ * reusable indices (NO_SEGMENT when it is empty)
+ * decoded holds one predecoded entry per word of the 0-segment; it is
+ * rebuilt whenever a new program is installed and kept in step with stores
+ * into the 0-segment -- while the 0-segment is shared it is the shared
+ * decoding, which the memory does not own
+ * image is the snapshot or cache mapping a memory's words lie in (NULL for
+ * none)
+ * stream is the rest of a 0-segment still arriving (NULL for none)
+ * counters points to the memory's own counters until memory_count moves them
+ * -- the mapped word count in them is what max_words limits
+ */
 struct UM_memory {
-        Seq_T segments;
-        Stack_T unmapped;
+        struct segment *segments;
+        uint32_t num_segments;
+        uint32_t capacity;
+        uint32_t unmapped;
         unsigned prog_counter;
+        struct decoded *decoded;
+        Seg_allocator alloc;
+        unsigned char *image;
+        size_t image_size;
+        uint64_t max_words;
+        struct stream *stream;
+        struct live_counters *counters;
+        struct live_counters own_counters;
 };
 
 /****** private helper function declarations ******/
 
-/* removes all words in given segment but does not free the sequence itself */
-void free_segment_words(Seq_T segment);
+/* makes room for at least one more entry at the end of the segment table */
+void expand_segment_table(UM_memory mem);
+
+/* rebuilds the predecoded form of the whole 0-segment */
+void decode_program(UM_memory mem);
+
+/* returns 1 if the given pointer lies in the memory's image and 0 otherwise */
+int in_image(UM_memory mem, const void *pointer);
+
+/* gives words back to the allocator, unless they are part of the image */
+void put_words(UM_memory mem, uint32_t *words, uint32_t num_words);
+
+/* gives up the words of the given segment -- private words go back to the
+ * allocator, shared ones lose a reference and are freed with the last one
+ */
+void release_words(UM_memory mem, struct segment *segment);
+
+/* gives up the 0-segment's words and, if the memory owns it, its decoding */
+void release_program(UM_memory mem);
+
+/* returns the shared words of the given segment, first wrapping its private
+ * words if they are not shared yet
+ */
+struct shared *share_words(struct segment *segment);
+
+/* gives the segment at the given index private words it can store to */
+void unshare_words(UM_memory mem, uint32_t segment_index);
+
+/* returns every byte of the given stream, storing how many in *num_bytes
+ * and in *mapped whether they were mmap'd
+ */
+unsigned char *input_bytes(FILE *input, size_t *num_bytes, int *mapped);
+
+/* gives back the bytes from input_bytes */
+void release_input(unsigned char *bytes, size_t num_bytes, int mapped);
+
+/* reads the rest of the given stream into one malloc'd buffer, storing the
+ * number of bytes read in *num_bytes
+ */
+unsigned char *read_stream(FILE *input, size_t *num_bytes);
+
+/* waits until at least one more whole word of the stream has arrived, and
+ * appends every whole word read to the 0-segment -- returns the number of
+ * words appended, which is 0 once the stream has ended
+ */
+uint32_t read_words(UM_memory mem);
+
+/* decodes the words of the 0-segment that have arrived but not been decoded */
+void decode_arrived(UM_memory mem);
+
+/* waits until the word at the given offset in the 0-segment has arrived, or
+ * the stream has ended without it
+ */
+void await_word(UM_memory mem, uint32_t offset);
+
+/* closes the stream and gives the 0-segment words of exactly its length */
+void end_stream(UM_memory mem);
 
 /**************************************************/
 
@@ -43,8 +199,18 @@ UM_memory initialize_memory()
         uint32_t initial_guess = 10;
 
         /* create new memory with initial guess of 10 segments */
-        mem->segments = Seq_new(initial_guess);
-        mem->unmapped = Stack_new();
+        mem->segments = malloc(initial_guess * sizeof(struct segment));
+        mem->num_segments = 0;
+        mem->capacity = initial_guess;
+        mem->unmapped = NO_SEGMENT;
+        mem->decoded = NULL;
+        mem->alloc = allocator_new();
+        mem->image = NULL;
+        mem->image_size = 0;
+        mem->max_words = UINT64_MAX;
+        mem->stream = NULL;
+        memset(&mem->own_counters, 0, sizeof(struct live_counters));
+        mem->counters = &mem->own_counters;
 
         map_segment(mem, 0);
         mem->prog_counter = 0; 
@@ -55,49 +221,178 @@ UM_memory initialize_memory()
 /* frees memory for the entire provided UM_memory struct */
 void free_memory(UM_memory mem)
 {
-        int length = Seq_length(mem->segments);
-        for (int i = 0; i < length; i++) {
-                Seq_T segment = Seq_get(mem->segments, i);
-                free_segment_words(segment);
-                Seq_free(&segment);
+        release_program(mem);
+        for (uint32_t i = 1; i < mem->num_segments; i++) {
+                release_words(mem, &mem->segments[i]);
         }
-        Seq_free(&(mem->segments));
-        
-        while (Stack_empty(mem->unmapped) != 1) {
-                uint32_t *popped = Stack_pop(mem->unmapped);
-                free(popped);
+        allocator_free(mem->alloc);
+        if (mem->image != NULL) {
+                munmap(mem->image, mem->image_size);
+        }
+        free(mem->segments);
+        free(mem);
+}
+
+/* gets the whole image at once -- a regular file is mmap'd, anything else
+ * (a pipe, say) is read in large chunks -- then sizes the 0-segment from the
+ * image length and converts the big-endian words to host order in bulk
+ * as with the original byte-at-a-time loader, a partial word at the end of
+ * the file is dropped
+ */
+void load_instructions(UM_memory mem, FILE *input)
+{
+        size_t num_bytes;
+        int mapped;
+        unsigned char *bytes = input_bytes(input, &num_bytes, &mapped);
+        struct segment *seg_zero = &mem->segments[0];
+        uint32_t num_words = num_bytes / BYTES_IN_WORD;
+
+        release_program(mem);
+        seg_zero->words = allocator_get(mem->alloc, num_words);
+        seg_zero->length = num_words;
+        swap_words(seg_zero->words, bytes, num_words);
+
+        release_input(bytes, num_bytes, mapped);
+        decode_program(mem);
+}
+
+/* reads the words just as load_instructions does, then decodes them once */
+UM_program program_load(FILE *input)
+{
+        size_t num_bytes;
+        int mapped;
+        unsigned char *bytes = input_bytes(input, &num_bytes, &mapped);
+        UM_program program = program_from_bytes(bytes, num_bytes);
+
+        release_input(bytes, num_bytes, mapped);
+        return program;
+}
 
+/* a regular file is all there already, so it is loaded whole
+ * the 0-segment starts out with room for a chunk of words and doubles its
+ * room as they arrive
+ */
+void stream_instructions(UM_memory mem, FILE *input)
+{
+        struct stat info;
+
+        if (fstat(fileno(input), &info) != 0 || S_ISREG(info.st_mode)) {
+                load_instructions(mem, input);
+                fclose(input);
+                return;
         }
-        Stack_free(&mem->unmapped);
 
-        free(mem);
+        struct stream *stream = malloc(sizeof(struct stream));
+        struct segment *seg_zero = &mem->segments[0];
+
+        release_program(mem);
+        stream->input = input;
+        stream->ended = 0;
+        stream->capacity = READ_CHUNK / BYTES_IN_WORD;
+        stream->decoded = 0;
+        stream->num_partial = 0;
+        stream->buffer = malloc(READ_CHUNK);
+        seg_zero->words = allocator_get(mem->alloc, stream->capacity);
+        seg_zero->length = 0;
+        mem->counters->program_words = 0;
+        mem->stream = stream;
 }
 
-/* parses the given input file and creates the 32 bit instructions,
- * which it then loads into the 0-segment until it hits EOF
+/* words a load or store waited for are decoded here first, without reading
+ * anything more
  */
-void load_instructions(UM_memory mem, FILE *input) {
-        uint32_t new_word = ~0;
-        int c = 0;
-        while (c != EOF) {
-                if (new_word != (uint32_t) ~0) {
-                        Seq_T seg_zero = Seq_get(mem->segments, 0);
-                        uint32_t *word = malloc(sizeof(uint32_t));
+int more_instructions(UM_memory mem)
+{
+        struct stream *stream = mem->stream;
 
-                        *word = new_word;
-                        Seq_addhi(seg_zero, word);
-                        new_word = 0;
-                }
-                for (int i = 3; i >= 0; i--) {
-                        c = fgetc(input);
-                        if (c == EOF) {
-                                break;
-                        } else {
-                                new_word = Bitpack_newu(new_word, BYTE,
-                                                        BYTE * i, c);
-                        }
-                }
+        if (stream == NULL) {
+                return 0;
+        }
+        if (stream->decoded == mem->segments[0].length &&
+            read_words(mem) == 0) {
+                end_stream(mem);
+                return 0;
+        }
+        decode_arrived(mem);
+        return 1;
+}
+
+/* converts the big-endian words to host order in bulk, then decodes them */
+UM_program program_from_bytes(const unsigned char *bytes, size_t num_bytes)
+{
+        UM_program program = malloc(sizeof(struct UM_program));
+
+        program->length = num_bytes / BYTES_IN_WORD;
+        program->words = malloc(program->length * sizeof(uint32_t));
+        program->decoded = malloc(program->length * sizeof(struct decoded));
+        swap_words(program->words, bytes, program->length);
+        decode_words(program->words, program->decoded, program->length);
+        peephole_program(program->decoded, program->length);
+        return program;
+}
+
+/* frees the words and their decoding */
+void program_free(UM_program program)
+{
+        free(program->words);
+        free(program->decoded);
+        free(program);
+}
+
+/* memories only ever borrow these words, so they are never stored into */
+const uint32_t *program_words(UM_program program, uint32_t *length)
+{
+        *length = program->length;
+        return program->words;
+}
+
+/* the 0-segment borrows the program's words through a shared record of its
+ * own, so a store into it copies them like any other shared words -- the
+ * decoding is copied straight away, since the engines keep a pointer to it
+ * that a store must not invalidate
+ */
+UM_memory memory_from_program(UM_program program)
+{
+        UM_memory mem = initialize_memory();
+        struct segment *seg_zero = &mem->segments[0];
+        struct shared *shared = malloc(sizeof(struct shared));
+        size_t decoded_bytes = program->length * sizeof(struct decoded);
+
+        shared->words = program->words;
+        shared->length = program->length;
+        shared->refs = 1;
+        shared->borrowed = 1;
+        shared->decoded = malloc(decoded_bytes);
+        if (decoded_bytes > 0) {
+                memcpy(shared->decoded, program->decoded, decoded_bytes);
         }
+
+        release_program(mem);
+        seg_zero->words = shared->words;
+        seg_zero->length = shared->length;
+        seg_zero->shared = shared;
+        mem->decoded = shared->decoded;
+        mem->counters->program_words = shared->length;
+        return mem;
+}
+
+/* nothing is decoded or copied -- the 0-segment and its decoding are
+ * simply pointed into the image
+ */
+UM_memory memory_from_image(uint32_t *words, struct decoded *decoded,
+                            uint32_t length, void *image, size_t image_size)
+{
+        UM_memory mem = initialize_memory();
+        struct segment *seg_zero = &mem->segments[0];
+
+        release_program(mem);
+        seg_zero->words = words;
+        seg_zero->length = length;
+        mem->decoded = decoded;
+        mem->image = image;
+        mem->image_size = image_size;
+        mem->counters->program_words = length;
+        return mem;
 }
 
 /* gets the next instruction in the 0-segment and increments
@@ -110,12 +405,7 @@ uint32_t get_instruction(UM_memory mem)
                 return 0;
         }
 
-        Seq_T seg_zero = Seq_get(mem->segments, 0);
-        uint32_t *instruction = Seq_get(seg_zero, mem->prog_counter);
-
-        mem->prog_counter++;
-
-        return *instruction;
+        return mem->segments[0].words[mem->prog_counter++];
 }
 
 /* checks whether the prog_counter is still less than the number of
@@ -124,116 +414,594 @@ uint32_t get_instruction(UM_memory mem)
  */
 uint32_t done_with_instructions(UM_memory mem)
 {
-        Seq_T seg_zero = Seq_get(mem->segments, 0);
-        if (mem->prog_counter >= (unsigned) Seq_length(seg_zero)) {
-                return 1;
+        while (mem->prog_counter >= mem->segments[0].length) {
+                if (more_instructions(mem) == 0) {
+                        return 1;
+                }
         }
         return 0;
 }
 
-/* checks whether there are any indices on the unmapped address stack
- *      if so, it pops an address and maps a segment of the given number of
- *              words to that address.
- *      if not, it maps a segment to the end of the memory sequence
- * initializes the given number of words to all zeros in the segment
- * returns the index of the new segment in the sequence
+/* returns the words of the 0-segment, storing its length in *length */
+uint32_t *program_segment(UM_memory mem, uint32_t *length)
+{
+        *length = mem->segments[0].length;
+        return mem->segments[0].words;
+}
+
+/* returns the predecoded 0-segment, one entry per word, storing its length
+ * in *length
+ */
+const struct decoded *decoded_program(UM_memory mem, uint32_t *length)
+{
+        if (mem->stream != NULL) {
+                *length = mem->stream->decoded;
+                return mem->decoded;
+        }
+        *length = mem->segments[0].length;
+        return mem->decoded;
+}
+
+/* the lengths are compared first, so another program is usually told
+ * apart without reading its words -- and a segment still sharing its
+ * words with the 0-segment is the program without reading them either
+ */
+int segment_is_program(UM_memory mem, uint32_t segment_index)
+{
+        struct segment *segment = &mem->segments[segment_index];
+        struct segment *seg_zero = &mem->segments[0];
+
+        return segment->length == seg_zero->length &&
+               (segment->length == 0 || segment->words == seg_zero->words ||
+                memcmp(segment->words, seg_zero->words,
+                       segment->length * sizeof(uint32_t)) == 0);
+}
+
+/* copies the segment allocator's counters into *stats */
+void memory_alloc_stats(UM_memory mem, struct allocator_stats *stats)
+{
+        allocator_stats(mem->alloc, stats);
+}
+
+/* returns the current program counter */
+uint32_t get_prog_counter(UM_memory mem)
+{
+        return mem->prog_counter;
+}
+
+/* the count includes unmapped entries */
+uint32_t memory_table(UM_memory mem, uint32_t *unmapped)
+{
+        *unmapped = mem->unmapped;
+        return mem->num_segments;
+}
+
+/* a shared segment is described by the words it shares */
+void segment_info(UM_memory mem, uint32_t segment_index,
+                  struct segment_info *info)
+{
+        struct segment *segment = &mem->segments[segment_index];
+
+        info->words = segment->words;
+        info->length = segment->length;
+        info->next_unmapped = segment->next_unmapped;
+}
+
+/* walks the unmapped stack before trusting it, so that a bad snapshot
+ * cannot send map_segment off the end of the table or round in a circle --
+ * only the entries on the stack keep their saved next_unmapped, and every
+ * other entry is marked mapped
+ */
+UM_memory memory_restore(const struct segment_info *table,
+                         uint32_t num_segments, uint32_t unmapped,
+                         uint32_t prog_counter, void *image,
+                         size_t image_size)
+{
+        uint32_t steps = 0;
+
+        if (num_segments == 0) {
+                return NULL;
+        }
+        for (uint32_t i = unmapped; i != NO_SEGMENT;
+             i = table[i].next_unmapped) {
+                if (i == 0 || i >= num_segments ||
+                    steps++ == num_segments) {
+                        return NULL;
+                }
+        }
+
+        UM_memory mem = initialize_memory();
+        release_program(mem);
+        mem->num_segments = 0;
+        mem->capacity = num_segments;
+        mem->segments = realloc(mem->segments,
+                                num_segments * sizeof(struct segment));
+        for (uint32_t i = 0; i < num_segments; i++) {
+                mem->segments[i].words = table[i].words;
+                mem->segments[i].length = table[i].length;
+                mem->segments[i].next_unmapped = MAPPED;
+                mem->segments[i].shared = NULL;
+        }
+        for (uint32_t i = unmapped; i != NO_SEGMENT;
+             i = table[i].next_unmapped) {
+                mem->segments[i].next_unmapped = table[i].next_unmapped;
+        }
+        mem->num_segments = num_segments;
+        mem->unmapped = unmapped;
+        mem->prog_counter = prog_counter;
+        mem->image = image;
+        mem->image_size = image_size;
+        mem->counters->live_segments = num_segments - steps;
+        mem->counters->unmapped_segments = steps;
+        for (uint32_t i = 1; i < num_segments; i++) {
+                mem->counters->mapped_words += mem->segments[i].length;
+        }
+        decode_program(mem);
+        return mem;
+}
+
+/* checks whether there are any indices on the unmapped stack
+ *      if so, it pops an index and maps a segment of the given number of
+ *              words to that index.
+ *      if not, it maps a segment to the end of the segment table
+ * the new segment is a single zeroed array of the given number of words from
+ * the segment allocator
+ * returns the index of the new segment in the table, or SEGMENT_REFUSED
+ * without mapping anything if the segment would take the memory over its
+ * limit or its words cannot be allocated
+ * the words are allocated before the table or the counters are touched, so
+ * a refusal leaves nothing to undo
  */
 uint32_t map_segment(UM_memory mem, uint32_t num_words) 
 {
         uint32_t index;
+
+        /* a memory restored from a snapshot may already be over a limit
+           set since, and max_words - mapped_words must not wrap */
+        if (mem->counters->mapped_words >= mem->max_words ||
+            num_words > mem->max_words - mem->counters->mapped_words) {
+                return SEGMENT_REFUSED;
+        }
+        uint32_t *words = allocator_get(mem->alloc, num_words);
+        if (words == NULL && num_words > 0) {
+                return SEGMENT_REFUSED;
+        }
+        mem->counters->mapped_words += num_words;
+        mem->counters->live_segments++;
+
         /* checking to see if segment was previously mapped  */
-        if (Stack_empty(mem->unmapped) == 1) {
-                index = Seq_length(mem->segments);
-                Seq_addhi(mem->segments, Seq_new(num_words));
+        if (mem->unmapped == NO_SEGMENT) {
+                expand_segment_table(mem);
+                index = mem->num_segments++;
         } else {
-                uint32_t *popped = Stack_pop(mem->unmapped);
-                index = *popped;
-                free(popped);
-                Seq_T old_segment = Seq_get(mem->segments, index);
-                /* we have to free everything before we remap it */
-                free_segment_words(old_segment);
+                index = mem->unmapped;
+                mem->unmapped = mem->segments[index].next_unmapped;
+                mem->counters->unmapped_segments--;
         }
 
-        /* initialize new segment to 0s */
-        Seq_T segment = Seq_get(mem->segments, index);
-        for (uint32_t i = 0; i < num_words; i++) {
-                uint32_t *new_space = malloc(sizeof(*new_space));
+        struct segment *segment = &mem->segments[index];
+        segment->words = words;
+        segment->length = num_words;
+        segment->next_unmapped = MAPPED;
+        segment->shared = NULL;
 
-                *new_space = 0;
-                Seq_addhi(segment, new_space);
-        }
         return index;
 }
 
-/* to unmap, simply push the index of the given segment to the unmapped
- * address stack so we can reuse it -- don't free segment here, b/c allocated
- * memory will be freed if/when the segment index is reused
+/* to unmap, give the words back to the segment allocator, which keeps
+ * them for the next segment of a similar size, and push the index of the
+ * given segment onto the unmapped stack so we can reuse it
+ * the stack is last-in first-out, so indices are reused in the same order
+ * as they always have been
  */
 void unmap_segment(UM_memory mem, uint32_t segment_index)
 {
-        uint32_t *new_seg_index = malloc(sizeof(*new_seg_index));
+        struct segment *segment = &mem->segments[segment_index];
+
+        mem->counters->mapped_words -= segment->length;
+        mem->counters->live_segments--;
+        mem->counters->unmapped_segments++;
+        release_words(mem, segment);
+        segment->next_unmapped = mem->unmapped;
+        mem->unmapped = segment_index;
+}
+
+void memory_limit(UM_memory mem, uint64_t max_words)
+{
+        mem->max_words = max_words;
+}
+
+struct live_counters *memory_counters(UM_memory mem)
+{
+        return mem->counters;
+}
 
-        *new_seg_index = segment_index;
-        Stack_push(mem->unmapped, new_seg_index);
+void memory_count(UM_memory mem, struct live_counters *counters)
+{
+        *counters = *mem->counters;
+        mem->counters = counters;
 }
 
-/* return the value at the given segment in the memory sequence at the given
- * offset in that segment sequence
+/* segment 0 is always mapped */
+int segment_mapped(UM_memory mem, uint32_t segment_index)
+{
+        return segment_index < mem->num_segments &&
+               mem->segments[segment_index].next_unmapped == MAPPED;
+}
+
+/* returns the length recorded in the segment table */
+uint32_t segment_length(UM_memory mem, uint32_t segment_index)
+{
+        return mem->segments[segment_index].length;
+}
+
+/* the engines that check every access call this, so it reads the table
+ * once rather than going through segment_mapped and segment_length
  */
-uint32_t segments_load(UM_memory mem, uint32_t segment_index, uint32_t offset)
+int segment_contains(UM_memory mem, uint32_t segment_index, uint32_t offset)
 {
-        Seq_T segment = Seq_get(mem->segments, segment_index);
-        uint32_t *loaded_value = Seq_get(segment, offset);
+        if (segment_index >= mem->num_segments) {
+                return 0;
+        }
+        const struct segment *segment = &mem->segments[segment_index];
+        return segment->next_unmapped == MAPPED && offset < segment->length;
+}
 
-        return *loaded_value;
+/* return the value at the given segment in the segment table at the given
+ * offset in that segment
+ */
+uint32_t segments_load(UM_memory mem, uint32_t segment_index, uint32_t offset)
+{
+        if (segment_index == 0 && mem->stream != NULL) {
+                await_word(mem, offset);
+        }
+        return mem->segments[segment_index].words[offset];
 }
 
-/* store the given value in the memory sequence in the given segment at the
- * given offset in that segment sequence
+/* store the given value in the segment table in the given segment at the
+ * given offset in that segment
+ * a store into shared words first gives the segment its own copy, and a
+ * store into the 0-segment also re-decodes the one instruction it changed
+ * and redoes the superinstructions that could cover it
+ * a store into a 0-segment still arriving waits for the word it replaces,
+ * and leaves a word that has not been decoded yet to be decoded later
  */
 void segments_store(UM_memory mem, uint32_t segment_index, uint32_t offset,
                     uint32_t value)
 {
-        Seq_T segment = Seq_get(mem->segments, segment_index);
-        uint32_t *value_location = Seq_get(segment, offset);
-        *value_location = value;
+        struct segment *segment = &mem->segments[segment_index];
+
+        if (segment_index == 0 && mem->stream != NULL) {
+                await_word(mem, offset);
+                segment->words[offset] = value;
+                if (offset < mem->stream->decoded) {
+                        decode_word(value, &mem->decoded[offset]);
+                        peephole_update(mem->decoded, mem->stream->decoded,
+                                        offset);
+                }
+                return;
+        }
+
+        if (segment->shared != NULL) {
+                unshare_words(mem, segment_index);
+        }
+        segment->words[offset] = value;
+        if (segment_index == 0) {
+                decode_word(value, &mem->decoded[offset]);
+                peephole_update(mem->decoded, segment->length, offset);
+        }
 }
 
-/* unmaps and remaps the 0-segment with the number of words in the segment
- * at the given segment index
- * then copies each value in the given segment into the 0-segment
+/* replaces the 0-segment with the words of the segment at the given segment
+ * index, shared rather than copied, and installs their decoding -- which is
+ * only made if these words have not been installed before
  * finally sets the program counter to be the given offset in the new 0-segment
- * if the segment index is 0, nothing is unmapped, mapped, or copied, but the
+ * if the segment index is 0, nothing is freed, allocated, or copied, but the
  * prog counter is set to the offset in the 0-segment
  */
 void segments_load_program(UM_memory mem, uint32_t segment_index,
                            uint32_t offset)
 {
         if (segment_index != 0) {
-                Seq_T segment = Seq_get(mem->segments, segment_index);
-                int length = Seq_length(segment);
-                /* unmapping the zero segment so that it will be the next
-                   possible address on the stack to map to */
-                unmap_segment(mem, 0);
-                map_segment(mem, length);
-                Seq_T seg_zero = Seq_get(mem->segments, 0);
-                for (int i = 0; i < length; i++) {
-                        uint32_t *value = Seq_get(segment, i);
-                        uint32_t *newval_location = Seq_get(seg_zero, i);
-                        *newval_location = *value;
+                struct shared *shared =
+                        share_words(&mem->segments[segment_index]);
+                struct segment *seg_zero = &mem->segments[0];
+
+                /* the new reference is taken first, in case the 0-segment
+                   already holds these very words */
+                shared->refs++;
+                if (shared->decoded == NULL) {
+                        shared->decoded = malloc(shared->length *
+                                                 sizeof(struct decoded));
+                        decode_words(shared->words, shared->decoded,
+                                     shared->length);
+                        peephole_program(shared->decoded, shared->length);
                 }
+                release_program(mem);
+                seg_zero->words = shared->words;
+                seg_zero->length = shared->length;
+                seg_zero->shared = shared;
+                mem->decoded = shared->decoded;
+                mem->counters->program_words = shared->length;
         }
         mem->prog_counter = offset;
 }
 
 /****** private heler function definitions ******/
 
-/* frees all words in the given sequence */
-void free_segment_words(Seq_T segment)
+/* doubles the capacity of the segment table if every entry is in use */
+void expand_segment_table(UM_memory mem)
+{
+        if (mem->num_segments < mem->capacity) {
+                return;
+        }
+        mem->capacity *= 2;
+        mem->segments = realloc(mem->segments,
+                                mem->capacity * sizeof(struct segment));
+}
+
+/* replaces the decoded array with a fresh decoding of the 0-segment */
+void decode_program(UM_memory mem)
+{
+        struct segment *seg_zero = &mem->segments[0];
+
+        free(mem->decoded);
+        mem->decoded = malloc(seg_zero->length * sizeof(struct decoded));
+        decode_words(seg_zero->words, mem->decoded, seg_zero->length);
+        peephole_program(mem->decoded, seg_zero->length);
+        mem->counters->program_words = seg_zero->length;
+}
+
+int in_image(UM_memory mem, const void *pointer)
+{
+        const unsigned char *bytes = pointer;
+
+        return mem->image != NULL && bytes >= mem->image &&
+               bytes < mem->image + mem->image_size;
+}
+
+/* the image is unmapped as a whole when the memory is freed */
+void put_words(UM_memory mem, uint32_t *words, uint32_t num_words)
+{
+        if (in_image(mem, words)) {
+                return;
+        }
+        allocator_put(mem->alloc, words, num_words);
+}
+
+/* a segment that is not shared owns its words outright */
+void release_words(UM_memory mem, struct segment *segment)
+{
+        struct shared *shared = segment->shared;
+
+        if (shared == NULL) {
+                put_words(mem, segment->words, segment->length);
+        } else if (--shared->refs == 0) {
+                if (shared->borrowed == 0) {
+                        put_words(mem, shared->words, shared->length);
+                }
+                free(shared->decoded);
+                free(shared);
+        }
+        segment->words = NULL;
+        segment->length = 0;
+        segment->shared = NULL;
+}
+
+/* a shared decoding belongs to the shared words, so it is released with
+ * them, and a decoding in the image goes with the image -- a program still
+ * arriving is cut off where it is
+ */
+void release_program(UM_memory mem)
+{
+        struct segment *seg_zero = &mem->segments[0];
+
+        if (mem->stream != NULL) {
+                end_stream(mem);
+        }
+        if (seg_zero->shared == NULL && !in_image(mem, mem->decoded)) {
+                free(mem->decoded);
+        }
+        release_words(mem, seg_zero);
+        mem->decoded = NULL;
+}
+
+/* the segment's own words become the shared words, with one reference */
+struct shared *share_words(struct segment *segment)
+{
+        if (segment->shared == NULL) {
+                struct shared *shared = malloc(sizeof(struct shared));
+                shared->words = segment->words;
+                shared->length = segment->length;
+                shared->refs = 1;
+                shared->borrowed = 0;
+                shared->decoded = NULL;
+                segment->shared = shared;
+        }
+        return segment->shared;
+}
+
+/* the last segment using words of its own simply takes them back;
+ * otherwise it copies them
+ * the 0-segment always keeps the decoding it is running from (the engines
+ * hold on to that pointer) and the shared words lose their cached copy, so
+ * the decoding is never copied
+ */
+void unshare_words(UM_memory mem, uint32_t segment_index)
 {
-        int length = Seq_length(segment);
-        for (int i = 0; i < length; i++) {
-                uint32_t *removed = Seq_remhi(segment);
-                free(removed);
+        struct segment *segment = &mem->segments[segment_index];
+        struct shared *shared = segment->shared;
+
+        segment->shared = NULL;
+        if (shared->refs == 1 && shared->borrowed == 0) {
+                if (segment_index != 0) {
+                        free(shared->decoded);
+                }
+                free(shared);
+                return;
+        }
+        segment->words = allocator_get(mem->alloc, segment->length);
+        if (segment->length > 0) {
+                memcpy(segment->words, shared->words,
+                       segment->length * sizeof(uint32_t));
+        }
+        if (segment_index == 0) {
+                shared->decoded = NULL;
+        }
+        if (--shared->refs == 0) {
+                free(shared->decoded);
+                free(shared);
+        }
+}
+
+/* a regular file is mmap'd, anything else (a pipe, say) is read in large
+ * chunks
+ */
+unsigned char *input_bytes(FILE *input, size_t *num_bytes, int *mapped)
+{
+        struct stat info;
+        int fd = fileno(input);
+
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+            info.st_size > 0) {
+                unsigned char *bytes = mmap(NULL, info.st_size, PROT_READ,
+                                            MAP_PRIVATE, fd, 0);
+                if (bytes != MAP_FAILED) {
+                        *mapped = 1;
+                        *num_bytes = info.st_size;
+                        madvise(bytes, *num_bytes, MADV_SEQUENTIAL);
+                        return bytes;
+                }
+        }
+        *mapped = 0;
+        return read_stream(input, num_bytes);
+}
+
+/* unmaps or frees, whichever input_bytes did */
+void release_input(unsigned char *bytes, size_t num_bytes, int mapped)
+{
+        if (mapped == 1) {
+                munmap(bytes, num_bytes);
+        } else {
+                free(bytes);
+        }
+}
+
+/* doubles the buffer whenever a chunk read would not fit */
+unsigned char *read_stream(FILE *input, size_t *num_bytes)
+{
+        size_t capacity = READ_CHUNK;
+        size_t length = 0;
+        unsigned char *bytes = malloc(capacity);
+        size_t got;
+
+        do {
+                if (capacity - length < READ_CHUNK) {
+                        capacity *= 2;
+                        bytes = realloc(bytes, capacity);
+                }
+                got = fread(bytes + length, 1, READ_CHUNK, input);
+                length += got;
+        } while (got == READ_CHUNK);
+
+        *num_bytes = length;
+        return bytes;
+}
+
+/* a read returns as soon as anything has arrived, so the program can start
+ * on its first words; a partial word left at the end is dropped, as
+ * load_instructions drops it
+ */
+uint32_t read_words(UM_memory mem)
+{
+        struct stream *stream = mem->stream;
+        struct segment *seg_zero = &mem->segments[0];
+        size_t have = stream->num_partial;
+
+        while (stream->ended == 0 && have < BYTES_IN_WORD) {
+                ssize_t got = read(fileno(stream->input), stream->buffer + have,
+                                   READ_CHUNK - have);
+                if (got > 0) {
+                        have += got;
+                } else if (got == 0 || errno != EINTR) {
+                        stream->ended = 1;
+                }
+        }
+
+        uint32_t num_words = have / BYTES_IN_WORD;
+        if (num_words > stream->capacity - seg_zero->length) {
+                uint64_t capacity = stream->capacity;
+                while (capacity < (uint64_t) seg_zero->length + num_words) {
+                        capacity *= 2;
+                }
+                if (capacity > UINT32_MAX) {
+                        capacity = UINT32_MAX;
+                }
+                uint32_t *words = allocator_get(mem->alloc, capacity);
+                memcpy(words, seg_zero->words,
+                       seg_zero->length * sizeof(uint32_t));
+                put_words(mem, seg_zero->words, stream->capacity);
+                seg_zero->words = words;
+                stream->capacity = capacity;
+        }
+
+        swap_words(seg_zero->words + seg_zero->length, stream->buffer,
+                   num_words);
+        seg_zero->length += num_words;
+        mem->counters->program_words = seg_zero->length;
+        stream->num_partial = have - num_words * BYTES_IN_WORD;
+        memmove(stream->buffer, stream->buffer + num_words * BYTES_IN_WORD,
+                stream->num_partial);
+        return num_words;
+}
+
+/* a superinstruction is only chosen when all of its words are decoded, so
+ * the handlers just before the new words are redone too
+ */
+void decode_arrived(UM_memory mem)
+{
+        struct stream *stream = mem->stream;
+        uint32_t length = mem->segments[0].length;
+        uint32_t first = stream->decoded < SUPER_MAX_LENGTH - 1
+                         ? 0 : stream->decoded - (SUPER_MAX_LENGTH - 1);
+
+        mem->decoded = realloc(mem->decoded,
+                               length * sizeof(struct decoded));
+        decode_words(mem->segments[0].words + stream->decoded,
+                     mem->decoded + stream->decoded,
+                     length - stream->decoded);
+        peephole_program(mem->decoded + first, length - first);
+        stream->decoded = length;
+}
+
+void await_word(UM_memory mem, uint32_t offset)
+{
+        while (offset >= mem->segments[0].length) {
+                if (read_words(mem) == 0) {
+                        return;
+                }
+        }
+}
+
+/* the words were allocated for the capacity, so that is what is given back
+ * -- release_words gives back the length
+ */
+void end_stream(UM_memory mem)
+{
+        struct stream *stream = mem->stream;
+        struct segment *seg_zero = &mem->segments[0];
+
+        if (stream->capacity != seg_zero->length) {
+                uint32_t *words = allocator_get(mem->alloc, seg_zero->length);
+                if (seg_zero->length > 0) {
+                        memcpy(words, seg_zero->words,
+                               seg_zero->length * sizeof(uint32_t));
+                }
+                put_words(mem, seg_zero->words, stream->capacity);
+                seg_zero->words = words;
         }
+        fclose(stream->input);
+        free(stream->buffer);
+        free(stream);
+        mem->stream = NULL;
 }
@@ -17,9 +17,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include "decode.h"
+#include "segalloc.h"
 
 typedef struct UM_memory *UM_memory;
 
+/* what map_segment returns instead of an index when it refuses a segment */
+#define SEGMENT_REFUSED UINT32_MAX
+
+/* the counters of a running program, defined in stats.h */
+struct live_counters;
+
+/* a loaded program that memories can share read-only */
+typedef struct UM_program *UM_program;
+
+/* one entry of the segment table, as seen when saving or restoring the
+ * memory -- an unmapped entry has NULL words and length 0, and next_unmapped
+ * links it to the entry unmapped before it
+ */
+struct segment_info {
+        uint32_t *words;
+        uint32_t length;
+        uint32_t next_unmapped;
+};
+
 /* creates and initializes a new UM_memory struct (all memory associated with
  * the universal machine then returns the struct
  */
@@ -34,8 +55,61 @@ void free_memory(UM_memory mem);
  */
 void load_instructions(UM_memory mem, FILE *input);
 
+/* reads and decodes a program from the given FILE * as load_instructions
+ * would, but into a UM_program that any number of memories, in any number
+ * of threads, can be created from
+ */
+UM_program program_load(FILE *input);
+
+/* loads the program from the given FILE * as load_instructions does, except
+ * that anything but a regular file (a pipe, say) is read as it arrives: the
+ * 0-segment starts out empty, and more_instructions, loads and stores wait
+ * for the words they need -- the memory takes the FILE * and closes it
+ * once the program has all arrived, or has been replaced
+ */
+void stream_instructions(UM_memory mem, FILE *input);
+
+/* called once the program counter reaches the end of the decoded 0-segment:
+ * waits for more of a program that is still arriving, and returns 1 once
+ * there is more to run (decoded_program must then be asked again, since the
+ * decoding will have moved) or 0 if the program has ended
+ */
+int more_instructions(UM_memory mem);
+
+/* does the same for a .um image already in memory, num_bytes long -- the
+ * bytes are not needed afterwards
+ */
+UM_program program_from_bytes(const unsigned char *bytes, size_t num_bytes);
+
+/* frees the program -- every memory created from it must be freed first */
+void program_free(UM_program program);
+
+/* returns the words of the program in host order and stores their number in
+ * *length -- they never change, and are valid until the program is freed
+ */
+const uint32_t *program_words(UM_program program, uint32_t *length);
+
+/* creates a memory whose 0-segment is the given program, as though it had
+ * been loaded with load_instructions -- the words are not copied until the
+ * program stores into its 0-segment, and the program itself is never
+ * changed
+ */
+UM_memory memory_from_program(UM_program program);
+
+/* creates a memory whose 0-segment is the length words at words, already
+ * predecoded at decoded, as though they had been loaded with
+ * load_instructions -- both must lie in image, a writable private mapping
+ * of image_size bytes that the memory takes over and unmaps when it is
+ * freed, and they are used in place
+ */
+UM_memory memory_from_image(uint32_t *words, struct decoded *decoded,
+                            uint32_t length, void *image, size_t image_size);
+
 /* maps a new segment in memory of the given number of words
- * returns the segment index in memory of the newly mapped segment
+ * returns the segment index in memory of the newly mapped segment, or
+ * SEGMENT_REFUSED if that would take the words of the segments the program
+ * has mapped over the memory's limit, or if the host has no memory for its
+ * words
  */
 uint32_t map_segment(UM_memory mem, uint32_t num_words);
 
@@ -44,6 +118,33 @@ uint32_t map_segment(UM_memory mem, uint32_t num_words);
  */
 void unmap_segment(UM_memory mem, uint32_t segment_index);
 
+/* limits the total number of words in the segments mapped by map_segment
+ * and not yet unmapped to max_words -- there is no limit until this is
+ * called, and segments already mapped are never taken away
+ */
+void memory_limit(UM_memory mem, uint64_t max_words);
+
+/* returns the counters the memory keeps for anyone watching the program
+ * (see stats.h) -- the engines keep the program's progress in them
+ */
+struct live_counters *memory_counters(UM_memory mem);
+
+/* moves the memory's counters into the given storage, which must outlive
+ * the memory, carrying over their values so far
+ */
+void memory_count(UM_memory mem, struct live_counters *counters);
+
+/* returns 1 if the given index names a mapped segment and 0 otherwise */
+int segment_mapped(UM_memory mem, uint32_t segment_index);
+
+/* returns the number of words in the segment at the given index */
+uint32_t segment_length(UM_memory mem, uint32_t segment_index);
+
+/* returns 1 if the given index names a mapped segment with a word at the
+ * given offset, and 0 otherwise
+ */
+int segment_contains(UM_memory mem, uint32_t segment_index, uint32_t offset);
+
 /* loads a value from memory at the given segment index and at the given offset
  * within that segment -- the value at that location is returned to the user
  */
@@ -58,6 +159,8 @@ void segments_store(UM_memory mem, uint32_t segment_index, uint32_t offset,
 /* replaces the memory instruction stream with the words following the given
  * offset in the given segment -- so get_instruction will now begin returning
  * the words following that offset in that segment
+ * the words are not copied: the two segments share them until one of them
+ * is stored to
  */
 void segments_load_program(UM_memory mem, uint32_t segment_index,
                            uint32_t new_offset);
@@ -69,8 +172,66 @@ void segments_load_program(UM_memory mem, uint32_t segment_index,
 uint32_t get_instruction(UM_memory mem);
 
 /* returns 1 if there are no more instructions to be read in memory,
- * returns 0 otherwise
+ * returns 0 otherwise -- waiting, at the end of a program that is still
+ * arriving, to see which
  */
 uint32_t done_with_instructions(UM_memory mem);
 
+/* returns a pointer to the words of the 0-segment and stores its length in
+ * *length -- the pointer is only valid until the next call to
+ * segments_load_program that names a segment other than 0, the next
+ * segments_store into the 0-segment, or, while it is still arriving, the next
+ * segments_load from it
+ */
+uint32_t *program_segment(UM_memory mem, uint32_t *length);
+
+/* returns the predecoded form of the 0-segment, one entry per word, and
+ * stores its length in *length -- it is rebuilt by load_instructions and
+ * segments_load_program, and a segments_store into the 0-segment re-decodes
+ * just the word it changes (along with the superinstructions around it);
+ * the pointer is valid until the next segments_load_program that names a
+ * segment other than 0, or the next more_instructions that returns 1
+ * while the program is arriving, only the words more_instructions has
+ * decoded are counted in *length
+ */
+const struct decoded *decoded_program(UM_memory mem, uint32_t *length);
+
+/* returns 1 if the segment at the given index holds exactly the words of
+ * the 0-segment, so that loading it as the program would change nothing,
+ * and 0 otherwise
+ */
+int segment_is_program(UM_memory mem, uint32_t segment_index);
+
+
+/* copies the hit, miss and retained-byte counters of the allocator that
+ * supplies the words of the given memory's segments into *stats
+ */
+void memory_alloc_stats(UM_memory mem, struct allocator_stats *stats);
+
+/* returns the offset in the 0-segment of the next instruction to be read */
+uint32_t get_prog_counter(UM_memory mem);
+
+/* returns the number of entries in the segment table, mapped or not, and
+ * stores the most recently unmapped index in *unmapped
+ */
+uint32_t memory_table(UM_memory mem, uint32_t *unmapped);
+
+/* describes the entry at the given index of the segment table -- the words
+ * pointer is only valid until the memory next changes
+ */
+void segment_info(UM_memory mem, uint32_t segment_index,
+                  struct segment_info *info);
+
+/* creates a memory with the given segment table, unmapped stack and program
+ * counter, using the words where they are rather than copying them -- the
+ * words must lie in image, a writable private mapping of image_size bytes
+ * that the memory takes over and unmaps when it is freed
+ * returns NULL (leaving the image mapped) if the unmapped stack does not
+ * make sense for the table
+ */
+UM_memory memory_restore(const struct segment_info *table,
+                         uint32_t num_segments, uint32_t unmapped,
+                         uint32_t prog_counter, void *image,
+                         size_t image_size);
+
 #endif /* SEGMENTS_H_INCLUDED_ */
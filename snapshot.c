@@ -0,0 +1,392 @@
+/*
+ * snapshot.c
+ *      the implementation for checkpointing and resuming the UM
+ *      a snapshot file is a header, then one table entry per segment, then
+ *      the words of each mapped segment in table order, all in host byte
+ *      order -- the byte order mark in the header refuses snapshots from a
+ *      host of the other order, and the version refuses any other layout
+ *      since the header and entries are multiples of 4 bytes long, every
+ *      segment's words start 4-byte aligned and a restore can point the
+ *      segment table straight into the mapped file
+ *      the checkpointing engine decrements a countdown per instruction and
+ *      only checks the signal flags and the periodic save when it runs out,
+ *      at most CHECK_INTERVAL instructions apart -- and before an input
+ *      instruction that would block, whose wait the signals interrupt
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include "snapshot.h"
+#include "operations.h"
+#include "peephole.h"
+#include "stats.h"
+
+#define SNAPSHOT_MAGIC "UMSNAP\r\n"
+#define SNAPSHOT_VERSION 1
+#define BYTE_ORDER_MARK 0x01020304
+#define TEMP_SUFFIX ".tmp"
+#define CHECK_INTERVAL (1u << 20)
+
+/* the start of every snapshot file */
+struct snapshot_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint32_t registers[8];
+        uint32_t prog_counter;
+        uint32_t num_segments;
+        uint32_t unmapped;
+        uint32_t reserved;
+};
+
+/* one per segment table entry -- offset is where in the file the words
+ * start, and is 0 for a segment with no words
+ */
+struct snapshot_entry {
+        uint64_t offset;
+        uint32_t length;
+        uint32_t next_unmapped;
+};
+
+/* set by the signal handlers, cleared by checkpoint_tick */
+static volatile sig_atomic_t save_requested = 0;
+static volatile sig_atomic_t stop_requested = 0;
+
+/****** private helper function declarations ******/
+
+/* the signal handlers, which only note that the signal arrived */
+void request_save(int signum);
+void request_stop(int signum);
+
+/* writes the snapshot to the given stream, returning 0 on success */
+int write_snapshot(FILE *out, UM_memory mem, const uint32_t *registers,
+                   uint32_t prog_counter);
+
+/* saves if save is 1 or a signal asked for it, then exits if SIGTERM
+ * arrived
+ */
+void act_on_signals(struct checkpoint *checkpoint, UM_memory mem, UM_io io,
+                    const uint32_t *registers, uint32_t pc, int save);
+
+/* restarts the countdown, stopping early if a periodic save falls due */
+void start_countdown(struct checkpoint *checkpoint);
+
+/**************************************************/
+
+#define ENGINE_NAME run_checkpointed
+#define ENGINE_EXTRA_PARAMS , struct checkpoint *checkpoint
+#define ENGINE_CHECKS 0
+#define ENGINE_HANDLER(inst) (inst)->opcode
+#define ENGINE_START(registers)                                         \
+        memcpy(registers, checkpoint->registers,                        \
+               sizeof(checkpoint->registers))
+#define ENGINE_FETCH(pc, inst)                                          \
+        do {                                                            \
+                if (--checkpoint->countdown == 0) {                     \
+                        checkpoint_tick(checkpoint, mem, io, registers, \
+                                        pc);                            \
+                }                                                       \
+                if ((inst)->opcode == 11) {                             \
+                        checkpoint_input(checkpoint, mem, io,           \
+                                         registers, pc);                \
+                }                                                       \
+        } while (0)
+#define ENGINE_STORE(segment, offset)
+#define ENGINE_PROGRAM(length)
+#define ENGINE_MAP(index, size)
+#define ENGINE_UNMAP(index)
+#define ENGINE_JUMP(segment, offset)
+#define ENGINE_TARGET(pc)
+#define ENGINE_OUTPUT(value)
+#define ENGINE_INPUT(value)
+#define ENGINE_EXIT()
+#define ENGINE_STOP(status) exit(status)
+
+#include "threaded_body.h"
+
+/* SA_RESTART keeps the signals from failing reads and writes -- the wait
+ * in checkpoint_input is a pselect, which they interrupt all the same
+ */
+struct checkpoint *checkpoint_new(const char *path, uint64_t every)
+{
+        struct checkpoint *checkpoint = calloc(1, sizeof(struct checkpoint));
+        struct sigaction action;
+
+        checkpoint->path = path;
+        checkpoint->every = every;
+        checkpoint->until_save = every;
+        start_countdown(checkpoint);
+
+        memset(&action, 0, sizeof(action));
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        action.sa_handler = request_save;
+        sigaction(SIGUSR2, &action, NULL);
+        action.sa_handler = request_stop;
+        sigaction(SIGTERM, &action, NULL);
+        return checkpoint;
+}
+
+/* the path belongs to the caller */
+void checkpoint_free(struct checkpoint *checkpoint)
+{
+        free(checkpoint);
+}
+
+/* the temporary file is fsync'd before the rename, so the name only ever
+ * refers to a complete snapshot
+ */
+int snapshot_save(const char *path, UM_memory mem,
+                  const uint32_t *registers, uint32_t prog_counter)
+{
+        char *temp = malloc(strlen(path) + sizeof(TEMP_SUFFIX));
+        int failed = -1;
+
+        sprintf(temp, "%s%s", path, TEMP_SUFFIX);
+        FILE *out = fopen(temp, "wb");
+        if (out != NULL) {
+                failed = write_snapshot(out, mem, registers, prog_counter);
+                if (fflush(out) != 0 || fsync(fileno(out)) != 0) {
+                        failed = -1;
+                }
+                if (fclose(out) != 0) {
+                        failed = -1;
+                }
+                if (failed == 0 && rename(temp, path) != 0) {
+                        failed = -1;
+                }
+                if (failed != 0) {
+                        unlink(temp);
+                }
+        }
+        free(temp);
+        return failed;
+}
+
+/* every offset and length is checked against the size of the file before
+ * any word is used, so a truncated snapshot is refused rather than read past
+ */
+UM_memory snapshot_restore(const char *path, uint32_t *registers)
+{
+        struct stat info;
+        int fd = open(path, O_RDONLY);
+
+        if (fd < 0) {
+                return NULL;
+        }
+        if (fstat(fd, &info) != 0 ||
+            (size_t) info.st_size < sizeof(struct snapshot_header)) {
+                close(fd);
+                return NULL;
+        }
+        size_t size = info.st_size;
+        unsigned char *image = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (image == MAP_FAILED) {
+                return NULL;
+        }
+
+        struct snapshot_header *header = (struct snapshot_header *) image;
+        const struct snapshot_entry *entries =
+                (const struct snapshot_entry *) (header + 1);
+        uint64_t table_end = sizeof(struct snapshot_header) +
+                (uint64_t) header->num_segments *
+                sizeof(struct snapshot_entry);
+        if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic))
+            != 0 || header->version != SNAPSHOT_VERSION ||
+            header->byte_order != BYTE_ORDER_MARK || table_end > size) {
+                munmap(image, size);
+                return NULL;
+        }
+
+        uint32_t num_segments = header->num_segments;
+        struct segment_info *table =
+                malloc(num_segments * sizeof(struct segment_info));
+        UM_memory mem = NULL;
+        uint32_t i = 0;
+        for (; i < num_segments; i++) {
+                uint64_t offset = entries[i].offset;
+                uint64_t bytes = (uint64_t) entries[i].length *
+                                 sizeof(uint32_t);
+                table[i].words = NULL;
+                table[i].length = entries[i].length;
+                table[i].next_unmapped = entries[i].next_unmapped;
+                if (bytes == 0) {
+                        continue;
+                }
+                if (offset < table_end || offset % sizeof(uint32_t) != 0 ||
+                    offset + bytes > size) {
+                        break;
+                }
+                table[i].words = (uint32_t *) (image + offset);
+        }
+        if (i == num_segments) {
+                memcpy(registers, header->registers,
+                       sizeof(header->registers));
+                mem = memory_restore(table, num_segments, header->unmapped,
+                                     header->prog_counter, image, size);
+        }
+        free(table);
+        if (mem == NULL) {
+                munmap(image, size);
+        }
+        return mem;
+}
+
+void checkpoint_tick(struct checkpoint *checkpoint, UM_memory mem, UM_io io,
+                     const uint32_t *registers, uint32_t pc)
+{
+        int save = 0;
+
+        if (checkpoint->every != 0) {
+                checkpoint->until_save -= checkpoint->interval;
+                if (checkpoint->until_save == 0) {
+                        checkpoint->until_save = checkpoint->every;
+                        save = 1;
+                }
+        }
+        act_on_signals(checkpoint, mem, io, registers, pc, save);
+        start_countdown(checkpoint);
+}
+
+/* the signals stay blocked but for the pselect itself, so one that arrives
+ * after the flags were looked at still ends the wait
+ */
+void checkpoint_input(struct checkpoint *checkpoint, UM_memory mem, UM_io io,
+                      const uint32_t *registers, uint32_t pc)
+{
+        int fd = io_wait_fd(io);
+        sigset_t signals, unblocked;
+        fd_set readable;
+
+        if (fd < 0) {
+                return;
+        }
+        io_flush(io);
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGUSR2);
+        sigaddset(&signals, SIGTERM);
+        sigprocmask(SIG_BLOCK, &signals, &unblocked);
+        while (1) {
+                act_on_signals(checkpoint, mem, io, registers, pc, 0);
+                FD_ZERO(&readable);
+                FD_SET(fd, &readable);
+                if (pselect(fd + 1, &readable, NULL, NULL, NULL,
+                            &unblocked) >= 0 || errno != EINTR) {
+                        break;
+                }
+        }
+        sigprocmask(SIG_SETMASK, &unblocked, NULL);
+}
+
+/****** private helper function definitions ******/
+
+/* a failed save is reported but does not stop the program -- the previous
+ * snapshot is still there to resume from
+ */
+void act_on_signals(struct checkpoint *checkpoint, UM_memory mem, UM_io io,
+                    const uint32_t *registers, uint32_t pc, int save)
+{
+        if (save_requested != 0 || stop_requested != 0) {
+                save = 1;
+        }
+        save_requested = 0;
+        if (save == 1) {
+                io_flush(io);
+                if (snapshot_save(checkpoint->path, mem, registers, pc)
+                    != 0) {
+                        fprintf(stderr, "um: could not save snapshot to "
+                                        "%s\n", checkpoint->path);
+                }
+        }
+        if (stop_requested != 0) {
+                io_free(io);
+                free_memory(mem);
+                exit(128 + SIGTERM);
+        }
+}
+
+void request_save(int signum)
+{
+        (void) signum;
+        save_requested = 1;
+}
+
+void request_stop(int signum)
+{
+        (void) signum;
+        stop_requested = 1;
+}
+
+/* the entries are written first, with offsets worked out from the lengths,
+ * then the words in the same order
+ */
+int write_snapshot(FILE *out, UM_memory mem, const uint32_t *registers,
+                   uint32_t prog_counter)
+{
+        struct snapshot_header header;
+        struct segment_info info;
+        uint32_t unmapped;
+        uint32_t num_segments = memory_table(mem, &unmapped);
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.byte_order = BYTE_ORDER_MARK;
+        memcpy(header.registers, registers, sizeof(header.registers));
+        header.prog_counter = prog_counter;
+        header.num_segments = num_segments;
+        header.unmapped = unmapped;
+        if (fwrite(&header, sizeof(header), 1, out) != 1) {
+                return -1;
+        }
+
+        uint64_t offset = sizeof(header) +
+                (uint64_t) num_segments * sizeof(struct snapshot_entry);
+        for (uint32_t i = 0; i < num_segments; i++) {
+                struct snapshot_entry entry;
+                segment_info(mem, i, &info);
+                entry.offset = info.length > 0 ? offset : 0;
+                entry.length = info.length;
+                entry.next_unmapped = info.next_unmapped;
+                offset += (uint64_t) info.length * sizeof(uint32_t);
+                if (fwrite(&entry, sizeof(entry), 1, out) != 1) {
+                        return -1;
+                }
+        }
+        for (uint32_t i = 0; i < num_segments; i++) {
+                segment_info(mem, i, &info);
+                if (info.length > 0 &&
+                    fwrite(info.words, sizeof(uint32_t), info.length, out)
+                    != info.length) {
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+/* the countdown never runs past the next periodic save */
+void start_countdown(struct checkpoint *checkpoint)
+{
+        checkpoint->interval = CHECK_INTERVAL;
+        if (checkpoint->every != 0 &&
+            checkpoint->until_save < checkpoint->interval) {
+                checkpoint->interval = checkpoint->until_save;
+        }
+        checkpoint->countdown = checkpoint->interval;
+}
@@ -0,0 +1,83 @@
+/*
+ * snapshot.h
+ *      the interface for checkpointing the UM to a snapshot file and resuming
+ *      from one
+ *      a snapshot holds the whole machine: the registers, the program
+ *      counter, the segment table with its unmapped stack, and the words of
+ *      every mapped segment, laid out so that a restore can mmap the file
+ *      and use the words where they are
+ *      run_checkpointed is the direct-threaded engine compiled with a hook
+ *      that saves a snapshot every so many instructions, on SIGUSR2, and on
+ *      SIGTERM (after which it exits with status 128 + SIGTERM, as if the
+ *      signal had killed it)
+ *      output is flushed before each save; input that has been read ahead
+ *      but not yet consumed by the program is not part of the snapshot
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef SNAPSHOT_H_INCLUDED_
+#define SNAPSHOT_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "segments.h"
+#include "umio.h"
+
+/* the state of a checkpointed run */
+struct checkpoint {
+        const char *path;               /* where snapshots are saved */
+        uint64_t every;                 /* instructions between saves, or 0 */
+        uint64_t until_save;            /* instructions until the next save */
+        uint32_t countdown;             /* instructions until the next check */
+        uint32_t interval;              /* what countdown last started at */
+        uint32_t registers[8];          /* the registers to start from */
+};
+
+/* creates a checkpoint that saves to path every given number of
+ * instructions (never, for 0) and on the signals above, starting from zeroed
+ * registers -- installs the signal handlers
+ */
+struct checkpoint *checkpoint_new(const char *path, uint64_t every);
+
+/* frees the checkpoint */
+void checkpoint_free(struct checkpoint *checkpoint);
+
+/* writes a snapshot of the memory, the registers and the given program
+ * counter to path -- the file is written under a temporary name and renamed
+ * into place, so a crash mid-save leaves the previous snapshot intact
+ * returns 0 on success and -1 on failure
+ */
+int snapshot_save(const char *path, UM_memory mem,
+                  const uint32_t *registers, uint32_t prog_counter);
+
+/* maps the snapshot at path and builds a memory around it, storing the
+ * saved registers in registers[0..7] -- returns NULL if the file cannot be
+ * opened or is not a snapshot this build can read
+ */
+UM_memory snapshot_restore(const char *path, uint32_t *registers);
+
+/* called by the checkpointing engine whenever countdown reaches 0, before
+ * the instruction at pc runs -- saves if a save is due, and exits if
+ * SIGTERM arrived
+ */
+void checkpoint_tick(struct checkpoint *checkpoint, UM_memory mem, UM_io io,
+                     const uint32_t *registers, uint32_t pc);
+
+/* called by the checkpointing engine before the input instruction at pc --
+ * if it would have to wait for input, waits here instead, saving and
+ * exiting as checkpoint_tick does whenever SIGUSR2 or SIGTERM arrives
+ */
+void checkpoint_input(struct checkpoint *checkpoint, UM_memory mem, UM_io io,
+                      const uint32_t *registers, uint32_t pc);
+
+/* Executes the instructions in the given UM_memory exactly as run_threaded
+ * does, starting from the checkpoint's registers and taking snapshots as it
+ * goes
+ */
+void run_checkpointed(UM_memory mem, UM_io io,
+                      struct checkpoint *checkpoint);
+
+#endif /* SNAPSHOT_H_INCLUDED_ */
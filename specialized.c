@@ -0,0 +1,246 @@
+/*
+ * specialized.c
+ *      the implementation for the specialized execution engine
+ *      a direct-threaded engine with a separate handler for each opcode and
+ *      register triple, so no handler reads an operand field or indexes the
+ *      registers: the eight UM registers are eight locals, named outright
+ *      in every handler, and the compiler is free to keep them in machine
+ *      registers
+ *      each decoded word carries the number of its handler (special in
+ *      decode.h), kept up to date through stores by segments.c like the rest
+ *      of the decoding
+ *      the handlers and the dispatch table are generated by the macros
+ *      below; the table has all 512 register triples of all 16 opcodes, but
+ *      a handler is only made for the registers its opcode uses -- every
+ *      triple of load_value shares the handler for its a, map and
+ *      load_program have one per b and c, unmap, output and input one per
+ *      c, and halt and the invalid opcodes just one
+ *      superinstructions are not used here: they exist to save dispatches
+ *      and operand reads, and the point of this engine is to measure what
+ *      specializing alone buys
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "specialized.h"
+#include "decode.h"
+#include "stats.h"
+
+#define NUM_SPECIAL (16 * 512)
+
+/* expands m once per value of the registers it is given, passing it the
+ * opcode's label prefix and a, b and c
+ */
+#define EACH_C(m, op, a, b)                                             \
+        m(op, a, b, 0) m(op, a, b, 1) m(op, a, b, 2) m(op, a, b, 3)     \
+        m(op, a, b, 4) m(op, a, b, 5) m(op, a, b, 6) m(op, a, b, 7)
+#define EACH_BC(m, op, a)                                               \
+        EACH_C(m, op, a, 0) EACH_C(m, op, a, 1) EACH_C(m, op, a, 2)     \
+        EACH_C(m, op, a, 3) EACH_C(m, op, a, 4) EACH_C(m, op, a, 5)     \
+        EACH_C(m, op, a, 6) EACH_C(m, op, a, 7)
+#define EACH_ABC(m, op)                                                 \
+        EACH_BC(m, op, 0) EACH_BC(m, op, 1) EACH_BC(m, op, 2)           \
+        EACH_BC(m, op, 3) EACH_BC(m, op, 4) EACH_BC(m, op, 5)           \
+        EACH_BC(m, op, 6) EACH_BC(m, op, 7)
+
+/* a dispatch table entry, for a handler named by all three registers, by b
+ * and c, by c alone, by a alone, or by none of them
+ */
+#define ADDRESS_ABC(op, a, b, c) &&op##_##a##_##b##_##c,
+#define ADDRESS_BC(op, a, b, c) &&op##_##b##_##c,
+#define ADDRESS_C(op, a, b, c) &&op##_##c,
+#define ADDRESS_A(op, a, b, c) &&op##_##a,
+#define ADDRESS_NONE(op, a, b, c) &&op,
+
+/* the handlers -- those named by fewer registers are expanded with EACH_C
+ * over the one that names them, or EACH_BC over the two
+ */
+#define MOVE(op, a, b, c)                                               \
+        op##_##a##_##b##_##c:                                           \
+                if (r##c != 0) {                                        \
+                        r##a = r##b;                                    \
+                }                                                       \
+                DISPATCH();
+#define LOAD(op, a, b, c)                                               \
+        op##_##a##_##b##_##c:                                           \
+                r##a = segments_load(mem, r##b, r##c);                  \
+                DISPATCH();
+#define STORE(op, a, b, c)                                              \
+        op##_##a##_##b##_##c:                                           \
+                segments_store(mem, r##a, r##b, r##c);                  \
+                DISPATCH();
+#define ADD(op, a, b, c)                                                \
+        op##_##a##_##b##_##c:                                           \
+                r##a = r##b + r##c;                                     \
+                DISPATCH();
+#define MULTIPLY(op, a, b, c)                                           \
+        op##_##a##_##b##_##c:                                           \
+                r##a = r##b * r##c;                                     \
+                DISPATCH();
+#define DIVIDE(op, a, b, c)                                             \
+        op##_##a##_##b##_##c:                                           \
+                r##a = r##b / r##c;                                     \
+                DISPATCH();
+#define NAND(op, a, b, c)                                               \
+        op##_##a##_##b##_##c:                                           \
+                r##a = ~(r##b & r##c);                                  \
+                DISPATCH();
+#define MAP(op, a, b, c)                                                \
+        op##_##b##_##c:                                                 \
+                index = map_segment(mem, r##c);                         \
+                if (index == SEGMENT_REFUSED) {                         \
+                        goto refused;                                   \
+                }                                                       \
+                r##b = index;                                           \
+                DISPATCH();
+#define UNMAP(op, a, b, c)                                              \
+        op##_##c:                                                       \
+                unmap_segment(mem, r##c);                               \
+                DISPATCH();
+#define OUTPUT(op, a, b, c)                                             \
+        op##_##c:                                                       \
+                if (r##c < 256) {                                       \
+                        io_put(io, r##c);                               \
+                }                                                       \
+                DISPATCH();
+#define INPUT(op, a, b, c)                                              \
+        op##_##c:                                                       \
+                value = io_get(io);                                     \
+                if (value == (uint32_t) EOF) {                          \
+                        r##c = ~0;                                      \
+                } else if (value < 256) {                               \
+                        r##c = value;                                   \
+                }                                                       \
+                DISPATCH();
+#define LOAD_PROGRAM(op, a, b, c)                                       \
+        op##_##b##_##c:                                                 \
+                io_tick(io);                                            \
+                live->instructions += pc - start;                       \
+                live->load_programs++;                                  \
+                if (r##b != 0) {                                        \
+                        segments_load_program(mem, r##b, r##c);         \
+                        code = decoded_program(mem, &length);           \
+                }                                                       \
+                pc = r##c;                                              \
+                start = pc;                                             \
+                live->pc = pc;                                          \
+                DISPATCH();
+#define LOAD_VALUE(op, a, b, c)                                         \
+        op##_##c:                                                       \
+                r##c = inst->value;                                     \
+                DISPATCH();
+
+/* fetches the next decoded instruction and jumps to the handler made for
+ * its opcode and registers -- running off the end of the 0-segment ends the
+ * program just like done_with_instructions does for unpack_instructions,
+ * unless more of it is still arriving
+ */
+#define DISPATCH()                                                      \
+        do {                                                            \
+                if (pc >= length) {                                     \
+                        goto end_of_code;                               \
+                }                                                       \
+                inst = &code[pc++];                                     \
+                goto *dispatch[inst->special];                          \
+        } while (0)
+
+/* brings the watched instruction count and program counter up to date --
+ * every word from start up to pc has run since they last were
+ */
+#define PUBLISH()                                                       \
+        do {                                                            \
+                live->instructions += pc - start;                       \
+                live->pc = pc;                                          \
+                start = pc;                                             \
+        } while (0)
+
+/* computed goto is not ISO C, so -pedantic is silenced for this function
+ * -- and it is compiled at -O1, since -O2's value numbering and redundancy
+ * elimination take minutes over thousands of handlers and buy nothing the
+ * handlers need
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC push_options
+#pragma GCC optimize ("O1")
+
+/* runs the fetch/dispatch loop -- every handler finishes with DISPATCH() */
+void run_specialized(UM_memory mem, UM_io io)
+{
+        static void *const dispatch[NUM_SPECIAL] = {
+                EACH_ABC(ADDRESS_ABC, op_move)
+                EACH_ABC(ADDRESS_ABC, op_load)
+                EACH_ABC(ADDRESS_ABC, op_store)
+                EACH_ABC(ADDRESS_ABC, op_add)
+                EACH_ABC(ADDRESS_ABC, op_multiply)
+                EACH_ABC(ADDRESS_ABC, op_divide)
+                EACH_ABC(ADDRESS_ABC, op_nand)
+                EACH_ABC(ADDRESS_NONE, op_halt)
+                EACH_ABC(ADDRESS_BC, op_map)
+                EACH_ABC(ADDRESS_C, op_unmap)
+                EACH_ABC(ADDRESS_C, op_output)
+                EACH_ABC(ADDRESS_C, op_input)
+                EACH_ABC(ADDRESS_BC, op_load_program)
+                EACH_ABC(ADDRESS_A, op_load_value)
+                EACH_ABC(ADDRESS_NONE, op_invalid)
+                EACH_ABC(ADDRESS_NONE, op_invalid)
+        };
+        uint32_t r0 = 0, r1 = 0, r2 = 0, r3 = 0;
+        uint32_t r4 = 0, r5 = 0, r6 = 0, r7 = 0;
+        uint32_t length;
+        const struct decoded *code = decoded_program(mem, &length);
+        uint32_t pc = get_prog_counter(mem);
+        const struct decoded *inst;
+        uint32_t index, value;
+        struct live_counters *live = memory_counters(mem);
+        uint32_t start = pc;
+
+        DISPATCH();
+
+        EACH_ABC(MOVE, op_move)
+        EACH_ABC(LOAD, op_load)
+        EACH_ABC(STORE, op_store)
+        EACH_ABC(ADD, op_add)
+        EACH_ABC(MULTIPLY, op_multiply)
+        EACH_ABC(DIVIDE, op_divide)
+        EACH_ABC(NAND, op_nand)
+        EACH_BC(MAP, op_map, 0)
+        EACH_C(UNMAP, op_unmap, 0, 0)
+        EACH_C(OUTPUT, op_output, 0, 0)
+        EACH_C(INPUT, op_input, 0, 0)
+        EACH_BC(LOAD_PROGRAM, op_load_program, 0)
+        EACH_C(LOAD_VALUE, op_load_value, 0, 0)
+
+op_halt:
+        PUBLISH();
+        io_free(io);
+        free_memory(mem);
+        exit(0);
+op_invalid:
+        /* op code must be 14 or 15 which is invalid so we must free memory
+           and quit the program */
+        PUBLISH();
+        io_free(io);
+        free_memory(mem);
+        exit(1);
+refused:
+        fprintf(stderr, "Segment limit exceeded\n");
+        goto op_invalid;
+end_of_code:
+        PUBLISH();
+        /* the output so far is written before waiting for more program */
+        io_flush(io);
+        if (more_instructions(mem) == 1) {
+                code = decoded_program(mem, &length);
+                DISPATCH();
+        }
+        io_free(io);
+        free_memory(mem);
+}
+
+#pragma GCC pop_options
+#pragma GCC diagnostic pop
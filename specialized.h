@@ -0,0 +1,28 @@
+/*
+ * specialized.h
+ *      the interface for the specialized execution engine of the UM
+ *      runs the program in the UM_memory with a handler for every opcode and
+ *      register triple, each with its operands built in, as an alternative
+ *      to the generic handlers of run_threaded in threaded.h
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef SPECIALIZED_H_INCLUDED_
+#define SPECIALIZED_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "segments.h"
+#include "umio.h"
+
+/* Executes the instructions in the given UM_memory, starting at its program
+ * counter, until the program halts or runs off the end of the 0-segment --
+ * behaves exactly like unpack_instructions, including freeing the memory
+ * and the UM_io
+ */
+void run_specialized(UM_memory mem, UM_io io);
+
+#endif /* SPECIALIZED_H_INCLUDED_ */
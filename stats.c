@@ -0,0 +1,216 @@
+/*
+ * stats.c
+ *      the implementation for watching a running UM
+ *      the watched counters live in static storage, so neither the signal
+ *      handler nor the listener thread can outlive what they read
+ *      the report is formatted by hand rather than with stdio, since the
+ *      signal handler may only use async-signal-safe calls
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "stats.h"
+
+#define REPORT_SIZE 512
+
+static struct live_counters watched;
+
+/* the socket's path, for removing it at exit */
+static char socket_path[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+
+/****** private helper function declarations ******/
+
+/* the SIGUSR1 handler, which writes the report to stderr */
+void report_counters(int signum);
+
+/* writes the report of the watched counters into buffer, which has room for
+ * REPORT_SIZE bytes, and returns its length
+ */
+size_t format_report(char *buffer);
+
+/* appends a "name value" line at p and returns the end of it */
+char *put_line(char *p, const char *name, uint64_t value);
+
+/* accepts connections to the listening socket forever, writing the report
+ * to each and closing it
+ */
+void *serve(void *listener);
+
+/* removes the socket at exit */
+void remove_socket(void);
+
+/**************************************************/
+
+/* SA_RESTART keeps the signal from failing the program's reads and writes */
+void stats_watch(UM_memory mem, UM_io io)
+{
+        struct sigaction action;
+
+        memory_count(mem, &watched);
+        io_count(io, &watched.output_bytes);
+
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = report_counters;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR1, &action, NULL);
+}
+
+/* a stale socket left by an earlier run is replaced -- the thread is
+ * started with every signal blocked, so that signals are still handled by
+ * the thread running the program
+ */
+int stats_listen(const char *path)
+{
+        struct sockaddr_un address;
+        pthread_t thread;
+        sigset_t all, old;
+
+        if (strlen(path) >= sizeof(address.sun_path)) {
+                return 0;
+        }
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, path);
+
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0) {
+                return 0;
+        }
+        unlink(path);
+        if (bind(listener, (struct sockaddr *) &address,
+                 sizeof(address)) != 0 || listen(listener, 8) != 0) {
+                close(listener);
+                return 0;
+        }
+        strcpy(socket_path, path);
+        atexit(remove_socket);
+
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        int made = pthread_create(&thread, NULL, serve,
+                                  (void *) (intptr_t) listener);
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        if (made != 0) {
+                close(listener);
+                return 0;
+        }
+        pthread_detach(thread);
+        return 1;
+}
+
+/****** private helper function definitions ******/
+
+/* errno is kept, since the handler may interrupt a call that sets it */
+void report_counters(int signum)
+{
+        char buffer[REPORT_SIZE];
+        int saved = errno;
+        size_t length = format_report(buffer);
+        ssize_t wrote = write(STDERR_FILENO, buffer, length);
+
+        (void) signum;
+        (void) wrote;
+        errno = saved;
+}
+
+/* each counter is loaded atomically, since the listener reads them while
+ * the program is writing them
+ */
+size_t format_report(char *buffer)
+{
+        char *p = buffer;
+
+        strcpy(p, "=== UM stats ===\n");
+        p += strlen(p);
+        p = put_line(p, "instructions",
+                     __atomic_load_n(&watched.instructions, __ATOMIC_RELAXED));
+        p = put_line(p, "pc", __atomic_load_n(&watched.pc, __ATOMIC_RELAXED));
+        p = put_line(p, "program_words",
+                     __atomic_load_n(&watched.program_words,
+                                     __ATOMIC_RELAXED));
+        p = put_line(p, "live_segments",
+                     __atomic_load_n(&watched.live_segments,
+                                     __ATOMIC_RELAXED));
+        p = put_line(p, "unmapped_segments",
+                     __atomic_load_n(&watched.unmapped_segments,
+                                     __ATOMIC_RELAXED));
+        p = put_line(p, "mapped_words",
+                     __atomic_load_n(&watched.mapped_words,
+                                     __ATOMIC_RELAXED));
+        p = put_line(p, "output_bytes",
+                     __atomic_load_n(&watched.output_bytes,
+                                     __ATOMIC_RELAXED));
+        p = put_line(p, "load_programs",
+                     __atomic_load_n(&watched.load_programs,
+                                     __ATOMIC_RELAXED));
+        return p - buffer;
+}
+
+/* the digits are made backwards and then copied in order */
+char *put_line(char *p, const char *name, uint64_t value)
+{
+        char digits[20];
+        int n = 0;
+
+        while (*name != '\0') {
+                *p++ = *name++;
+        }
+        *p++ = ' ';
+        do {
+                digits[n++] = '0' + value % 10;
+                value /= 10;
+        } while (value != 0);
+        while (n > 0) {
+                *p++ = digits[--n];
+        }
+        *p++ = '\n';
+        return p;
+}
+
+/* MSG_NOSIGNAL keeps a reader that has already gone from raising SIGPIPE */
+void *serve(void *listener)
+{
+        int fd = (int) (intptr_t) listener;
+        char buffer[REPORT_SIZE];
+
+        for (;;) {
+                int client = accept(fd, NULL, NULL);
+                if (client < 0) {
+                        continue;
+                }
+                size_t length = format_report(buffer);
+                size_t sent = 0;
+                while (sent < length) {
+                        ssize_t n = send(client, buffer + sent,
+                                         length - sent, MSG_NOSIGNAL);
+                        if (n < 0 && errno == EINTR) {
+                                continue;
+                        }
+                        if (n <= 0) {
+                                break;
+                        }
+                        sent += n;
+                }
+                close(client);
+        }
+        return NULL;
+}
+
+void remove_socket(void)
+{
+        unlink(socket_path);
+}
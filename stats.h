@@ -0,0 +1,55 @@
+/*
+ * stats.h
+ *      the interface for watching a running UM from outside
+ *      the memory, the UM_io and the engines keep a few counters up to date
+ *      as the program runs; once they are watched, SIGUSR1 writes them to
+ *      stderr, and a Unix socket can serve the same report to anything that
+ *      connects to it, without stopping the program
+ *      the report is one "name value" line per counter, after a heading
+ *      umstats prints the report served at a socket
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef STATS_H_INCLUDED_
+#define STATS_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "segments.h"
+#include "umio.h"
+
+/* the counters of one running program -- only the thread running it writes
+ * them, so a reader in another thread sees each one whole but may see them
+ * from slightly different moments
+ * instructions and pc are brought up to date by each load_program and when
+ * the program ends, so between those they lag by the straight-line run in
+ * progress; that keeps their cost off every other instruction
+ * the segment counts include the 0-segment
+ */
+struct live_counters {
+        uint64_t instructions;          /* instructions run */
+        uint64_t load_programs;         /* load_programs run */
+        uint64_t output_bytes;          /* bytes written by output */
+        uint64_t mapped_words;          /* words in mapped segments but 0 */
+        uint32_t pc;                    /* where the program counter was */
+        uint32_t program_words;         /* length of the 0-segment */
+        uint32_t live_segments;         /* mapped segments */
+        uint32_t unmapped_segments;     /* indices waiting to be reused */
+};
+
+/* moves the counters of the given memory and UM_io into storage that
+ * outlives them and has SIGUSR1 report them on stderr from then on
+ */
+void stats_watch(UM_memory mem, UM_io io);
+
+/* serves the report of the watched counters, from a thread of its own, to
+ * every connection to a Unix socket made at path -- the socket is removed
+ * when the process exits
+ * returns 0 if the socket cannot be made
+ */
+int stats_listen(const char *path);
+
+#endif /* STATS_H_INCLUDED_ */
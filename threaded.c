@@ -0,0 +1,44 @@
+/*
+ * threaded.c
+ *      the implementation for the direct-threaded execution engine
+ *      each instruction ends by jumping straight to the handler of the next
+ *      one through a table of label addresses (a gcc extension), so there is
+ *      no central switch and no function call per instruction
+ *      instructions are fetched from the predecoded 0-segment kept by
+ *      segments.c, so no fields are extracted at run time
+ *      the registers, the program counter and a pointer to the decoded
+ *      0-segment are all kept in locals; the pointer is refreshed whenever
+ *      load_program may have replaced it
+ *      the engine itself lives in threaded_body.h, instantiated here with
+ *      every hook empty and dispatching on superinstructions
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "threaded.h"
+#include "operations.h"
+#include "peephole.h"
+#include "stats.h"
+
+#define ENGINE_NAME run_threaded
+#define ENGINE_EXTRA_PARAMS
+#define ENGINE_CHECKS 0
+#define ENGINE_HANDLER(inst) (inst)->handler
+#define ENGINE_START(registers)
+#define ENGINE_FETCH(pc, inst)
+#define ENGINE_STORE(segment, offset)
+#define ENGINE_PROGRAM(length)
+#define ENGINE_MAP(index, size)
+#define ENGINE_UNMAP(index)
+#define ENGINE_JUMP(segment, offset)
+#define ENGINE_TARGET(pc)
+#define ENGINE_OUTPUT(value)
+#define ENGINE_INPUT(value)
+#define ENGINE_EXIT()
+#define ENGINE_STOP(status) exit(status)
+
+#include "threaded_body.h"
@@ -0,0 +1,27 @@
+/*
+ * threaded.h
+ *      the interface for the direct-threaded execution engine of the UM
+ *      runs the program in the UM_memory with computed-goto dispatch,
+ *      as a faster alternative to unpack_instructions in unpack.h
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef THREADED_H_INCLUDED_
+#define THREADED_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "segments.h"
+#include "umio.h"
+
+/* Executes the instructions in the given UM_memory, starting at its program
+ * counter, until the program halts or runs off the end of the 0-segment --
+ * behaves exactly like unpack_instructions, including freeing the memory
+ * and the UM_io
+ */
+void run_threaded(UM_memory mem, UM_io io);
+
+#endif /* THREADED_H_INCLUDED_ */
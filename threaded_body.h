@@ -0,0 +1,302 @@
+/*
+ * threaded_body.h
+ *      the body of the direct-threaded engine, written once and compiled
+ *      into more than one engine
+ *      each instantiation defines, before including this file:
+ *              ENGINE_NAME             the name of the function to define
+ *              ENGINE_EXTRA_PARAMS     parameters after mem and io, each
+ *                                      preceded by a comma (may be empty)
+ *              ENGINE_CHECKS           1 to stop the program as an invalid
+ *                                      opcode does, instead of crashing,
+ *                                      before a load or store outside a
+ *                                      mapped segment, a division by zero,
+ *                                      an unmap of segment 0 or of one not
+ *                                      mapped, or a load_program from one
+ *                                      not mapped; 0 not to check
+ *              ENGINE_HANDLER(inst)    the field dispatched on: (inst)->handler
+ *                                      to run superinstructions (see
+ *                                      peephole.h), (inst)->opcode to run
+ *                                      exactly one instruction per dispatch
+ *              ENGINE_START(registers) run once before the first instruction
+ *              ENGINE_FETCH(pc, inst)  run after each instruction is fetched
+ *              ENGINE_STORE(segment, offset)
+ *                                      run after each store
+ *              ENGINE_PROGRAM(length)  run at the start and whenever
+ *                                      load_program installs a new program,
+ *                                      or more of a streamed one arrives
+ *              ENGINE_MAP(index, size) run after a segment is mapped
+ *              ENGINE_UNMAP(index)     run before a segment is unmapped
+ *              ENGINE_JUMP(segment, offset)
+ *                                      run before each load_program
+ *              ENGINE_TARGET(pc)       run after each load_program, with pc
+ *                                      at the word it goes to -- it may run
+ *                                      instructions itself, moving pc on to
+ *                                      the next one to dispatch
+ *              ENGINE_OUTPUT(value)    run after each output instruction
+ *              ENGINE_INPUT(value)     run after each input instruction,
+ *                                      with the value it left
+ *              ENGINE_EXIT()           run before the program ends for any
+ *                                      reason
+ *              ENGINE_STOP(status)     run once the memory and the UM_io
+ *                                      are freed after a halt (status 0), or
+ *                                      an invalid opcode or a refused map
+ *                                      (status 1) -- the engine returns if
+ *                                      it does
+ *      hooks that expand to nothing cost nothing, so run_threaded is
+ *      exactly the engine it would be without them
+ *      this file has no include guard, on purpose
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+/* fetches the next decoded instruction and jumps to the handler for its
+ * opcode -- running off the end of the 0-segment ends the program just like
+ * done_with_instructions does for unpack_instructions, unless more of it is
+ * still arriving
+ */
+#define DISPATCH()                                                      \
+        do {                                                            \
+                if (pc >= length) {                                     \
+                        goto end_of_code;                               \
+                }                                                       \
+                inst = &code[pc];                                       \
+                ENGINE_FETCH(pc, inst);                                 \
+                pc++;                                                   \
+                a = inst->a;                                            \
+                b = inst->b;                                            \
+                c = inst->c;                                            \
+                goto *dispatch[ENGINE_HANDLER(inst)];                   \
+        } while (0)
+
+/* brings the watched instruction count and program counter up to date --
+ * every word from start up to pc has run since they last were
+ */
+#define PUBLISH()                                                       \
+        do {                                                            \
+                live->instructions += pc - start;                       \
+                live->pc = pc;                                          \
+                start = pc;                                             \
+        } while (0)
+
+/* computed goto is not ISO C, so -pedantic is silenced for this function */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+/* runs the fetch/dispatch loop -- every handler finishes with DISPATCH() */
+void ENGINE_NAME(UM_memory mem, UM_io io ENGINE_EXTRA_PARAMS)
+{
+        static void *const dispatch[NUM_HANDLERS] = {
+                &&op_move, &&op_load, &&op_store, &&op_add,
+                &&op_multiply, &&op_divide, &&op_nand, &&op_halt,
+                &&op_map, &&op_unmap, &&op_output, &&op_input,
+                &&op_load_program, &&op_load_value, &&op_invalid, &&op_invalid,
+                &&super_lv2, &&super_const, &&super_jump, &&super_branch,
+                &&super_and, &&super_or, &&super_lv_add, &&super_lv_mul,
+                &&super_lv_nand, &&super_lv_load
+        };
+        uint32_t registers[8] = {0,0,0,0,0,0,0,0};
+        uint32_t length;
+        const struct decoded *code = decoded_program(mem, &length);
+        uint32_t pc = get_prog_counter(mem);
+        const struct decoded *inst;
+        uint32_t a, b, c;
+        struct live_counters *live = memory_counters(mem);
+        uint32_t start = pc;
+
+        ENGINE_START(registers);
+        ENGINE_PROGRAM(length);
+        DISPATCH();
+
+op_move:
+        if (registers[c] != 0) {
+                registers[a] = registers[b];
+        }
+        DISPATCH();
+op_load:
+        if (ENGINE_CHECKS && !segment_contains(mem, registers[b],
+                                               registers[c])) {
+                goto op_invalid;
+        }
+        registers[a] = segments_load(mem, registers[b], registers[c]);
+        DISPATCH();
+op_store:
+        if (ENGINE_CHECKS && !segment_contains(mem, registers[a],
+                                               registers[b])) {
+                goto op_invalid;
+        }
+        segments_store(mem, registers[a], registers[b], registers[c]);
+        ENGINE_STORE(registers[a], registers[b]);
+        DISPATCH();
+op_add:
+        registers[a] = registers[b] + registers[c];
+        DISPATCH();
+op_multiply:
+        registers[a] = registers[b] * registers[c];
+        DISPATCH();
+op_divide:
+        if (ENGINE_CHECKS && registers[c] == 0) {
+                goto op_invalid;
+        }
+        registers[a] = registers[b] / registers[c];
+        DISPATCH();
+op_nand:
+        registers[a] = ~(registers[b] & registers[c]);
+        DISPATCH();
+op_halt:
+        PUBLISH();
+        ENGINE_EXIT();
+        io_free(io);
+        free_memory(mem);
+        ENGINE_STOP(0);
+        return;
+op_map:
+        a = map_segment(mem, registers[c]);
+        if (a == SEGMENT_REFUSED) {
+                goto refused;
+        }
+        ENGINE_MAP(a, registers[c]);
+        registers[b] = a;
+        DISPATCH();
+op_unmap:
+        if (ENGINE_CHECKS && (registers[c] == 0 ||
+                              !segment_mapped(mem, registers[c]))) {
+                goto op_invalid;
+        }
+        ENGINE_UNMAP(registers[c]);
+        unmap_segment(mem, registers[c]);
+        DISPATCH();
+op_output:
+        output(io, registers, c);
+        ENGINE_OUTPUT(registers[c]);
+        DISPATCH();
+op_input:
+        input(io, registers, c);
+        ENGINE_INPUT(registers[c]);
+        DISPATCH();
+op_load_program:
+        /* loading segment 0 is only a jump, so the 0-segment pointer stays
+           valid; anything else installs a new 0-segment */
+        if (ENGINE_CHECKS && registers[b] != 0 &&
+            !segment_mapped(mem, registers[b])) {
+                goto op_invalid;
+        }
+        ENGINE_JUMP(registers[b], registers[c]);
+        io_tick(io);
+        live->instructions += pc - start;
+        live->load_programs++;
+        if (registers[b] != 0) {
+                segments_load_program(mem, registers[b], registers[c]);
+                code = decoded_program(mem, &length);
+                ENGINE_PROGRAM(length);
+        }
+        pc = registers[c];
+        ENGINE_TARGET(pc);
+        start = pc;
+        live->pc = pc;
+        DISPATCH();
+op_load_value:
+        registers[a] = inst->value;
+        DISPATCH();
+
+/* each superinstruction has the effect of its words run in order, reading
+ * the later words' fields from the entries after inst, and moves pc past
+ * them -- the ones ending in load_program finish in op_load_program
+ */
+super_lv2:
+        registers[a] = inst->value;
+        registers[inst[1].a] = inst[1].value;
+        pc += 1;
+        DISPATCH();
+super_const:
+        registers[a] = inst->value * inst[1].value + inst[3].value;
+        registers[inst[1].a] = inst[3].value;
+        pc += 4;
+        DISPATCH();
+super_jump:
+        registers[a] = inst->value;
+        b = inst[1].b;
+        c = inst[1].c;
+        pc += 1;
+        goto op_load_program;
+super_branch:
+        registers[a] = inst->value;
+        registers[inst[1].a] = inst[1].value;
+        if (registers[inst[2].c] != 0) {
+                registers[inst[2].a] = registers[inst[2].b];
+        }
+        b = inst[3].b;
+        c = inst[3].c;
+        pc += 3;
+        goto op_load_program;
+super_and:
+        registers[a] = ~(registers[b] & registers[c]);
+        registers[inst[1].a] = ~registers[a];
+        pc += 1;
+        DISPATCH();
+super_or:
+        registers[a] = ~registers[b];
+        registers[inst[1].a] = ~registers[inst[1].b];
+        registers[inst[2].a] = ~(registers[inst[2].b] &
+                                 registers[inst[2].c]);
+        pc += 2;
+        DISPATCH();
+super_lv_add:
+        registers[a] = inst->value;
+        registers[inst[1].a] = registers[inst[1].b ^ inst[1].c ^ a] +
+                               inst->value;
+        pc += 1;
+        DISPATCH();
+super_lv_mul:
+        registers[a] = inst->value;
+        registers[inst[1].a] = registers[inst[1].b ^ inst[1].c ^ a] *
+                               inst->value;
+        pc += 1;
+        DISPATCH();
+super_lv_nand:
+        registers[a] = inst->value;
+        registers[inst[1].a] = ~(registers[inst[1].b ^ inst[1].c ^ a] &
+                                 inst->value);
+        pc += 1;
+        DISPATCH();
+super_lv_load:
+        registers[a] = inst->value;
+        if (ENGINE_CHECKS && !segment_contains(mem, registers[inst[1].b],
+                                               registers[inst[1].c])) {
+                pc += 1;
+                goto op_invalid;
+        }
+        registers[inst[1].a] = segments_load(mem, registers[inst[1].b],
+                                             registers[inst[1].c]);
+        pc += 1;
+        DISPATCH();
+op_invalid:
+        /* op code must be 14 or 15 which is invalid, or a check failed, so
+           we must free memory and quit the program */
+        PUBLISH();
+        ENGINE_EXIT();
+        io_free(io);
+        free_memory(mem);
+        ENGINE_STOP(1);
+        return;
+refused:
+        fprintf(stderr, "Segment limit exceeded\n");
+        goto op_invalid;
+end_of_code:
+        PUBLISH();
+        /* the output so far is written before waiting for more program */
+        io_flush(io);
+        if (more_instructions(mem) == 1) {
+                code = decoded_program(mem, &length);
+                ENGINE_PROGRAM(length);
+                DISPATCH();
+        }
+        ENGINE_EXIT();
+        io_free(io);
+        free_memory(mem);
+}
+
+#pragma GCC diagnostic pop
+
+#undef DISPATCH
+#undef PUBLISH
@@ -0,0 +1,155 @@
+/*
+ * trace.c
+ *      the implementation for execution tracing
+ *      instantiates threaded_body.h with hooks that write trace records,
+ *      and makes and maps the trace file
+ *      step records are counted down to rather than counted, so a sampled
+ *      run costs one decrement and test per instruction between samples
+ *      events happen after the pc has moved past their instruction, so they
+ *      are recorded at pc - 1
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "trace.h"
+#include "operations.h"
+#include "peephole.h"
+#include "stats.h"
+
+/****** private helper function declarations ******/
+
+/* writes a record at the head of the ring */
+void trace_put(struct trace *trace, uint8_t kind, uint32_t pc,
+               uint8_t opcode, uint32_t segment, uint32_t value);
+
+/* writes the exit record and the number of instructions run */
+void trace_finish(struct trace *trace);
+
+/**************************************************/
+
+#define ENGINE_NAME run_traced
+#define ENGINE_EXTRA_PARAMS , struct trace *trace
+#define ENGINE_CHECKS 0
+#define ENGINE_HANDLER(inst) (inst)->opcode
+#define ENGINE_START(registers)
+#define ENGINE_FETCH(pc, inst)                                          \
+        do {                                                            \
+                if (--trace->countdown == 0) {                          \
+                        trace->countdown = trace->header->every;        \
+                        trace->steps++;                                 \
+                        trace_put(trace, TRACE_STEP, pc, (inst)->opcode,\
+                                  0, 0);                                \
+                }                                                       \
+        } while (0)
+#define ENGINE_STORE(segment, offset)
+#define ENGINE_PROGRAM(length)
+#define ENGINE_MAP(index, size)                                         \
+        trace_put(trace, TRACE_MAP, pc - 1, 8, index, size)
+#define ENGINE_UNMAP(index)                                             \
+        trace_put(trace, TRACE_UNMAP, pc - 1, 9, index,                 \
+                  segment_length(mem, index))
+#define ENGINE_JUMP(segment, offset)                                    \
+        trace_put(trace, TRACE_LOAD_PROGRAM, pc - 1, 12, segment, offset)
+#define ENGINE_TARGET(pc)
+#define ENGINE_OUTPUT(value)                                            \
+        trace_put(trace, TRACE_OUTPUT, pc - 1, 10, 0, value)
+#define ENGINE_INPUT(value)                                             \
+        trace_put(trace, TRACE_INPUT, pc - 1, 11, 0, value)
+#define ENGINE_EXIT() trace_finish(trace)
+#define ENGINE_STOP(status) exit(status)
+
+#include "threaded_body.h"
+
+/* the file is sized up front and mapped shared, so records reach it without
+ * any write calls -- its pages are only allocated as the ring first fills
+ */
+struct trace *trace_open(const char *path, uint64_t capacity, uint64_t every)
+{
+        uint64_t rounded = 1;
+        while (rounded < capacity) {
+                rounded *= 2;
+        }
+        size_t size = sizeof(struct trace_header) +
+                      rounded * sizeof(struct trace_record);
+
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+                return NULL;
+        }
+        if (ftruncate(fd, size) != 0) {
+                close(fd);
+                return NULL;
+        }
+        void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                             fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+                return NULL;
+        }
+
+        struct trace *trace = malloc(sizeof(struct trace));
+        trace->header = mapping;
+        trace->records = (struct trace_record *) (trace->header + 1);
+        trace->mask = rounded - 1;
+        trace->countdown = every == 0 ? 1 : every;
+        trace->steps = 0;
+        trace->size = size;
+
+        memcpy(trace->header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        trace->header->version = TRACE_VERSION;
+        trace->header->record_size = sizeof(struct trace_record);
+        trace->header->capacity = rounded;
+        trace->header->head = 0;
+        trace->header->every = trace->countdown;
+        trace->header->instructions = 0;
+        return trace;
+}
+
+/* the records stay in the file */
+void trace_close(struct trace *trace)
+{
+        munmap(trace->header, trace->size);
+        free(trace);
+}
+
+/****** private helper function definitions ******/
+
+/* head is kept in the mapped header itself, so the file says where the ring
+ * ends whenever the process stops
+ */
+void trace_put(struct trace *trace, uint8_t kind, uint32_t pc,
+               uint8_t opcode, uint32_t segment, uint32_t value)
+{
+        uint64_t head = trace->header->head;
+        struct trace_record *record = &trace->records[head & trace->mask];
+
+        record->pc = pc;
+        record->kind = kind;
+        record->opcode = opcode;
+        record->unused = 0;
+        record->segment = segment;
+        record->value = value;
+        trace->header->head = head + 1;
+}
+
+/* every instruction since the last step record has been fetched but not
+ * recorded
+ */
+void trace_finish(struct trace *trace)
+{
+        uint64_t every = trace->header->every;
+
+        trace_put(trace, TRACE_EXIT, 0, 0, 0, 0);
+        trace->header->instructions = trace->steps * every +
+                                      (every - trace->countdown);
+}
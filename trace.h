@@ -0,0 +1,92 @@
+/*
+ * trace.h
+ *      the interface for execution tracing of the UM, and the format of the
+ *      trace files that umtrace reads
+ *      run_traced is the direct-threaded engine compiled with hooks that
+ *      write fixed-size binary records into a ring kept in a shared mapping
+ *      of the trace file, so recording one is a few stores and the file is
+ *      complete even if the process is killed
+ *      a step record is written for every instruction, or for every Nth one
+ *      when sampling; map, unmap, load_program, output and input are always
+ *      recorded
+ *      once the ring is full, each record overwrites the oldest, so the file
+ *      always holds the most recent records
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef TRACE_H_INCLUDED_
+#define TRACE_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "segments.h"
+#include "umio.h"
+
+#define TRACE_MAGIC "UMTRACE"
+#define TRACE_VERSION 1
+
+/* what a record describes, and what its segment and value fields hold */
+enum trace_kind {
+        TRACE_STEP,             /* an instruction: neither */
+        TRACE_MAP,              /* the new segment and its size */
+        TRACE_UNMAP,            /* the segment and its size */
+        TRACE_LOAD_PROGRAM,     /* the segment and the new program counter */
+        TRACE_OUTPUT,           /* the register written out as value */
+        TRACE_INPUT,            /* the value input left in its register */
+        TRACE_EXIT              /* the end of the program: neither */
+};
+
+/* one record -- pc is the 0-segment offset of the instruction */
+struct trace_record {
+        uint32_t pc;
+        uint8_t kind;
+        uint8_t opcode;
+        uint16_t unused;
+        uint32_t segment;
+        uint32_t value;
+};
+
+/* the start of a trace file, followed by capacity records -- record i of
+ * the run is at index i % capacity, so the newest is at (head - 1) %
+ * capacity and the oldest kept at (head - capacity) % capacity once head
+ * passes capacity
+ * instructions is filled in when the program ends, and is 0 until then
+ */
+struct trace_header {
+        char magic[8];
+        uint32_t version;
+        uint32_t record_size;
+        uint64_t capacity;      /* a power of two */
+        uint64_t head;          /* the number of records ever written */
+        uint64_t every;         /* instructions per step record */
+        uint64_t instructions;  /* instructions run, in all */
+};
+
+/* the state of a traced run */
+struct trace {
+        struct trace_header *header;
+        struct trace_record *records;
+        uint64_t mask;          /* capacity - 1 */
+        uint64_t countdown;     /* instructions until the next step record */
+        uint64_t steps;         /* step records written */
+        size_t size;            /* bytes mapped */
+};
+
+/* creates the trace file at path with room for capacity records (rounded
+ * up to a power of two), writing a step record every given number of
+ * instructions -- returns NULL if the file cannot be made
+ */
+struct trace *trace_open(const char *path, uint64_t capacity, uint64_t every);
+
+/* unmaps and closes the trace file and frees the trace */
+void trace_close(struct trace *trace);
+
+/* Executes the instructions in the given UM_memory exactly as run_threaded
+ * does while writing the trace
+ */
+void run_traced(UM_memory mem, UM_io io, struct trace *trace);
+
+#endif /* TRACE_H_INCLUDED_ */
@@ -0,0 +1,459 @@
+/*
+ * um2c.c
+ *      translates a .um program into C ahead of time, so that a program run
+ *      over and over can be compiled once and run as native code
+ *      usage: um2c program.um [program.c]
+ *              the C goes to standard output if no file is given
+ *      the generated file is compiled against the UM's own modules, e.g.
+ *              ./compile && ./um2c program.um > program.c
+ *              gcc -O2 -I. -o program program.c libum2c.a (and the libraries
+ *              the um itself links against)
+ *      every word of the 0-segment becomes a labelled statement in one of
+ *      a series of functions, each CHUNK_WORDS words long, and the
+ *      registers become a local array of each function whose address is
+ *      never taken, so the C compiler keeps them in machine registers
+ *      load_program on segment 0 is a jump through a switch on the program
+ *      counter, with a direct goto for every target in the same chunk that
+ *      a nearby load_value suggests; a target in another chunk goes back to
+ *      run, which calls that chunk; load_program on a segment holding
+ *      exactly the original program (a copy of itself, say) stays native as
+ *      well
+ *      only a store into segment 0, or a load_program that installs a
+ *      different program, leaves the native code: the registers are handed
+ *      to unpack_resume, which carries on with the words in the memory
+ *      gcc's time on one function grows much faster than its size, so the
+ *      chunks keep the compile roughly linear in the program, and they are
+ *      compiled at -O1 (by a pragma in the generated file), which takes
+ *      half the time -O2 does: expect about a millisecond per word, so
+ *      under a minute for a 50,000 word program that took minutes more as
+ *      one function at -O2
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "decode.h"
+#include "byteswap.h"
+
+#define BYTES_IN_WORD 4
+#define BYTES_PER_LINE 12
+#define TARGET_WINDOW 3  /* words before a load_program searched for the
+                            load_values that may hold its target */
+#define CHUNK_WORDS 2048 /* words of the program in each generated function */
+
+/* the labels of a generated chunk that a word's statement may jump to, so
+ * that labels nothing jumps to are left out
+ */
+#define USES_INTERPRET 1
+#define USES_REPLACE 2
+
+/****** private helper function declarations ******/
+
+/* reads the whole of the given stream into a malloc'd buffer, storing its
+ * size in *num_bytes
+ */
+unsigned char *read_image(FILE *input, size_t *num_bytes);
+
+/* writes the includes, the embedded image and the helper functions */
+void emit_prologue(FILE *out, const char *name, const unsigned char *bytes,
+                   uint32_t num_words);
+
+/* writes the function running the chunk of the program starting at the
+ * given offset
+ */
+void emit_chunk(FILE *out, const struct decoded *code, uint32_t num_words,
+                uint32_t first);
+
+/* writes the statement for the word at the given offset, in the chunk
+ * starting at first, returning the USES_ flags of the labels it jumps to
+ */
+int emit_word(FILE *out, const struct decoded *code, uint32_t num_words,
+              uint32_t first, uint32_t offset);
+
+/* writes a load_program, with a direct goto for each target in the chunk
+ * starting at first that the load_values just before it could have put in
+ * its c register
+ */
+void emit_load_program(FILE *out, const struct decoded *code,
+                       uint32_t num_words, uint32_t first, uint32_t offset);
+
+/* writes the table of chunks, the function that calls them in turn and
+ * main
+ */
+void emit_epilogue(FILE *out, uint32_t num_words);
+/**************************************************/
+
+int main(int argc, char *argv[])
+{
+        if (argc != 2 && argc != 3) {
+                fprintf(stderr, "usage: um2c program.um [program.c]\n");
+                exit(1);
+        }
+
+        FILE *input = fopen(argv[1], "rb");
+        if (input == NULL) {
+                printf("Could not open file\n");
+                exit(1);
+        }
+        size_t num_bytes;
+        unsigned char *bytes = read_image(input, &num_bytes);
+        fclose(input);
+
+        uint32_t num_words = num_bytes / BYTES_IN_WORD;
+        uint32_t *words = malloc((num_words + 1) * sizeof(uint32_t));
+        struct decoded *code = malloc((num_words + 1) *
+                                      sizeof(struct decoded));
+        swap_words(words, bytes, num_words);
+        decode_words(words, code, num_words);
+
+        FILE *out = stdout;
+        if (argc == 3) {
+                out = fopen(argv[2], "w");
+                if (out == NULL) {
+                        printf("Could not open file\n");
+                        exit(1);
+                }
+        }
+
+        emit_prologue(out, argv[1], bytes, num_words);
+        for (uint32_t first = 0; first < num_words; first += CHUNK_WORDS) {
+                emit_chunk(out, code, num_words, first);
+        }
+        emit_epilogue(out, num_words);
+
+        int failed = ferror(out);
+        if (out != stdout) {
+                failed |= fclose(out);
+        }
+        free(code);
+        free(words);
+        free(bytes);
+        return failed == 0 ? 0 : 1;
+}
+
+/****** private helper function definitions ******/
+
+/* doubles the buffer until the stream runs dry */
+unsigned char *read_image(FILE *input, size_t *num_bytes)
+{
+        size_t capacity = 1 << 16;
+        size_t size = 0;
+        unsigned char *bytes = malloc(capacity);
+        size_t got;
+
+        while ((got = fread(bytes + size, 1, capacity - size, input)) > 0) {
+                size += got;
+                if (size == capacity) {
+                        capacity *= 2;
+                        bytes = realloc(bytes, capacity);
+                }
+        }
+        *num_bytes = size;
+        return bytes;
+}
+
+/* the image is embedded as the big-endian bytes of the .um file, so the
+ * generated program loads it exactly as the um loads a file
+ */
+void emit_prologue(FILE *out, const char *name, const unsigned char *bytes,
+                   uint32_t num_words)
+{
+        fprintf(out, "/*\n * generated by um2c from %s -- do not edit\n"
+                " */\n\n", name);
+        fprintf(out, "#include <stdint.h>\n#include <string.h>\n"
+                "#include <unistd.h>\n#include \"segments.h\"\n"
+                "#include \"umio.h\"\n#include \"unpack.h\"\n\n");
+
+        fprintf(out, "#define NUM_WORDS %uu\n\n", (unsigned) num_words);
+        fprintf(out, "static const unsigned char image[NUM_WORDS * 4 + 1]"
+                " = {");
+        for (uint32_t i = 0; i < num_words * BYTES_IN_WORD; i++) {
+                fprintf(out, "%s0x%02x,", i % BYTES_PER_LINE == 0 ?
+                        "\n        " : " ", bytes[i]);
+        }
+        fprintf(out, "\n        0\n};\n\n");
+
+        fprintf(out,
+"/* the value input leaves in a register that held old */\n"
+"static inline uint32_t input_value(UM_io io, uint32_t old)\n"
+"{\n"
+"        int value = io_get(io);\n"
+"\n"
+"        if (value == EOF) {\n"
+"                return ~0u;\n"
+"        }\n"
+"        return value < 256 ? (uint32_t) value : old;\n"
+"}\n"
+"\n"
+"/* returns 1 if the 0-segment holds exactly the words of the program the\n"
+" * native code was generated from\n"
+" */\n"
+"static inline int same_program(UM_memory mem, const uint32_t *words)\n"
+"{\n"
+"        uint32_t length;\n"
+"        const uint32_t *current = program_segment(mem, &length);\n"
+"\n"
+"        return length == NUM_WORDS && (current == words ||\n"
+"                memcmp(current, words, NUM_WORDS * sizeof(uint32_t)) == 0);\n"
+"}\n"
+"\n"
+"/* what the chunks of the program share -- each runs with the registers\n"
+" * and pc it is given, and leaves them for the next one\n"
+" */\n"
+"struct machine {\n"
+"        UM_memory mem;\n"
+"        UM_io io;\n"
+"        const uint32_t *words;\n"
+"        uint32_t r[8];\n"
+"        uint32_t pc;\n"
+"};\n"
+"\n"
+"/* the ways a chunk ends: pc has left it, halt, an invalid instruction,\n"
+" * or a change to the 0-segment the native code cannot follow\n"
+" */\n"
+"#define CHUNK_LEFT 0\n"
+"#define CHUNK_HALTED 1\n"
+"#define CHUNK_FAILED 2\n"
+"#define CHUNK_INTERPRET 3\n"
+"\n"
+"/* -O2 spends several times as long as -O1 on the chunks and buys them\n"
+" * little, so they are compiled at -O1 whatever the command line says\n"
+" */\n"
+"#pragma GCC push_options\n"
+"#pragma GCC optimize (\"O1\")\n"
+"\n");
+}
+
+/* the registers are copied in and out, so that within the chunk they are
+ * locals the C compiler can keep in machine registers -- the switch that
+ * enters the chunk at pc is also where a load_program jumps to, and a pc
+ * outside the chunk leaves it
+ */
+void emit_chunk(FILE *out, const struct decoded *code, uint32_t num_words,
+                uint32_t first)
+{
+        uint32_t last = num_words - first < CHUNK_WORDS ?
+                        num_words : first + CHUNK_WORDS;
+        int uses = 0;
+
+        fprintf(out, "/* runs words %u to %u natively */\n"
+                "static int chunk%u(struct machine *m)\n"
+                "{\n"
+                "        UM_memory mem = m->mem;\n"
+                "        UM_io io = m->io;\n"
+                "        const uint32_t *words = m->words;\n"
+                "        uint32_t r[8] = { m->r[0], m->r[1], m->r[2], "
+                "m->r[3],\n"
+                "                          m->r[4], m->r[5], m->r[6], "
+                "m->r[7] };\n"
+                "        uint32_t pc = m->pc;\n"
+                "        uint32_t segment = 0;\n"
+                "        int status = CHUNK_LEFT;\n"
+                "\n"
+                "        (void) mem;\n"
+                "        (void) io;\n"
+                "        (void) words;\n"
+                "        (void) segment;\n"
+                "        goto dispatch;\n",
+                (unsigned) first, (unsigned) last - 1,
+                (unsigned) (first / CHUNK_WORDS));
+
+        for (uint32_t offset = first; offset < last; offset++) {
+                uses |= emit_word(out, code, num_words, first, offset);
+        }
+
+        fprintf(out, "        pc = %uu;\n        goto leave;\n\n"
+                "dispatch:\n        switch (pc) {\n", (unsigned) last);
+        for (uint32_t offset = first; offset < last; offset++) {
+                fprintf(out, "        case %uu: goto w%u;\n",
+                        (unsigned) offset, (unsigned) offset);
+        }
+        fprintf(out, "        }\n        goto leave;\n");
+        if (uses & USES_REPLACE) {
+                fprintf(out, "replace:\n"
+                        "        segments_load_program(mem, segment, pc);\n"
+                        "        if (same_program(mem, words)) {\n"
+                        "                goto dispatch;\n"
+                        "        }\n"
+                        "        goto interpret;\n");
+        }
+        if (uses & USES_INTERPRET) {
+                fprintf(out, "interpret:\n"
+                        "        status = CHUNK_INTERPRET;\n");
+        }
+        fprintf(out, "leave:\n");
+        for (int i = 0; i < 8; i++) {
+                fprintf(out, "        m->r[%d] = r[%d];\n", i, i);
+        }
+        fprintf(out, "        m->pc = pc;\n"
+                "        return status;\n"
+                "}\n\n");
+}
+
+int emit_word(FILE *out, const struct decoded *code, uint32_t num_words,
+              uint32_t first, uint32_t offset)
+{
+        const struct decoded *inst = &code[offset];
+        unsigned a = inst->a, b = inst->b, c = inst->c;
+
+        fprintf(out, "w%u:\n", (unsigned) offset);
+        switch (inst->opcode) {
+                case 0:
+                        fprintf(out, "        if (r[%u] != 0) {\n"
+                                "                r[%u] = r[%u];\n"
+                                "        }\n", c, a, b);
+                        break;
+                case 1:
+                        fprintf(out, "        r[%u] = segments_load(mem, "
+                                "r[%u], r[%u]);\n", a, b, c);
+                        break;
+                case 2:
+                        fprintf(out, "        segments_store(mem, r[%u], "
+                                "r[%u], r[%u]);\n"
+                                "        if (r[%u] == 0) {\n"
+                                "                pc = %uu;\n"
+                                "                goto interpret;\n"
+                                "        }\n", a, b, c, a,
+                                (unsigned) offset + 1);
+                        return USES_INTERPRET;
+                case 3:
+                        fprintf(out, "        r[%u] = r[%u] + r[%u];\n",
+                                a, b, c);
+                        break;
+                case 4:
+                        fprintf(out, "        r[%u] = r[%u] * r[%u];\n",
+                                a, b, c);
+                        break;
+                case 5:
+                        fprintf(out, "        r[%u] = r[%u] / r[%u];\n",
+                                a, b, c);
+                        break;
+                case 6:
+                        fprintf(out, "        r[%u] = ~(r[%u] & r[%u]);\n",
+                                a, b, c);
+                        break;
+                case 7:
+                        fprintf(out, "        status = CHUNK_HALTED;\n"
+                                "        goto leave;\n");
+                        break;
+                case 8:
+                        fprintf(out, "        r[%u] = map_segment(mem, "
+                                "r[%u]);\n", b, c);
+                        break;
+                case 9:
+                        fprintf(out, "        unmap_segment(mem, r[%u]);\n",
+                                c);
+                        break;
+                case 10:
+                        fprintf(out, "        if (r[%u] < 256) {\n"
+                                "                io_put(io, r[%u]);\n"
+                                "        }\n", c, c);
+                        break;
+                case 11:
+                        fprintf(out, "        r[%u] = input_value(io, "
+                                "r[%u]);\n", c, c);
+                        break;
+                case 12:
+                        emit_load_program(out, code, num_words, first,
+                                          offset);
+                        return USES_REPLACE | USES_INTERPRET;
+                case 13:
+                        fprintf(out, "        r[%u] = %uu;\n", a,
+                                (unsigned) inst->value);
+                        break;
+                default:
+                        fprintf(out, "        status = CHUNK_FAILED;\n"
+                                "        goto leave;\n");
+                        break;
+        }
+        return 0;
+}
+
+/* the candidate targets are only hints: each goto is guarded by a test of
+ * the register, so a word reached some other way still jumps correctly
+ */
+void emit_load_program(FILE *out, const struct decoded *code,
+                       uint32_t num_words, uint32_t first, uint32_t offset)
+{
+        const struct decoded *inst = &code[offset];
+        uint32_t window = offset < TARGET_WINDOW ? 0 : offset - TARGET_WINDOW;
+
+        fprintf(out, "        io_tick(io);\n        pc = r[%u];\n"
+                "        if (r[%u] != 0) {\n"
+                "                segment = r[%u];\n"
+                "                goto replace;\n"
+                "        }\n",
+                (unsigned) inst->c, (unsigned) inst->b, (unsigned) inst->b);
+        for (uint32_t i = window; i < offset; i++) {
+                uint32_t target = code[i].value;
+                int repeated = 0;
+
+                if (code[i].opcode != 13 || target < first ||
+                    target >= num_words || target - first >= CHUNK_WORDS) {
+                        continue;
+                }
+                for (uint32_t j = window; j < i; j++) {
+                        repeated |= code[j].opcode == 13 &&
+                                    code[j].value == target;
+                }
+                if (!repeated) {
+                        fprintf(out, "        if (pc == %uu) {\n"
+                                "                goto w%u;\n"
+                                "        }\n", (unsigned) target,
+                                (unsigned) target);
+                }
+        }
+        fprintf(out, "        goto dispatch;\n");
+}
+
+/* running off the end of the 0-segment ends the program, as it does in the
+ * engines -- the table has a last entry that is never called, so that it is
+ * not empty when the program is
+ */
+void emit_epilogue(FILE *out, uint32_t num_words)
+{
+        fprintf(out, "#pragma GCC pop_options\n\n");
+        fprintf(out, "static int (*const chunks[])(struct machine *) = {\n");
+        for (uint32_t first = 0; first < num_words; first += CHUNK_WORDS) {
+                fprintf(out, "        chunk%u,\n",
+                        (unsigned) (first / CHUNK_WORDS));
+        }
+        fprintf(out, "        NULL\n};\n\n");
+        fprintf(out,
+"/* runs the program natively, a chunk at a time, for as long as the\n"
+" * 0-segment is unchanged\n"
+" */\n"
+"static int run(UM_program program, UM_io io)\n"
+"{\n"
+"        struct machine m = { memory_from_program(program), io, NULL,\n"
+"                             { 0, 0, 0, 0, 0, 0, 0, 0 }, 0 };\n"
+"        uint32_t num_words;\n"
+"        int status = CHUNK_LEFT;\n"
+"\n"
+"        m.words = program_words(program, &num_words);\n"
+"        while (status == CHUNK_LEFT && m.pc < NUM_WORDS) {\n"
+"                status = chunks[m.pc / %uu](&m);\n"
+"        }\n"
+"        if (status == CHUNK_INTERPRET) {\n"
+"                segments_load_program(m.mem, 0, m.pc);\n"
+"                unpack_resume(m.mem, io, m.r);\n"
+"                return 0;\n"
+"        }\n"
+"        io_free(io);\n"
+"        free_memory(m.mem);\n"
+"        return status == CHUNK_FAILED ? 1 : 0;\n"
+"}\n"
+"\n"
+"int main(void)\n"
+"{\n"
+"        UM_program program = program_from_bytes(image, NUM_WORDS * 4);\n"
+"        UM_io io = io_new(STDIN_FILENO, STDOUT_FILENO, NULL);\n"
+"        int status = run(program, io);\n"
+"\n"
+"        program_free(program);\n"
+"        return status;\n"
+"}\n", (unsigned) CHUNK_WORDS);
+}
@@ -0,0 +1,632 @@
+/*
+ * umbench.c
+ *      the benchmark harness for the UM
+ *      builds each synthetic workload (see workloads.h) into a temporary
+ *      .um file, counts its instructions once with um --profile, then runs
+ *      it repeatedly with output thrown away, timing each run and taking the
+ *      child's peak RSS from wait4 -- on Linux it can also count cycles,
+ *      cache misses and branch misses for the child with perf_event_open
+ *      results are written as CSV, one line per workload with the median of
+ *      the runs, so two builds can be compared with --compare
+ *      usage: umbench [options] [workload[=size] ...]
+ *              --um=PATH runs PATH instead of ./um
+ *              --um-option=OPT passes OPT (--jit, say) to every run
+ *              --reps=N runs each workload N times (default 5)
+ *              --counters reads the hardware counters as well
+ *              --out=FILE writes the results to FILE instead of stdout
+ *      usage: umbench --compare OLD.csv NEW.csv [--threshold=PCT]
+ *              prints the change in instructions per second for each
+ *              workload in both files, and exits with 1 if any slowed down
+ *              by more than PCT percent (default 5)
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "workloads.h"
+
+#define DEFAULT_REPS 5
+#define DEFAULT_THRESHOLD 5.0
+#define MAX_WORKLOADS 64
+#define MAX_UM_OPTIONS 16
+#define NUM_COUNTERS 3
+#define NS_PER_S 1000000000.0
+
+/* the sizes used when a workload is named without one, chosen so each run
+ * takes a fraction of a second on the threaded engine
+ */
+static const struct {
+        const char *name;
+        uint32_t size;
+} default_sizes[] = {
+        { "arith", 20000000 },
+        { "churn", 2000000 },
+        { "bigseg", 8000000 },
+        { "jumps", 2000000 },
+        { "output", 20000000 },
+};
+
+/* one workload to run */
+struct bench {
+        const char *name;
+        uint32_t size;
+};
+
+/* the measurements of one run -- counters are -1 when unavailable */
+struct run {
+        double seconds;
+        long rss_kb;
+        long long counters[NUM_COUNTERS];
+};
+
+/* the result line for one workload */
+struct result {
+        char name[64];
+        uint32_t size;
+        unsigned reps;
+        unsigned long long instructions;
+        double seconds;
+        double ips;
+        long rss_kb;
+        long long counters[NUM_COUNTERS];
+};
+
+/* how to run the um */
+struct runner {
+        const char *um;
+        const char *options[MAX_UM_OPTIONS];
+        int num_options;
+        int counters;
+};
+
+/****** private helper function declarations ******/
+
+/* prints the usage and exits */
+void usage(void);
+
+/* parses name[=size], using the default size if none is given */
+struct bench parse_bench(const char *arg);
+
+/* builds the workload into a fresh temporary file, storing its path */
+void write_workload(struct bench bench, char *path);
+
+/* runs the um once under --profile, without the --um-option options, to
+ * count the instructions the workload executes -- returns 0 if the count
+ * could not be found
+ */
+unsigned long long count_instructions(struct runner *runner,
+                                      const char *path);
+
+/* runs the um once on the program, with output going to /dev/null --
+ * returns 0 on success and -1 if the um could not run or did not exit 0
+ */
+int run_once(struct runner *runner, const char *path, struct run *run);
+
+/* forks and execs the um with the given extra option, input from
+ * /dev/null and output to out_fd -- the child waits for a byte on a pipe
+ * before it execs, so counters can be attached first; that byte is sent
+ * by release_child
+ */
+pid_t start_child(struct runner *runner, const char *extra,
+                  const char *path, int out_fd, int *go_fd);
+void release_child(int go_fd);
+
+/* opens the hardware counters for the child, enabled when it execs --
+ * counters that cannot be opened are left as -1
+ */
+void open_counters(pid_t child, int *fds);
+
+/* reads and closes the counters */
+void read_counters(int *fds, long long *values);
+
+/* fills in the result with the medians of the runs */
+void summarize(struct result *result, struct run *runs, unsigned reps);
+
+/* median of n values, which are sorted in place */
+double median(double *values, unsigned n);
+
+/* writes the header, or one result, as CSV */
+void write_header(FILE *out);
+void write_result(FILE *out, const struct result *result);
+
+/* reads the results in a CSV file, returning how many there were, or -1 if
+ * the file could not be opened
+ */
+int read_results(const char *path, struct result *results, int max);
+
+/* compares two results files, returning the exit code */
+int compare(const char *old_path, const char *new_path, double threshold);
+
+/**************************************************/
+
+int main(int argc, char *argv[])
+{
+        struct runner runner = { "./um", { NULL }, 0, 0 };
+        struct bench benches[MAX_WORKLOADS];
+        int num_benches = 0;
+        unsigned reps = DEFAULT_REPS;
+        double threshold = DEFAULT_THRESHOLD;
+        const char *compare_paths[2] = { NULL, NULL };
+        FILE *out = stdout;
+
+        for (int arg = 1; arg < argc; arg++) {
+                if (strncmp(argv[arg], "--um=", 5) == 0) {
+                        runner.um = argv[arg] + 5;
+                } else if (strncmp(argv[arg], "--um-option=", 12) == 0) {
+                        if (runner.num_options == MAX_UM_OPTIONS) {
+                                usage();
+                        }
+                        runner.options[runner.num_options++] = argv[arg] + 12;
+                } else if (strncmp(argv[arg], "--reps=", 7) == 0) {
+                        reps = strtoul(argv[arg] + 7, NULL, 10);
+                        if (reps == 0) {
+                                usage();
+                        }
+                } else if (strcmp(argv[arg], "--counters") == 0) {
+                        runner.counters = 1;
+                } else if (strncmp(argv[arg], "--out=", 6) == 0) {
+                        out = fopen(argv[arg] + 6, "w");
+                        if (out == NULL) {
+                                printf("Could not open file\n");
+                                exit(1);
+                        }
+                } else if (strcmp(argv[arg], "--compare") == 0) {
+                        if (argc - arg < 3) {
+                                usage();
+                        }
+                        compare_paths[0] = argv[++arg];
+                        compare_paths[1] = argv[++arg];
+                } else if (strncmp(argv[arg], "--threshold=", 12) == 0) {
+                        threshold = strtod(argv[arg] + 12, NULL);
+                } else if (strncmp(argv[arg], "--", 2) == 0 ||
+                           num_benches == MAX_WORKLOADS) {
+                        usage();
+                } else {
+                        benches[num_benches++] = parse_bench(argv[arg]);
+                }
+        }
+
+        if (compare_paths[0] != NULL) {
+                return compare(compare_paths[0], compare_paths[1],
+                               threshold);
+        }
+
+        /* no workloads named means all of them at their default sizes */
+        if (num_benches == 0) {
+                for (int i = 0; workload_names[i] != NULL; i++) {
+                        benches[num_benches++] = parse_bench(
+                                                   workload_names[i]);
+                }
+        }
+
+        struct run *runs = malloc(reps * sizeof(struct run));
+        int failed = 0;
+        write_header(out);
+        for (int i = 0; i < num_benches; i++) {
+                struct result result;
+                char path[64];
+
+                write_workload(benches[i], path);
+                memset(&result, 0, sizeof(result));
+                snprintf(result.name, sizeof(result.name), "%s",
+                         benches[i].name);
+                result.size = benches[i].size;
+                result.reps = reps;
+                result.instructions = count_instructions(&runner, path);
+
+                unsigned r = 0;
+                for (; r < reps; r++) {
+                        if (run_once(&runner, path, &runs[r]) != 0) {
+                                break;
+                        }
+                }
+                unlink(path);
+                if (r < reps || result.instructions == 0) {
+                        fprintf(stderr, "umbench: %s failed to run\n",
+                                benches[i].name);
+                        failed = 1;
+                        continue;
+                }
+                summarize(&result, runs, reps);
+                write_result(out, &result);
+                fflush(out);
+        }
+        free(runs);
+        if (out != stdout) {
+                fclose(out);
+        }
+        return failed;
+}
+
+/****** private helper function definitions ******/
+
+/* the workloads are listed with the size each gets by default */
+void usage(void)
+{
+        fprintf(stderr, "usage: umbench [--um=PATH] [--um-option=OPT] "
+                        "[--reps=N] [--counters] [--out=FILE] "
+                        "[workload[=size] ...]\n"
+                        "       umbench --compare OLD.csv NEW.csv "
+                        "[--threshold=PCT]\n"
+                        "workloads:");
+        for (size_t i = 0; i < sizeof(default_sizes) /
+                               sizeof(default_sizes[0]); i++) {
+                fprintf(stderr, " %s=%u", default_sizes[i].name,
+                        default_sizes[i].size);
+        }
+        fprintf(stderr, "\n");
+        exit(1);
+}
+
+/* the name must be one workload_build knows */
+struct bench parse_bench(const char *arg)
+{
+        struct bench bench = { NULL, 0 };
+        const char *equals = strchr(arg, '=');
+        size_t length = equals == NULL ? strlen(arg)
+                                       : (size_t) (equals - arg);
+
+        for (int i = 0; workload_names[i] != NULL; i++) {
+                if (strlen(workload_names[i]) == length &&
+                    strncmp(arg, workload_names[i], length) == 0) {
+                        bench.name = workload_names[i];
+                        bench.size = default_sizes[i].size;
+                }
+        }
+        if (bench.name == NULL) {
+                usage();
+        }
+        if (equals != NULL) {
+                char *end;
+                bench.size = strtoul(equals + 1, &end, 10);
+                if (*end != '\0') {
+                        usage();
+                }
+        }
+        return bench;
+}
+
+/* mkstemp gives a name no other run can be using */
+void write_workload(struct bench bench, char *path)
+{
+        uint32_t num_words;
+        uint32_t *words = workload_build(bench.name, bench.size, &num_words);
+
+        strcpy(path, "/tmp/umbench-XXXXXX");
+        int fd = mkstemp(path);
+        FILE *file = fd < 0 ? NULL : fdopen(fd, "wb");
+        if (file == NULL || workload_write(file, words, num_words) != 0 ||
+            fclose(file) != 0) {
+                fprintf(stderr, "umbench: could not write %s\n", path);
+                exit(1);
+        }
+        free(words);
+}
+
+/* the report goes to a pipe and is scanned for the retired line -- the
+ * count is the same under every engine, and um will not run --profile
+ * together with one
+ */
+unsigned long long count_instructions(struct runner *runner,
+                                      const char *path)
+{
+        int report[2];
+        int null_fd = open("/dev/null", O_WRONLY);
+        unsigned long long count = 0;
+        char line[256];
+        char option[64];
+
+        if (pipe(report) != 0) {
+                return 0;
+        }
+        snprintf(option, sizeof(option), "--profile=/dev/fd/%d", report[1]);
+        struct runner profiled = *runner;
+        profiled.num_options = 0;
+        int go_fd;
+        pid_t child = start_child(&profiled, option, path, null_fd, &go_fd);
+        close(report[1]);
+        close(null_fd);
+        if (child < 0) {
+                close(report[0]);
+                return 0;
+        }
+        release_child(go_fd);
+
+        FILE *in = fdopen(report[0], "r");
+        while (fgets(line, sizeof(line), in) != NULL) {
+                sscanf(line, "instructions retired: %llu", &count);
+        }
+        fclose(in);
+
+        int status;
+        waitpid(child, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                return 0;
+        }
+        return count;
+}
+
+/* the clock starts just before the child is released, so the fork is not
+ * counted, but loading the program is
+ */
+int run_once(struct runner *runner, const char *path, struct run *run)
+{
+        int fds[NUM_COUNTERS] = { -1, -1, -1 };
+        int null_fd = open("/dev/null", O_WRONLY);
+        struct timespec start, end;
+        struct rusage usage;
+        int go_fd, status;
+
+        pid_t child = start_child(runner, NULL, path, null_fd, &go_fd);
+        close(null_fd);
+        if (child < 0) {
+                return -1;
+        }
+        if (runner->counters == 1) {
+                open_counters(child, fds);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        release_child(go_fd);
+        if (wait4(child, &status, 0, &usage) < 0) {
+                return -1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        run->seconds = (end.tv_sec - start.tv_sec) +
+                       (end.tv_nsec - start.tv_nsec) / NS_PER_S;
+        run->rss_kb = usage.ru_maxrss;
+        read_counters(fds, run->counters);
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/* the argument list is the um, its options, the extra one, and the file */
+pid_t start_child(struct runner *runner, const char *extra,
+                  const char *path, int out_fd, int *go_fd)
+{
+        const char *args[MAX_UM_OPTIONS + 4];
+        int go[2];
+        int n = 0;
+
+        args[n++] = runner->um;
+        for (int i = 0; i < runner->num_options; i++) {
+                args[n++] = runner->options[i];
+        }
+        if (extra != NULL) {
+                args[n++] = extra;
+        }
+        args[n++] = path;
+        args[n] = NULL;
+
+        if (pipe(go) != 0) {
+                return -1;
+        }
+        pid_t child = fork();
+        if (child == 0) {
+                char byte;
+                close(go[1]);
+                if (read(go[0], &byte, 1) != 1) {
+                        _exit(127);
+                }
+                close(go[0]);
+                int in_fd = open("/dev/null", O_RDONLY);
+                dup2(in_fd, STDIN_FILENO);
+                dup2(out_fd, STDOUT_FILENO);
+                execv(runner->um, (char *const *) args);
+                _exit(127);
+        }
+        close(go[0]);
+        if (child < 0) {
+                close(go[1]);
+                return -1;
+        }
+        *go_fd = go[1];
+        return child;
+}
+
+/* closing the pipe after the byte means the child never blocks twice */
+void release_child(int go_fd)
+{
+        char byte = 0;
+        if (write(go_fd, &byte, 1) != 1) {
+                fprintf(stderr, "umbench: could not start the um\n");
+        }
+        close(go_fd);
+}
+
+#ifdef __linux__
+
+/* user-space only, so the counters work under the default
+ * perf_event_paranoid setting
+ */
+void open_counters(pid_t child, int *fds)
+{
+        static const uint64_t events[NUM_COUNTERS] = {
+                PERF_COUNT_HW_CPU_CYCLES,
+                PERF_COUNT_HW_CACHE_MISSES,
+                PERF_COUNT_HW_BRANCH_MISSES
+        };
+
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+                struct perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.type = PERF_TYPE_HARDWARE;
+                attr.size = sizeof(attr);
+                attr.config = events[i];
+                attr.disabled = 1;
+                attr.enable_on_exec = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                fds[i] = syscall(SYS_perf_event_open, &attr, child, -1, -1,
+                                 0);
+        }
+}
+
+#else
+
+/* there is no perf_event_open, so every counter stays unavailable */
+void open_counters(pid_t child, int *fds)
+{
+        (void) child;
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+                fds[i] = -1;
+        }
+}
+
+#endif
+
+/* a counter that was never opened, or cannot be read, is -1 */
+void read_counters(int *fds, long long *values)
+{
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+                uint64_t value;
+                values[i] = -1;
+                if (fds[i] < 0) {
+                        continue;
+                }
+                if (read(fds[i], &value, sizeof(value)) == sizeof(value)) {
+                        values[i] = value;
+                }
+                close(fds[i]);
+        }
+}
+
+/* the median resists the odd run disturbed by the rest of the system */
+void summarize(struct result *result, struct run *runs, unsigned reps)
+{
+        double values[reps];
+
+        for (unsigned r = 0; r < reps; r++) {
+                values[r] = runs[r].seconds;
+        }
+        result->seconds = median(values, reps);
+        result->ips = result->seconds > 0
+                      ? result->instructions / result->seconds : 0;
+
+        result->rss_kb = 0;
+        for (unsigned r = 0; r < reps; r++) {
+                if (runs[r].rss_kb > result->rss_kb) {
+                        result->rss_kb = runs[r].rss_kb;
+                }
+        }
+
+        for (int i = 0; i < NUM_COUNTERS; i++) {
+                result->counters[i] = -1;
+                if (runs[0].counters[i] < 0) {
+                        continue;
+                }
+                for (unsigned r = 0; r < reps; r++) {
+                        values[r] = runs[r].counters[i];
+                }
+                result->counters[i] = median(values, reps);
+        }
+}
+
+/* insertion sort, since there are only a handful of runs */
+double median(double *values, unsigned n)
+{
+        for (unsigned i = 1; i < n; i++) {
+                double value = values[i];
+                unsigned j = i;
+                for (; j > 0 && values[j - 1] > value; j--) {
+                        values[j] = values[j - 1];
+                }
+                values[j] = value;
+        }
+        if (n % 2 == 1) {
+                return values[n / 2];
+        }
+        return (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+/* the columns match write_result and read_results */
+void write_header(FILE *out)
+{
+        fprintf(out, "workload,size,reps,instructions,seconds,"
+                     "instructions_per_second,peak_rss_kb,cycles,"
+                     "cache_misses,branch_misses\n");
+}
+
+void write_result(FILE *out, const struct result *result)
+{
+        fprintf(out, "%s,%u,%u,%llu,%.6f,%.0f,%ld,%lld,%lld,%lld\n",
+                result->name, result->size, result->reps,
+                result->instructions, result->seconds, result->ips,
+                result->rss_kb, result->counters[0], result->counters[1],
+                result->counters[2]);
+}
+
+/* the header, and any line that does not parse, is skipped */
+int read_results(const char *path, struct result *results, int max)
+{
+        FILE *in = fopen(path, "r");
+        char line[512];
+        int n = 0;
+
+        if (in == NULL) {
+                return -1;
+        }
+        while (n < max && fgets(line, sizeof(line), in) != NULL) {
+                struct result *r = &results[n];
+                if (sscanf(line, "%63[^,],%u,%u,%llu,%lf,%lf,%ld,%lld,%lld,"
+                                 "%lld", r->name, &r->size, &r->reps,
+                           &r->instructions, &r->seconds, &r->ips,
+                           &r->rss_kb, &r->counters[0], &r->counters[1],
+                           &r->counters[2]) == 10) {
+                        n++;
+                }
+        }
+        fclose(in);
+        return n;
+}
+
+/* workloads are matched on both name and size, so that results for
+ * different sizes are never compared
+ */
+int compare(const char *old_path, const char *new_path, double threshold)
+{
+        static struct result old[MAX_WORKLOADS], new[MAX_WORKLOADS];
+        int num_old = read_results(old_path, old, MAX_WORKLOADS);
+        int num_new = read_results(new_path, new, MAX_WORKLOADS);
+        int regressed = 0;
+
+        if (num_old < 0 || num_new < 0) {
+                printf("Could not open file\n");
+                return 1;
+        }
+        printf("%-10s %10s %14s %14s %8s\n", "workload", "size",
+               "old instr/s", "new instr/s", "change");
+        for (int i = 0; i < num_new; i++) {
+                for (int j = 0; j < num_old; j++) {
+                        if (strcmp(new[i].name, old[j].name) != 0 ||
+                            new[i].size != old[j].size || old[j].ips <= 0) {
+                                continue;
+                        }
+                        double change = (new[i].ips / old[j].ips - 1) * 100;
+                        int slower = change < -threshold;
+                        printf("%-10s %10u %14.0f %14.0f %+7.1f%%%s\n",
+                               new[i].name, new[i].size, old[j].ips,
+                               new[i].ips, change,
+                               slower ? "  REGRESSION" : "");
+                        regressed |= slower;
+                        break;
+                }
+        }
+        return regressed;
+}
@@ -0,0 +1,62 @@
+/*
+ * umgen.c
+ *      writes one of the synthetic benchmark workloads as a .um file
+ *      usage: umgen workload size [file.um]
+ *              workload is one of arith, churn, bigseg, jumps or output
+ *              (see workloads.h), size is its size parameter, and the
+ *              program goes to standard output if no file is given
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "workloads.h"
+
+/* exits after listing the workloads */
+static void usage(void)
+{
+        fprintf(stderr, "usage: umgen workload size [file.um]\n");
+        fprintf(stderr, "workloads:");
+        for (int i = 0; workload_names[i] != NULL; i++) {
+                fprintf(stderr, " %s", workload_names[i]);
+        }
+        fprintf(stderr, "\n");
+        exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+        if (argc != 3 && argc != 4) {
+                usage();
+        }
+
+        char *end;
+        unsigned long size = strtoul(argv[2], &end, 10);
+        if (*end != '\0' || size > UINT32_MAX) {
+                usage();
+        }
+
+        uint32_t num_words;
+        uint32_t *words = workload_build(argv[1], size, &num_words);
+        if (words == NULL) {
+                usage();
+        }
+
+        FILE *out = stdout;
+        if (argc == 4) {
+                out = fopen(argv[3], "wb");
+                if (out == NULL) {
+                        printf("Could not open file\n");
+                        exit(1);
+                }
+        }
+        int failed = workload_write(out, words, num_words);
+        if (out != stdout) {
+                failed |= fclose(out);
+        }
+        free(words);
+        return failed == 0 ? 0 : 1;
+}
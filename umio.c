@@ -0,0 +1,576 @@
+/*
+ * umio.c
+ *      the implementation for the I/O layer of the UM
+ *      synchronous output collects bytes in a buffer that is written with
+ *      one write() when it reaches the byte threshold, when a line ends on a
+ *      terminal, or when its oldest byte passes the time threshold -- which
+ *      is checked as bytes arrive and at every io_tick
+ *      asynchronous output pushes each byte into a UM_ring instead; a writer
+ *      thread drains the ring under the same thresholds and sleeps on a
+ *      condition variable while there is nothing worth writing
+ *      input from a regular file or a pipe is read in IN_BUFFER_SIZE pieces;
+ *      from anything else (a terminal, say) it is read a byte at a time so
+ *      the UM never takes more than it asked for
+ *      a linked UM_io works on its rings' own bytes: output is put straight
+ *      into the space ring_reserve offers and committed under the same
+ *      byte and time thresholds, and input is taken straight from the bytes
+ *      ring_peek shows -- so a byte passed from one UM to another is copied
+ *      by neither of them
+ *      a side waiting on a linked ring spins briefly, then sleeps in short
+ *      naps, since the other side is usually a running UM that will be
+ *      along at once
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "umio.h"
+#include "ring.h"
+
+#define OUT_BUFFER_SIZE (64 * 1024)
+#define IN_BUFFER_SIZE (64 * 1024)
+#define RING_SIZE (4 * 1024 * 1024)
+#define WRITER_IDLE_MS 10
+#define LINK_SPINS 64
+#define LINK_NAP_NS 50000L
+#define NS_PER_MS 1000000L
+#define NS_PER_S 1000000000L
+
+struct UM_io {
+        int in_fd;
+        int out_fd;
+        uint64_t *output_bytes;         /* own_output_bytes until io_count */
+        uint64_t own_output_bytes;
+        size_t flush_bytes;
+        long flush_ns;
+        int line_flush;
+        int async;
+
+        /* synchronous output */
+        unsigned char *out;
+        size_t out_len;
+        struct timespec oldest;
+
+        /* read-ahead input */
+        unsigned char *in;
+        size_t in_pos;
+        size_t in_len;
+        size_t in_chunk;
+        int in_eof;
+
+        /* asynchronous output -- pushed is only touched by the UM's thread,
+           written only by the writer thread */
+        UM_ring ring;
+        pthread_t writer;
+        pthread_mutex_t lock;
+        pthread_cond_t wake;
+        pthread_cond_t drained;
+        size_t pushed;
+        size_t written;
+        int flush_request;
+        int writer_idle;
+
+        /* linked input and output -- in and out then point into the
+           rings, and out_room is how much of the reserved space is left */
+        UM_ring in_ring;
+        UM_ring out_ring;
+        size_t out_room;
+};
+
+/****** private helper function declarations ******/
+
+/* writes all n bytes to fd, retrying after partial writes and signals --
+ * output that cannot be written at all is dropped
+ */
+void write_all(int fd, const unsigned char *bytes, size_t n);
+
+/* writes the synchronous output buffer */
+void write_out(UM_io io);
+
+/* returns the nanoseconds from start to now */
+long elapsed_ns(const struct timespec *start);
+
+/* pushes one byte into the ring, waking the writer if the byte threshold
+ * has been reached
+ */
+void async_put(UM_io io, unsigned char byte);
+
+/* asks the writer to drain the ring and waits until it has */
+void async_flush(UM_io io);
+
+/* the writer thread: drains the ring to out_fd until it is closed */
+void *writer_main(void *arg);
+
+/* returns 1 if the writer has something to do -- called with the lock held;
+ * since is when the writer first saw bytes it has not written
+ */
+int writer_has_work(UM_io io, int *waiting, struct timespec *since);
+
+/* puts one byte into the output ring, committing it once a threshold is
+ * reached
+ */
+void link_put(UM_io io, unsigned char byte);
+
+/* commits the output put into the ring so far */
+void link_commit(UM_io io);
+
+/* waits for room in the output ring and reserves it -- returns 0, leaving
+ * none reserved, if the reader has detached
+ */
+int link_reserve(UM_io io);
+
+/* gives back the input taken so far and waits for more in the input ring,
+ * returning 0 once the ring is closed and empty
+ */
+int link_refill(UM_io io);
+
+/* waits a little longer, the more times it has already been called for
+ * the same wait
+ */
+void link_wait(unsigned *tries);
+
+/**************************************************/
+
+/* fills in the defaults and works out how each descriptor should be read or
+ * written, then starts the writer thread if asked to
+ */
+UM_io io_new(int in_fd, int out_fd, const struct io_options *options)
+{
+        UM_io io = calloc(1, sizeof(struct UM_io));
+        struct stat info;
+
+        io->in_fd = in_fd;
+        io->out_fd = out_fd;
+        io->output_bytes = &io->own_output_bytes;
+        io->flush_bytes = OUT_BUFFER_SIZE;
+        if (options != NULL) {
+                if (options->flush_bytes != 0 &&
+                    options->flush_bytes < OUT_BUFFER_SIZE) {
+                        io->flush_bytes = options->flush_bytes;
+                }
+                io->flush_ns = options->flush_ms * NS_PER_MS;
+                io->async = options->async;
+        }
+        io->line_flush = isatty(out_fd);
+
+        io->in_chunk = 1;
+        if (fstat(in_fd, &info) == 0 &&
+            (S_ISREG(info.st_mode) || S_ISFIFO(info.st_mode))) {
+                io->in_chunk = IN_BUFFER_SIZE;
+        }
+        io->in = malloc(io->in_chunk);
+
+        if (io->async == 0) {
+                io->out = malloc(OUT_BUFFER_SIZE);
+                return io;
+        }
+
+        /* the writer has no lines to look for, so a terminal gets every
+           byte as soon as the writer sees it */
+        if (io->line_flush == 1) {
+                io->flush_bytes = 1;
+        }
+        io->ring = ring_new(RING_SIZE);
+        pthread_mutex_init(&io->lock, NULL);
+        pthread_cond_init(&io->wake, NULL);
+        pthread_cond_init(&io->drained, NULL);
+        if (pthread_create(&io->writer, NULL, writer_main, io) != 0) {
+                /* no thread, so fall back to writing synchronously */
+                ring_free(io->ring);
+                io->ring = NULL;
+                io->async = 0;
+                io->flush_bytes = OUT_BUFFER_SIZE;
+                io->out = malloc(OUT_BUFFER_SIZE);
+        }
+        return io;
+}
+
+/* there is no one else to take the bytes a linked UM_io leaves behind, so it
+ * hands on all it has
+ */
+void io_link(UM_io io, UM_ring in, UM_ring out)
+{
+        if (in != NULL) {
+                free(io->in);
+                io->in = NULL;
+                io->in_pos = 0;
+                io->in_len = 0;
+                io->in_ring = in;
+        }
+        if (out != NULL) {
+                write_out(io);
+                free(io->out);
+                io->out = NULL;
+                io->out_ring = out;
+        }
+}
+
+/* flushes, then closes the ring so the writer thread exits -- a linked
+ * UM_io closes its output ring and detaches from its input ring
+ */
+void io_free(UM_io io)
+{
+        io_flush(io);
+        if (io->out_ring != NULL) {
+                ring_close(io->out_ring);
+                io->out = NULL;
+        }
+        if (io->in_ring != NULL) {
+                ring_consume(io->in_ring, io->in_pos);
+                ring_detach(io->in_ring);
+                io->in = NULL;
+        }
+        if (io->async == 1) {
+                pthread_mutex_lock(&io->lock);
+                ring_close(io->ring);
+                pthread_cond_signal(&io->wake);
+                pthread_mutex_unlock(&io->lock);
+                pthread_join(io->writer, NULL);
+
+                ring_free(io->ring);
+                pthread_mutex_destroy(&io->lock);
+                pthread_cond_destroy(&io->wake);
+                pthread_cond_destroy(&io->drained);
+        }
+        free(io->out);
+        free(io->in);
+        free(io);
+}
+
+/* appends to the buffer and writes it out once a threshold is reached */
+void io_put(UM_io io, unsigned char byte)
+{
+        (*io->output_bytes)++;
+        if (io->async == 1) {
+                async_put(io, byte);
+                return;
+        }
+        if (io->out_ring != NULL) {
+                link_put(io, byte);
+                return;
+        }
+        if (io->out_len == 0 && io->flush_ns != 0) {
+                clock_gettime(CLOCK_MONOTONIC, &io->oldest);
+        }
+        io->out[io->out_len++] = byte;
+        if (io->out_len >= io->flush_bytes ||
+            (io->line_flush == 1 && byte == '\n') ||
+            (io->flush_ns != 0 && elapsed_ns(&io->oldest) >= io->flush_ns)) {
+                write_out(io);
+        }
+}
+
+/* refills the read-ahead buffer if it is empty, flushing first so that any
+ * prompt is visible before the read can block -- end of input is remembered
+ */
+int io_get(UM_io io)
+{
+        if (io->in_ring != NULL) {
+                if (io->in_pos == io->in_len && link_refill(io) == 0) {
+                        return EOF;
+                }
+                return io->in[io->in_pos++];
+        }
+        if (io->in_pos == io->in_len && io->in_eof == 0) {
+                ssize_t got;
+
+                io_flush(io);
+                do {
+                        got = read(io->in_fd, io->in, io->in_chunk);
+                } while (got < 0 && errno == EINTR);
+
+                io->in_pos = 0;
+                io->in_len = got > 0 ? (size_t) got : 0;
+                io->in_eof = got <= 0;
+        }
+        if (io->in_pos == io->in_len) {
+                return EOF;
+        }
+        return io->in[io->in_pos++];
+}
+
+/* the same test io_get makes before it reads */
+int io_wait_fd(UM_io io)
+{
+        if (io->in_pos == io->in_len && io->in_eof == 0) {
+                return io->in_fd;
+        }
+        return -1;
+}
+
+/* carries the count so far over to the new counter */
+void io_count(UM_io io, uint64_t *output_bytes)
+{
+        *output_bytes = *io->output_bytes;
+        io->output_bytes = output_bytes;
+}
+
+/* writes the buffer, or has the writer drain the ring */
+void io_flush(UM_io io)
+{
+        if (io->async == 1) {
+                async_flush(io);
+        } else {
+                write_out(io);
+        }
+}
+
+/* costs two tests while nothing is waiting, or no time threshold is set */
+void io_tick(UM_io io)
+{
+        if (io->out_len != 0 && io->flush_ns != 0 &&
+            elapsed_ns(&io->oldest) >= io->flush_ns) {
+                write_out(io);
+        }
+}
+
+/****** private helper function definitions ******/
+
+/* loops until every byte is written or the descriptor fails */
+void write_all(int fd, const unsigned char *bytes, size_t n)
+{
+        while (n > 0) {
+                ssize_t wrote = write(fd, bytes, n);
+                if (wrote < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        return;
+                }
+                bytes += wrote;
+                n -= wrote;
+        }
+}
+
+/* writes and empties the synchronous buffer, or commits the reserved
+ * space that has been used
+ */
+void write_out(UM_io io)
+{
+        if (io->out_ring != NULL) {
+                link_commit(io);
+                return;
+        }
+        write_all(io->out_fd, io->out, io->out_len);
+        io->out_len = 0;
+}
+
+/* uses the monotonic clock, so changes to the wall clock do not matter */
+long elapsed_ns(const struct timespec *start)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (now.tv_sec - start->tv_sec) * NS_PER_S +
+               (now.tv_nsec - start->tv_nsec);
+}
+
+/* a full ring means the reader is far behind, so yield until it catches up
+ * -- the writer is only signalled when it is asleep and has work to do
+ */
+void async_put(UM_io io, unsigned char byte)
+{
+        while (ring_write(io->ring, &byte, 1) == 0) {
+                sched_yield();
+        }
+        io->pushed++;
+        if (__atomic_load_n(&io->writer_idle, __ATOMIC_ACQUIRE) == 1 &&
+            ring_used(io->ring) >= io->flush_bytes) {
+                pthread_mutex_lock(&io->lock);
+                pthread_cond_signal(&io->wake);
+                pthread_mutex_unlock(&io->lock);
+        }
+}
+
+/* the writer broadcasts drained under the lock after every write, so
+ * checking written under the lock cannot miss the last one
+ */
+void async_flush(UM_io io)
+{
+        pthread_mutex_lock(&io->lock);
+        if (__atomic_load_n(&io->written, __ATOMIC_ACQUIRE) < io->pushed) {
+                __atomic_store_n(&io->flush_request, 1, __ATOMIC_RELEASE);
+                pthread_cond_signal(&io->wake);
+                while (__atomic_load_n(&io->written, __ATOMIC_ACQUIRE) <
+                       io->pushed) {
+                        pthread_cond_wait(&io->drained, &io->lock);
+                }
+                __atomic_store_n(&io->flush_request, 0, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&io->lock);
+}
+
+/* sleeps until there is work, writes with the lock released, and exits once
+ * the ring is closed and empty
+ */
+void *writer_main(void *arg)
+{
+        UM_io io = arg;
+        unsigned char *buffer = malloc(OUT_BUFFER_SIZE);
+        struct timespec since;
+        int waiting = 0;
+
+        pthread_mutex_lock(&io->lock);
+        for (;;) {
+                while (writer_has_work(io, &waiting, &since) == 0) {
+                        struct timespec deadline;
+                        long wait_ns = WRITER_IDLE_MS * NS_PER_MS;
+                        if (waiting == 1 && io->flush_ns != 0) {
+                                wait_ns = io->flush_ns - elapsed_ns(&since);
+                                if (wait_ns < 0) {
+                                        wait_ns = 0;
+                                }
+                        }
+                        clock_gettime(CLOCK_REALTIME, &deadline);
+                        deadline.tv_nsec += wait_ns;
+                        deadline.tv_sec += deadline.tv_nsec / NS_PER_S;
+                        deadline.tv_nsec %= NS_PER_S;
+
+                        __atomic_store_n(&io->writer_idle, 1,
+                                         __ATOMIC_RELEASE);
+                        pthread_cond_timedwait(&io->wake, &io->lock,
+                                               &deadline);
+                        __atomic_store_n(&io->writer_idle, 0,
+                                         __ATOMIC_RELEASE);
+                }
+                /* the close is loaded before the byte count, so no byte
+                   written before the close can be missed */
+                int closed = ring_closed(io->ring);
+                if (closed == 1 && ring_used(io->ring) == 0) {
+                        break;
+                }
+                pthread_mutex_unlock(&io->lock);
+
+                size_t n = ring_read(io->ring, buffer, OUT_BUFFER_SIZE);
+                write_all(io->out_fd, buffer, n);
+                waiting = 0;
+
+                pthread_mutex_lock(&io->lock);
+                __atomic_add_fetch(&io->written, n, __ATOMIC_RELEASE);
+                pthread_cond_broadcast(&io->drained);
+        }
+        pthread_mutex_unlock(&io->lock);
+        free(buffer);
+        return NULL;
+}
+
+/* work is a close, or waiting bytes that have been asked to be flushed, have
+ * reached the byte threshold, or are older than the time threshold
+ */
+int writer_has_work(UM_io io, int *waiting, struct timespec *since)
+{
+        if (ring_closed(io->ring) == 1) {
+                return 1;
+        }
+        size_t used = ring_used(io->ring);
+        if (used == 0) {
+                *waiting = 0;
+                return 0;
+        }
+        if (used >= io->flush_bytes ||
+            __atomic_load_n(&io->flush_request, __ATOMIC_ACQUIRE) == 1) {
+                return 1;
+        }
+        if (io->flush_ns == 0) {
+                return 0;
+        }
+        if (*waiting == 0) {
+                *waiting = 1;
+                clock_gettime(CLOCK_MONOTONIC, since);
+                return 0;
+        }
+        return elapsed_ns(since) >= io->flush_ns;
+}
+
+/* once the reader has detached, output is dropped, as it is when an output
+ * descriptor fails
+ */
+void link_put(UM_io io, unsigned char byte)
+{
+        if (io->out_room == 0 && link_reserve(io) == 0) {
+                return;
+        }
+        if (io->out_len == 0 && io->flush_ns != 0) {
+                clock_gettime(CLOCK_MONOTONIC, &io->oldest);
+        }
+        io->out[io->out_len++] = byte;
+        io->out_room--;
+        if (io->out_len >= io->flush_bytes ||
+            (io->flush_ns != 0 && elapsed_ns(&io->oldest) >= io->flush_ns)) {
+                link_commit(io);
+        }
+}
+
+/* the rest of the reserved space stays reserved, for the bytes after */
+void link_commit(UM_io io)
+{
+        if (io->out_len == 0) {
+                return;
+        }
+        ring_commit(io->out_ring, io->out_len);
+        io->out += io->out_len;
+        io->out_len = 0;
+}
+
+/* whatever has been put so far is committed first, since the reader cannot
+ * make room without it
+ */
+int link_reserve(UM_io io)
+{
+        unsigned tries = 0;
+
+        link_commit(io);
+        while ((io->out_room = ring_reserve(io->out_ring, &io->out)) == 0) {
+                if (ring_detached(io->out_ring) == 1) {
+                        return 0;
+                }
+                link_wait(&tries);
+        }
+        return 1;
+}
+
+/* output is flushed before the wait, as it is before a read, so a stage
+ * never waits on a stage that is waiting on its output
+ * the close is loaded before the ring is looked at again, so no byte
+ * written before the close can be missed
+ */
+int link_refill(UM_io io)
+{
+        unsigned tries = 0;
+
+        ring_consume(io->in_ring, io->in_len);
+        io->in_pos = 0;
+        io->in_len = 0;
+        while ((io->in_len = ring_peek(io->in_ring, &io->in)) == 0) {
+                if (tries == 0) {
+                        io_flush(io);
+                }
+                if (ring_closed(io->in_ring) == 1 &&
+                    ring_peek(io->in_ring, &io->in) == 0) {
+                        return 0;
+                }
+                link_wait(&tries);
+        }
+        return 1;
+}
+
+void link_wait(unsigned *tries)
+{
+        if ((*tries)++ < LINK_SPINS) {
+                sched_yield();
+        } else {
+                struct timespec nap = { 0, LINK_NAP_NS };
+                nanosleep(&nap, NULL);
+        }
+}
@@ -0,0 +1,91 @@
+/*
+ * umio.h
+ *      the interface for the I/O layer behind the output and input
+ *      instructions of the UM
+ *      output bytes are buffered and written in large pieces, either
+ *      directly or by a writer thread fed through a lock-free ring; input is
+ *      read ahead in large pieces when it comes from a file or a pipe
+ *      a UM_io can instead be linked to rings, taking its input from one
+ *      and putting its output into another, so that one UM's output is the
+ *      next one's input without passing through the kernel
+ *      uses an incomplete struct definition called UM_io
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef UMIO_H_INCLUDED_
+#define UMIO_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "ring.h"
+
+typedef struct UM_io *UM_io;
+
+/* when buffered output is written out -- it is always written before input
+ * is read from the input descriptor and when the UM_io is freed; a 0 field
+ * means the default
+ */
+struct io_options {
+        size_t flush_bytes;     /* once this many bytes are waiting;
+                                   by default, when the buffer fills */
+        unsigned flush_ms;      /* once the oldest waiting byte is this many
+                                   milliseconds old; by default, never */
+        int async;              /* 1 to have a writer thread do the writes,
+                                   so a slow reader never stalls the UM */
+};
+
+/* creates a UM_io that reads from in_fd and writes to out_fd -- options may
+ * be NULL for the defaults
+ * output to a terminal is written a line at a time, as stdio would
+ */
+UM_io io_new(int in_fd, int out_fd, const struct io_options *options);
+
+/* links the UM_io to the given rings: input is taken from in (see ring.h)
+ * instead of the input descriptor, as its consumer, and output is put into
+ * out instead of the output descriptor, as its producer -- either may be
+ * NULL to keep the descriptor, and out may not be given to a UM_io made
+ * with async output
+ * output put into out once its reader has detached is dropped
+ */
+void io_link(UM_io io, UM_ring in, UM_ring out);
+
+/* writes any buffered output, stops the writer thread if there is one, and
+ * frees the UM_io -- the file descriptors are left open, an output ring is
+ * closed and an input ring is detached from
+ */
+void io_free(UM_io io);
+
+/* buffers one byte of output */
+void io_put(UM_io io, unsigned char byte);
+
+/* returns the next byte of input, or EOF once the input is exhausted --
+ * buffered output is written first whenever the input descriptor must be
+ * read, so a prompt is always visible before the UM waits for an answer
+ */
+int io_get(UM_io io);
+
+/* returns the descriptor the next io_get would read, or -1 if it would not
+ * read at all because input (or its end) is already buffered -- so that a
+ * caller can wait for input in its own way first
+ */
+int io_wait_fd(UM_io io);
+
+/* counts every byte output from now on in *output_bytes, which must outlive
+ * the UM_io, starting from the count so far
+ */
+void io_count(UM_io io, uint64_t *output_bytes);
+
+/* writes all buffered output and waits until it has been written */
+void io_flush(UM_io io);
+
+/* writes the buffered output if its oldest byte has passed the time
+ * threshold -- the engines call this at every load_program, so that the
+ * threshold holds while a UM computes without output (every UM loop goes
+ * through a load_program); the writer thread keeps it for async output
+ */
+void io_tick(UM_io io);
+
+#endif /* UMIO_H_INCLUDED_ */
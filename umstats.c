@@ -0,0 +1,82 @@
+/*
+ * umstats.c
+ *      asks a running um for its live counters over the Unix socket given
+ *      to um --stats-socket (see stats.h) and copies the report to stdout
+ *      usage: umstats socket
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/****** private helper function declarations ******/
+
+/* prints how to run umstats and exits */
+void usage(void);
+
+/* returns a socket connected to the one at path, or exits with an error */
+int connect_to(const char *path);
+
+/**************************************************/
+
+/* um sends the whole report and closes the connection */
+int main(int argc, char *argv[])
+{
+        char buffer[512];
+        ssize_t n;
+
+        if (argc != 2) {
+                usage();
+        }
+        int fd = connect_to(argv[1]);
+        while ((n = read(fd, buffer, sizeof(buffer))) != 0) {
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n < 0) {
+                        perror("umstats");
+                        exit(1);
+                }
+                fwrite(buffer, 1, n, stdout);
+        }
+        close(fd);
+        return 0;
+}
+
+/****** private helper function definitions ******/
+
+void usage(void)
+{
+        fprintf(stderr, "usage: umstats socket\n");
+        exit(1);
+}
+
+int connect_to(const char *path)
+{
+        struct sockaddr_un address;
+
+        if (strlen(path) >= sizeof(address.sun_path)) {
+                fprintf(stderr, "umstats: %s: path too long\n", path);
+                exit(1);
+        }
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strcpy(address.sun_path, path);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *) &address,
+                              sizeof(address)) != 0) {
+                perror("umstats");
+                exit(1);
+        }
+        return fd;
+}
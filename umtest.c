@@ -0,0 +1,444 @@
+/*
+ * umtest.c
+ *      checks the embeddable machine in libum.a (see umvm.h) through its
+ *      interface alone: that vm_run keeps to its budget and a machine
+ *      carries on where it stopped, that blocked input is asked for again,
+ *      and that each thing the UM does not allow stops the machine with
+ *      the right fault, after the output that came before it
+ *      the programs are built here, a word at a time
+ *      usage: umtest
+ *              prints each check that fails to stderr and exits with
+ *              status 1 if any did
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "umvm.h"
+
+#define MAX_WORDS 64
+#define MAX_OUTPUT 256
+#define HOST_LIMIT (1UL << 30)
+
+/* a program under construction */
+struct program {
+        uint32_t words[MAX_WORDS];
+        unsigned length;
+};
+
+/* what the callbacks read from and write to -- with block set, every other
+ * request for input is told it is not ready yet
+ */
+struct tape {
+        const char *input;
+        size_t next;
+        int block;
+        int asked;
+        char output[MAX_OUTPUT];
+        size_t output_len;
+};
+
+/* a program that must fault -- with limit_host set it runs with the process
+ * held to HOST_LIMIT bytes of address space
+ */
+struct fault_case {
+        const char *name;
+        void (*build)(struct program *program);
+        const char *fault;
+        int limit_host;
+};
+
+/****** private helper function declarations ******/
+
+/* appends a three-register instruction or a load value to the program */
+void emit(struct program *program, unsigned opcode, unsigned a, unsigned b,
+          unsigned c);
+void emit_value(struct program *program, unsigned a, uint32_t value);
+
+/* appends instructions that output each character of text */
+void emit_text(struct program *program, const char *text);
+
+/* returns a machine running the program, talking to the tape */
+UM_vm start(struct program *program, struct tape *tape,
+            struct vm_callbacks *callbacks);
+
+/* the callbacks */
+void tape_output(void *context, const unsigned char *bytes, size_t n);
+int tape_input(void *context);
+
+/* holds the process to HOST_LIMIT bytes of address space, or lifts the
+ * limit again
+ */
+void limit_host(int on);
+
+/* counts a failed check and says what went wrong */
+void fail(const char *check, const char *problem);
+
+/* the checks */
+void check_budget(void);
+void check_resume(void);
+void check_blocked_input(void);
+void check_wide_output(void);
+void check_fault(const struct fault_case *fault_case);
+
+/* the programs for check_fault */
+void divide_by_zero(struct program *program);
+void load_outside(struct program *program);
+void store_outside(struct program *program);
+void unmap_zero(struct program *program);
+void load_unmapped(struct program *program);
+void invalid_opcode(struct program *program);
+void map_too_big(struct program *program);
+
+/**************************************************/
+
+static int failures = 0;
+
+static const struct fault_case fault_cases[] = {
+        { "division", divide_by_zero, "division by zero", 0 },
+        { "load", load_outside, "load outside a mapped segment", 0 },
+        { "store", store_outside, "store outside a mapped segment", 0 },
+        { "unmap", unmap_zero,
+          "unmap of a segment that is not mapped, or of segment 0", 0 },
+        { "load_program", load_unmapped,
+          "load_program of a segment that is not mapped", 0 },
+        { "opcode", invalid_opcode, "invalid opcode", 0 },
+        { "map", map_too_big,
+          "map over the segment limit, or too big for the host", 1 }
+};
+
+int main(int argc, char *argv[])
+{
+        (void) argv;
+        if (argc != 1) {
+                printf("Incorrect input\n");
+                return 1;
+        }
+
+        check_budget();
+        check_resume();
+        check_blocked_input();
+        check_wide_output();
+        for (size_t i = 0; i < sizeof(fault_cases) / sizeof(fault_cases[0]);
+             i++) {
+                check_fault(&fault_cases[i]);
+        }
+        return failures != 0;
+}
+
+/****** private helper function definitions ******/
+
+void emit(struct program *program, unsigned opcode, unsigned a, unsigned b,
+          unsigned c)
+{
+        program->words[program->length++] =
+                (uint32_t) opcode << 28 | a << 6 | b << 3 | c;
+}
+
+void emit_value(struct program *program, unsigned a, uint32_t value)
+{
+        program->words[program->length++] = 13U << 28 | a << 25 | value;
+}
+
+/* uses register 1 */
+void emit_text(struct program *program, const char *text)
+{
+        for (; *text != '\0'; text++) {
+                emit_value(program, 1, (unsigned char) *text);
+                emit(program, 10, 0, 0, 1);
+        }
+}
+
+/* the image is written out big-endian, as in a .um file */
+UM_vm start(struct program *program, struct tape *tape,
+            struct vm_callbacks *callbacks)
+{
+        unsigned char image[MAX_WORDS * 4];
+
+        for (unsigned i = 0; i < program->length; i++) {
+                image[4 * i] = program->words[i] >> 24;
+                image[4 * i + 1] = program->words[i] >> 16;
+                image[4 * i + 2] = program->words[i] >> 8;
+                image[4 * i + 3] = program->words[i];
+        }
+        callbacks->output = tape_output;
+        callbacks->input = tape_input;
+        callbacks->context = tape;
+        return vm_new(image, program->length * 4, callbacks);
+}
+
+/* output past MAX_OUTPUT bytes is dropped, and shows up as a mismatch */
+void tape_output(void *context, const unsigned char *bytes, size_t n)
+{
+        struct tape *tape = context;
+
+        for (size_t i = 0; i < n && tape->output_len < MAX_OUTPUT - 1; i++) {
+                tape->output[tape->output_len++] = bytes[i];
+        }
+        tape->output[tape->output_len] = '\0';
+}
+
+int tape_input(void *context)
+{
+        struct tape *tape = context;
+
+        if (tape->block && tape->asked++ % 2 == 0) {
+                return VM_INPUT_BLOCKED;
+        }
+        if (tape->input == NULL || tape->input[tape->next] == '\0') {
+                return VM_INPUT_EOF;
+        }
+        return (unsigned char) tape->input[tape->next++];
+}
+
+/* only the soft limit changes, so it can always be lifted again */
+void limit_host(int on)
+{
+        static struct rlimit saved;
+        static int lowered = 0;
+
+        if (on) {
+                struct rlimit limit;
+                if (getrlimit(RLIMIT_AS, &saved) != 0 ||
+                    (saved.rlim_cur != RLIM_INFINITY &&
+                     saved.rlim_cur <= HOST_LIMIT)) {
+                        return;
+                }
+                limit = saved;
+                limit.rlim_cur = HOST_LIMIT;
+                lowered = setrlimit(RLIMIT_AS, &limit) == 0;
+        } else if (lowered) {
+                setrlimit(RLIMIT_AS, &saved);
+                lowered = 0;
+        }
+}
+
+void fail(const char *check, const char *problem)
+{
+        fprintf(stderr, "umtest: %s: %s\n", check, problem);
+        failures++;
+}
+
+/* a loop that counts register 1 down from 100 runs for exactly as many
+ * instructions in slices of 10 as in one go, every slice but the last
+ * using all of its budget, and a halted machine runs nothing more
+ */
+void check_budget(void)
+{
+        struct program program = { { 0 }, 0 };
+        struct tape tape;
+        struct vm_callbacks callbacks;
+
+        emit_value(&program, 1, 100);
+        emit(&program, 6, 3, 0, 0);                 /* r3 = ~0, or -1 */
+        emit(&program, 3, 1, 1, 3);                 /* loop: r1 += -1 */
+        emit_value(&program, 6, 8);                 /* r6 = the halt */
+        emit_value(&program, 7, 2);                 /* r7 = loop */
+        emit(&program, 0, 6, 7, 1);                 /* r6 = r7 if r1 */
+        emit(&program, 12, 0, 0, 6);
+        emit(&program, 7, 0, 0, 0);                 /* never reached */
+        emit(&program, 7, 0, 0, 0);
+
+        memset(&tape, 0, sizeof(tape));
+        UM_vm whole = start(&program, &tape, &callbacks);
+        if (vm_run(whole, UINT64_MAX) != VM_HALTED) {
+                fail("budget", "the loop did not halt");
+        }
+        uint64_t total = vm_instructions(whole);
+        vm_free(whole);
+
+        UM_vm sliced = start(&program, &tape, &callbacks);
+        enum vm_status status = VM_BUDGET;
+        while (status == VM_BUDGET) {
+                uint64_t before = vm_instructions(sliced);
+                status = vm_run(sliced, 10);
+                uint64_t ran = vm_instructions(sliced) - before;
+                if (ran > 10 || (status == VM_BUDGET && ran != 10)) {
+                        fail("budget", "a slice did not keep to its budget");
+                        break;
+                }
+        }
+        if (status != VM_HALTED || vm_instructions(sliced) != total) {
+                fail("budget", "slices did not add up to the whole run");
+        }
+        if (vm_run(sliced, 10) != VM_HALTED ||
+            vm_instructions(sliced) != total) {
+                fail("budget", "a halted machine ran again");
+        }
+        vm_free(sliced);
+}
+
+/* every slice of one instruction hands over its output before returning */
+void check_resume(void)
+{
+        struct program program = { { 0 }, 0 };
+        struct tape tape;
+        struct vm_callbacks callbacks;
+
+        emit_text(&program, "resumed\n");
+        emit(&program, 7, 0, 0, 0);
+
+        memset(&tape, 0, sizeof(tape));
+        UM_vm vm = start(&program, &tape, &callbacks);
+        size_t output_len = 0;
+        enum vm_status status;
+        while ((status = vm_run(vm, 1)) == VM_BUDGET) {
+                if (tape.output_len < output_len) {
+                        fail("resume", "output went missing");
+                }
+                output_len = tape.output_len;
+        }
+        if (status != VM_HALTED || strcmp(tape.output, "resumed\n") != 0) {
+                fail("resume", "the output is not the program's");
+        }
+        vm_free(vm);
+}
+
+/* an echo loop whose input is only ready every other time it is asked for
+ * still copies all of it, and ends on end of input
+ */
+void check_blocked_input(void)
+{
+        struct program program = { { 0 }, 0 };
+        struct tape tape;
+        struct vm_callbacks callbacks;
+
+        emit(&program, 11, 0, 0, 1);                /* loop: r1 = input */
+        emit(&program, 6, 2, 1, 1);                 /* r2 = ~r1 */
+        emit_value(&program, 6, 9);                 /* r6 = the halt */
+        emit_value(&program, 7, 6);                 /* r7 = the output */
+        emit(&program, 0, 6, 7, 2);                 /* r6 = r7 if r2 */
+        emit(&program, 12, 0, 0, 6);
+        emit(&program, 10, 0, 0, 1);                /* output r1 */
+        emit(&program, 12, 0, 0, 0);                /* r0 is still loop */
+        emit(&program, 7, 0, 0, 0);                 /* never reached */
+        emit(&program, 7, 0, 0, 0);
+
+        memset(&tape, 0, sizeof(tape));
+        tape.input = "echo";
+        tape.block = 1;
+        UM_vm vm = start(&program, &tape, &callbacks);
+        enum vm_status status;
+        unsigned blocked = 0;
+        while ((status = vm_run(vm, UINT64_MAX)) == VM_BLOCKED) {
+                blocked++;
+        }
+        if (status != VM_HALTED || blocked != 5 ||
+            strcmp(tape.output, "echo") != 0) {
+                fail("input", "blocked input was not asked for again");
+        }
+        vm_free(vm);
+}
+
+/* as with the other engines, output of a value over 255 is skipped */
+void check_wide_output(void)
+{
+        struct program program = { { 0 }, 0 };
+        struct tape tape;
+        struct vm_callbacks callbacks;
+
+        emit_text(&program, "a");
+        emit_value(&program, 1, 256);
+        emit(&program, 10, 0, 0, 1);
+        emit_text(&program, "b");
+        emit(&program, 7, 0, 0, 0);
+
+        memset(&tape, 0, sizeof(tape));
+        UM_vm vm = start(&program, &tape, &callbacks);
+        if (vm_run(vm, UINT64_MAX) != VM_HALTED ||
+            strcmp(tape.output, "ab") != 0) {
+                fail("output", "a value over 255 was not skipped");
+        }
+        vm_free(vm);
+}
+
+/* each program outputs "f" and then faults -- the machine must stop with
+ * the fault, keep the output and stay stopped
+ */
+void check_fault(const struct fault_case *fault_case)
+{
+        struct program program = { { 0 }, 0 };
+        struct tape tape;
+        struct vm_callbacks callbacks;
+
+        emit_text(&program, "f");
+        fault_case->build(&program);
+        emit_text(&program, "!");
+        emit(&program, 7, 0, 0, 0);
+
+        memset(&tape, 0, sizeof(tape));
+        UM_vm vm = start(&program, &tape, &callbacks);
+        if (fault_case->limit_host) {
+                limit_host(1);
+        }
+        enum vm_status status = vm_run(vm, UINT64_MAX);
+        if (fault_case->limit_host) {
+                limit_host(0);
+        }
+        uint64_t ran = vm_instructions(vm);
+        if (status != VM_FAULT) {
+                fail(fault_case->name, "did not fault");
+        } else if (vm_fault(vm) == NULL ||
+                   strcmp(vm_fault(vm), fault_case->fault) != 0) {
+                fail(fault_case->name, "faulted for the wrong reason");
+        }
+        if (strcmp(tape.output, "f") != 0) {
+                fail(fault_case->name, "the output before the fault is "
+                                       "wrong");
+        }
+        if (vm_run(vm, UINT64_MAX) != VM_FAULT ||
+            vm_instructions(vm) != ran) {
+                fail(fault_case->name, "a faulted machine ran again");
+        }
+        vm_free(vm);
+}
+
+void divide_by_zero(struct program *program)
+{
+        emit_value(program, 2, 0);
+        emit(program, 5, 1, 1, 2);
+}
+
+/* the program is shorter than 1000 words */
+void load_outside(struct program *program)
+{
+        emit_value(program, 2, 1000);
+        emit(program, 1, 1, 0, 2);
+}
+
+void store_outside(struct program *program)
+{
+        emit_value(program, 2, 1000);
+        emit(program, 2, 0, 2, 1);
+}
+
+void unmap_zero(struct program *program)
+{
+        emit_value(program, 2, 0);
+        emit(program, 9, 0, 0, 2);
+}
+
+void load_unmapped(struct program *program)
+{
+        emit_value(program, 2, 5);
+        emit(program, 12, 0, 2, 0);
+}
+
+void invalid_opcode(struct program *program)
+{
+        emit(program, 14, 0, 0, 0);
+}
+
+/* asks for 2^32 - 1 words, far more than HOST_LIMIT bytes */
+void map_too_big(struct program *program)
+{
+        emit(program, 6, 2, 0, 0);                  /* r2 = ~0 */
+        emit(program, 8, 0, 3, 2);
+}
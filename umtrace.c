@@ -0,0 +1,501 @@
+/*
+ * umtrace.c
+ *      decodes a trace file written by um --trace (see trace.h) and reports
+ *      where the program spent its time
+ *      usage: umtrace [--top=N] trace-file
+ *      the report lists the hottest 0-segment offsets, the hot loops (the
+ *      backward load_program jumps within segment 0, each naming the range
+ *      of offsets it closes), the most common jump targets, the lifetimes
+ *      and sizes of the segments mapped, and the bytes of I/O
+ *      times are in instructions, counted from the step records, so with
+ *      sampling they are accurate to the sampling interval
+ *      only the records still in the ring are seen: a segment unmapped in
+ *      the trace may have been mapped before its first record
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+#define DEFAULT_TOP 20
+#define NUM_BUCKETS 65
+#define NOT_MAPPED UINT64_MAX
+
+static const char *const opcode_names[16] = {
+        "move", "load", "store", "add", "multiply", "divide", "nand", "halt",
+        "map", "unmap", "output", "input", "load_program", "load_value",
+        "invalid", "invalid"
+};
+
+/* a load_program within segment 0, from the offset of the instruction to
+ * the offset it jumped to, and how often it was taken
+ */
+struct jump {
+        uint32_t from;
+        uint32_t to;
+        uint64_t count;
+};
+
+/* an open-addressing table of jumps, keyed by from and to together */
+struct jump_table {
+        struct jump *slots;
+        uint64_t *keys;         /* 0 for an empty slot, else key + 1 */
+        uint64_t capacity;      /* a power of two */
+        uint64_t used;
+};
+
+/* everything gathered from the records */
+struct analysis {
+        uint64_t every;
+        uint64_t now;                   /* instructions so far */
+        uint64_t *pc_counts;            /* step records per offset */
+        uint8_t *pc_opcodes;            /* the opcode last seen there */
+        uint64_t pc_capacity;
+        struct jump_table jumps;
+        uint64_t replacements;
+        uint64_t *mapped_at;            /* per segment, or NOT_MAPPED */
+        uint64_t segment_capacity;
+        uint64_t maps;
+        uint64_t unmaps;
+        uint64_t unmaps_unseen;         /* of segments mapped before */
+        uint64_t lifetimes[NUM_BUCKETS];
+        uint64_t map_sizes[NUM_BUCKETS];
+        uint64_t bytes_out;
+        uint64_t bytes_in;
+        uint64_t end_of_input;
+        int exited;
+};
+
+/****** private helper function declarations ******/
+
+/* exits after printing the usage message */
+void usage(void);
+
+/* maps the trace file and checks its header, exiting if it is not a trace
+ * -- stores the mapping's size in *size
+ */
+const struct trace_header *open_trace(const char *path, size_t *size);
+
+/* adds one record to the analysis */
+void analyze(struct analysis *analysis, const struct trace_record *record);
+
+/* makes room for the given offset in the pc histogram */
+void grow_pcs(struct analysis *analysis, uint32_t pc);
+
+/* makes room for the given index in the segment table */
+void grow_segments(struct analysis *analysis, uint32_t segment);
+
+/* counts one more of the jump from from to to */
+void count_jump(struct jump_table *table, uint32_t from, uint32_t to);
+
+/* returns the bit length of the given value, its histogram bucket */
+int bucket(uint64_t value);
+
+/* writes one histogram, skipping empty buckets */
+void report_buckets(const char *title, const uint64_t *buckets);
+
+/* writes the top most counted offsets */
+void report_pcs(struct analysis *analysis, int top);
+
+/* writes the top hottest loops and the top most common jump targets */
+void report_jumps(struct analysis *analysis, int top);
+
+/* orders jumps by count, most first */
+int compare_jumps(const void *a, const void *b);
+/**************************************************/
+
+int main(int argc, char *argv[])
+{
+        int top = DEFAULT_TOP;
+        int arg = 1;
+
+        for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+                if (strncmp(argv[arg], "--top=", 6) == 0) {
+                        top = atoi(argv[arg] + 6);
+                } else {
+                        usage();
+                }
+        }
+        if (argc - arg != 1 || top <= 0) {
+                usage();
+        }
+
+        size_t size;
+        const struct trace_header *header = open_trace(argv[arg], &size);
+        const struct trace_record *records =
+                (const struct trace_record *) (header + 1);
+        uint64_t first = header->head > header->capacity ?
+                         header->head - header->capacity : 0;
+
+        struct analysis analysis;
+        memset(&analysis, 0, sizeof(analysis));
+        analysis.every = header->every;
+        for (uint64_t i = first; i < header->head; i++) {
+                analyze(&analysis, &records[i & (header->capacity - 1)]);
+        }
+
+        printf("=== UM trace ===\n");
+        printf("records: %llu written, %llu kept in a ring of %llu\n",
+               (unsigned long long) header->head,
+               (unsigned long long) (header->head - first),
+               (unsigned long long) header->capacity);
+        printf("step records: every %llu instruction%s\n",
+               (unsigned long long) header->every,
+               header->every == 1 ? "" : "s");
+        if (analysis.exited) {
+                printf("instructions: %llu\n",
+                       (unsigned long long) header->instructions);
+        } else {
+                printf("instructions: unknown, the program did not end\n");
+        }
+
+        report_pcs(&analysis, top);
+        report_jumps(&analysis, top);
+        printf("program replacements: %llu\n",
+               (unsigned long long) analysis.replacements);
+
+        uint64_t live = 0;
+        for (uint64_t i = 0; i < analysis.segment_capacity; i++) {
+                live += analysis.mapped_at[i] != NOT_MAPPED;
+        }
+        printf("segments: %llu mapped, %llu unmapped (%llu of them mapped "
+               "before the first record), %llu still mapped\n",
+               (unsigned long long) analysis.maps,
+               (unsigned long long) analysis.unmaps,
+               (unsigned long long) analysis.unmaps_unseen,
+               (unsigned long long) live);
+        report_buckets("segment lifetimes (instructions)",
+                       analysis.lifetimes);
+        report_buckets("map sizes (words)", analysis.map_sizes);
+        printf("I/O: %llu bytes out, %llu bytes in, %llu reads at end of "
+               "input\n", (unsigned long long) analysis.bytes_out,
+               (unsigned long long) analysis.bytes_in,
+               (unsigned long long) analysis.end_of_input);
+
+        free(analysis.pc_counts);
+        free(analysis.pc_opcodes);
+        free(analysis.mapped_at);
+        free(analysis.jumps.slots);
+        free(analysis.jumps.keys);
+        munmap((void *) header, size);
+        return 0;
+}
+
+/****** private helper function definitions ******/
+
+void usage(void)
+{
+        fprintf(stderr, "usage: umtrace [--top=N] trace-file\n");
+        exit(1);
+}
+
+/* a file cut short is refused rather than read past its end */
+const struct trace_header *open_trace(const char *path, size_t *size)
+{
+        int fd = open(path, O_RDONLY);
+        struct stat info;
+
+        if (fd < 0 || fstat(fd, &info) != 0) {
+                printf("Could not open file\n");
+                exit(1);
+        }
+        *size = info.st_size;
+        if (*size < sizeof(struct trace_header)) {
+                printf("Not a trace file\n");
+                exit(1);
+        }
+        void *mapping = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+                printf("Could not open file\n");
+                exit(1);
+        }
+
+        const struct trace_header *header = mapping;
+        uint64_t capacity = header->capacity;
+        if (memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+            header->version != TRACE_VERSION ||
+            header->record_size != sizeof(struct trace_record) ||
+            capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+            capacity > (*size - sizeof(struct trace_header)) /
+                       sizeof(struct trace_record)) {
+                printf("Not a trace file\n");
+                exit(1);
+        }
+        return header;
+}
+
+/* a step moves the clock on by the sampling interval */
+void analyze(struct analysis *analysis, const struct trace_record *record)
+{
+        switch (record->kind) {
+                case TRACE_STEP:
+                        analysis->now += analysis->every;
+                        grow_pcs(analysis, record->pc);
+                        analysis->pc_counts[record->pc]++;
+                        analysis->pc_opcodes[record->pc] = record->opcode;
+                        break;
+                case TRACE_MAP:
+                        grow_segments(analysis, record->segment);
+                        analysis->mapped_at[record->segment] = analysis->now;
+                        analysis->maps++;
+                        analysis->map_sizes[bucket(record->value)]++;
+                        break;
+                case TRACE_UNMAP:
+                        grow_segments(analysis, record->segment);
+                        analysis->unmaps++;
+                        if (analysis->mapped_at[record->segment] ==
+                            NOT_MAPPED) {
+                                analysis->unmaps_unseen++;
+                        } else {
+                                uint64_t lifetime = analysis->now -
+                                        analysis->mapped_at[record->segment];
+                                analysis->lifetimes[bucket(lifetime)]++;
+                        }
+                        analysis->mapped_at[record->segment] = NOT_MAPPED;
+                        break;
+                case TRACE_LOAD_PROGRAM:
+                        if (record->segment == 0) {
+                                count_jump(&analysis->jumps, record->pc,
+                                           record->value);
+                        } else {
+                                analysis->replacements++;
+                        }
+                        break;
+                case TRACE_OUTPUT:
+                        analysis->bytes_out += record->value < 256;
+                        break;
+                case TRACE_INPUT:
+                        if (record->value == UINT32_MAX) {
+                                analysis->end_of_input++;
+                        } else {
+                                analysis->bytes_in++;
+                        }
+                        break;
+                case TRACE_EXIT:
+                        analysis->exited = 1;
+                        break;
+        }
+}
+
+/* grows by doubling, with the new counts zeroed */
+void grow_pcs(struct analysis *analysis, uint32_t pc)
+{
+        uint64_t old = analysis->pc_capacity;
+        if (pc < old) {
+                return;
+        }
+
+        uint64_t capacity = old == 0 ? 1024 : old;
+        while (capacity <= pc) {
+                capacity *= 2;
+        }
+        analysis->pc_counts = realloc(analysis->pc_counts,
+                                      capacity * sizeof(uint64_t));
+        analysis->pc_opcodes = realloc(analysis->pc_opcodes, capacity);
+        memset(analysis->pc_counts + old, 0,
+               (capacity - old) * sizeof(uint64_t));
+        memset(analysis->pc_opcodes + old, 0, capacity - old);
+        analysis->pc_capacity = capacity;
+}
+
+/* new entries start out unmapped */
+void grow_segments(struct analysis *analysis, uint32_t segment)
+{
+        uint64_t old = analysis->segment_capacity;
+        if (segment < old) {
+                return;
+        }
+
+        uint64_t capacity = old == 0 ? 64 : old;
+        while (capacity <= segment) {
+                capacity *= 2;
+        }
+        analysis->mapped_at = realloc(analysis->mapped_at,
+                                      capacity * sizeof(uint64_t));
+        for (uint64_t i = old; i < capacity; i++) {
+                analysis->mapped_at[i] = NOT_MAPPED;
+        }
+        analysis->segment_capacity = capacity;
+}
+
+/* linear probing, rehashing into twice the slots at half full */
+void count_jump(struct jump_table *table, uint32_t from, uint32_t to)
+{
+        uint64_t key = ((uint64_t) from << 32 | to) + 1;
+
+        if (2 * (table->used + 1) > table->capacity) {
+                struct jump_table old = *table;
+
+                table->capacity = old.capacity == 0 ? 256 :
+                                  2 * old.capacity;
+                table->slots = malloc(table->capacity * sizeof(struct jump));
+                table->keys = calloc(table->capacity, sizeof(uint64_t));
+                table->used = 0;
+                for (uint64_t i = 0; i < old.capacity; i++) {
+                        if (old.keys[i] != 0) {
+                                uint64_t j = old.keys[i] *
+                                             0x9e3779b97f4a7c15ULL;
+                                j &= table->capacity - 1;
+                                while (table->keys[j] != 0) {
+                                        j = (j + 1) & (table->capacity - 1);
+                                }
+                                table->keys[j] = old.keys[i];
+                                table->slots[j] = old.slots[i];
+                                table->used++;
+                        }
+                }
+                free(old.slots);
+                free(old.keys);
+        }
+
+        uint64_t i = (key * 0x9e3779b97f4a7c15ULL) & (table->capacity - 1);
+        while (table->keys[i] != 0 && table->keys[i] != key) {
+                i = (i + 1) & (table->capacity - 1);
+        }
+        if (table->keys[i] == 0) {
+                table->keys[i] = key;
+                table->slots[i].from = from;
+                table->slots[i].to = to;
+                table->slots[i].count = 0;
+                table->used++;
+        }
+        table->slots[i].count++;
+}
+
+int bucket(uint64_t value)
+{
+        int bits = 0;
+        while (value != 0) {
+                bits++;
+                value >>= 1;
+        }
+        return bits;
+}
+
+/* bucket k holds values from 2^(k-1) up to 2^k - 1 */
+void report_buckets(const char *title, const uint64_t *buckets)
+{
+        printf("%s:\n", title);
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+                if (buckets[i] == 0) {
+                        continue;
+                }
+                uint64_t low = i == 0 ? 0 : (uint64_t) 1 << (i - 1);
+                uint64_t high = i == 0 ? 0 : low * 2 - 1;
+                printf("  %20llu..%-20llu %12llu\n",
+                       (unsigned long long) low, (unsigned long long) high,
+                       (unsigned long long) buckets[i]);
+        }
+}
+
+/* picks the top offsets with repeated passes, since top is small */
+void report_pcs(struct analysis *analysis, int top)
+{
+        uint64_t total = 0;
+        for (uint64_t pc = 0; pc < analysis->pc_capacity; pc++) {
+                total += analysis->pc_counts[pc];
+        }
+
+        printf("hot pcs (of %llu step records):\n",
+               (unsigned long long) total);
+        uint64_t below = UINT64_MAX;
+        uint64_t last = UINT64_MAX;
+        for (int shown = 0; shown < top; shown++) {
+                uint64_t best = UINT64_MAX;
+                for (uint64_t pc = 0; pc < analysis->pc_capacity; pc++) {
+                        uint64_t count = analysis->pc_counts[pc];
+                        if (count == 0 || count > below ||
+                            (count == below && pc <= last)) {
+                                continue;
+                        }
+                        if (best == UINT64_MAX ||
+                            count > analysis->pc_counts[best]) {
+                                best = pc;
+                        }
+                }
+                if (best == UINT64_MAX) {
+                        break;
+                }
+                below = analysis->pc_counts[best];
+                last = best;
+                printf("  %10llu %-13s %14llu  %5.1f%%\n",
+                       (unsigned long long) best,
+                       opcode_names[analysis->pc_opcodes[best] & 15],
+                       (unsigned long long) below, 100.0 * below / total);
+        }
+}
+
+/* a loop is a backward jump: it runs the offsets from its target up to
+ * itself over and over
+ */
+void report_jumps(struct analysis *analysis, int top)
+{
+        struct jump_table *table = &analysis->jumps;
+        struct jump *jumps = malloc((table->used + 1) * sizeof(struct jump));
+        uint64_t num_jumps = 0;
+
+        for (uint64_t i = 0; i < table->capacity; i++) {
+                if (table->keys[i] != 0) {
+                        jumps[num_jumps++] = table->slots[i];
+                }
+        }
+        qsort(jumps, num_jumps, sizeof(struct jump), compare_jumps);
+
+        printf("hot loops (backward jumps within segment 0):\n");
+        int shown = 0;
+        for (uint64_t i = 0; i < num_jumps && shown < top; i++) {
+                if (jumps[i].to <= jumps[i].from) {
+                        printf("  %10u..%-10u %8u words %14llu times\n",
+                               jumps[i].to, jumps[i].from,
+                               jumps[i].from - jumps[i].to + 1,
+                               (unsigned long long) jumps[i].count);
+                        shown++;
+                }
+        }
+
+        /* the same target can be reached from many jumps, so the counts
+           are summed by target first */
+        for (uint64_t i = 0; i < num_jumps; i++) {
+                jumps[i].from = jumps[i].to;
+        }
+        for (uint64_t i = 0; i < num_jumps; i++) {
+                for (uint64_t j = i + 1; j < num_jumps; j++) {
+                        if (jumps[j].count != 0 && jumps[j].to ==
+                            jumps[i].to && jumps[i].count != 0) {
+                                jumps[i].count += jumps[j].count;
+                                jumps[j].count = 0;
+                        }
+                }
+        }
+        qsort(jumps, num_jumps, sizeof(struct jump), compare_jumps);
+        printf("jump targets:\n");
+        for (uint64_t i = 0; i < num_jumps && (int) i < top &&
+             jumps[i].count != 0; i++) {
+                printf("  %10u %14llu\n", jumps[i].to,
+                       (unsigned long long) jumps[i].count);
+        }
+        free(jumps);
+}
+
+int compare_jumps(const void *a, const void *b)
+{
+        const struct jump *x = a;
+        const struct jump *y = b;
+
+        if (x->count != y->count) {
+                return x->count < y->count ? 1 : -1;
+        }
+        return x->to < y->to ? -1 : x->to > y->to;
+}
@@ -0,0 +1,269 @@
+/*
+ * umvm.c
+ *      the implementation for the embeddable UM
+ *      vm_run is a switch over the predecoded 0-segment, with the registers
+ *      and program counter copied into locals for the length of the slice
+ *      every instruction that could take the process down is checked first:
+ *      loads and stores must stay inside a mapped segment, unmap and
+ *      load_program must name a mapped segment (and unmap not segment 0),
+ *      division must not be by zero, and a map must get its words
+ *      output of a value over 255 is skipped, as the other engines skip it
+ *      output collects in a buffer of OUT_BUFFER_SIZE bytes that is handed
+ *      to the output callback when it fills and at the end of every slice
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "umvm.h"
+#include "segments.h"
+#include "decode.h"
+
+#define OUT_BUFFER_SIZE 4096
+
+struct UM_vm {
+        UM_memory mem;
+        UM_program owned;               /* the program from vm_new, if any */
+        struct vm_callbacks callbacks;
+        uint32_t registers[8];
+        uint32_t pc;
+        enum vm_status status;
+        const char *fault;
+        uint64_t instructions;
+        unsigned char out[OUT_BUFFER_SIZE];
+        size_t out_len;
+};
+
+/****** private helper function declarations ******/
+
+/* hands the buffered output to the output callback */
+void flush_output(UM_vm vm);
+
+/* returns 1 if offset is inside the mapped segment at segment_index */
+int in_bounds(UM_memory mem, uint32_t segment_index, uint32_t offset);
+
+/**************************************************/
+
+/* the machine owns the program it makes from the image */
+UM_vm vm_new(const unsigned char *image, size_t num_bytes,
+             const struct vm_callbacks *callbacks)
+{
+        UM_program program = program_from_bytes(image, num_bytes);
+        UM_vm vm = vm_from_program(program, callbacks);
+
+        vm->owned = program;
+        return vm;
+}
+
+/* the 0-segment borrows the program's words until it is stored to */
+UM_vm vm_from_program(UM_program program,
+                      const struct vm_callbacks *callbacks)
+{
+        UM_vm vm = calloc(1, sizeof(struct UM_vm));
+
+        vm->mem = memory_from_program(program);
+        if (callbacks != NULL) {
+                vm->callbacks = *callbacks;
+        }
+        vm->status = VM_BUDGET;
+        return vm;
+}
+
+/* buffered output that was never flushed is thrown away */
+void vm_free(UM_vm vm)
+{
+        free_memory(vm->mem);
+        if (vm->owned != NULL) {
+                program_free(vm->owned);
+        }
+        free(vm);
+}
+
+/* a fault leaves the program counter on the instruction that faulted;
+ * blocking leaves it on the input instruction, which is not counted until
+ * it completes
+ */
+enum vm_status vm_run(UM_vm vm, uint64_t max_instructions)
+{
+        if (vm->status == VM_HALTED || vm->status == VM_FAULT) {
+                return vm->status;
+        }
+
+        UM_memory mem = vm->mem;
+        uint32_t registers[8];
+        uint32_t length;
+        const struct decoded *code = decoded_program(mem, &length);
+        uint32_t pc = vm->pc;
+        uint64_t executed = 0;
+        enum vm_status status = VM_BUDGET;
+        int byte;
+
+        memcpy(registers, vm->registers, sizeof(registers));
+        while (executed < max_instructions) {
+                if (pc >= length) {
+                        status = VM_HALTED;
+                        break;
+                }
+                const struct decoded *inst = &code[pc];
+                uint32_t a = inst->a, b = inst->b, c = inst->c;
+                switch (inst->opcode) {
+                case 0:
+                        if (registers[c] != 0) {
+                                registers[a] = registers[b];
+                        }
+                        break;
+                case 1:
+                        if (in_bounds(mem, registers[b], registers[c]) == 0) {
+                                vm->fault = "load outside a mapped segment";
+                                goto fault;
+                        }
+                        registers[a] = segments_load(mem, registers[b],
+                                                     registers[c]);
+                        break;
+                case 2:
+                        if (in_bounds(mem, registers[a], registers[b]) == 0) {
+                                vm->fault = "store outside a mapped segment";
+                                goto fault;
+                        }
+                        segments_store(mem, registers[a], registers[b],
+                                       registers[c]);
+                        break;
+                case 3:
+                        registers[a] = registers[b] + registers[c];
+                        break;
+                case 4:
+                        registers[a] = registers[b] * registers[c];
+                        break;
+                case 5:
+                        if (registers[c] == 0) {
+                                vm->fault = "division by zero";
+                                goto fault;
+                        }
+                        registers[a] = registers[b] / registers[c];
+                        break;
+                case 6:
+                        registers[a] = ~(registers[b] & registers[c]);
+                        break;
+                case 7:
+                        executed++;
+                        status = VM_HALTED;
+                        goto stop;
+                case 8: {
+                        uint32_t index = map_segment(mem, registers[c]);
+                        if (index == SEGMENT_REFUSED) {
+                                vm->fault = "map over the segment limit, or "
+                                            "too big for the host";
+                                goto fault;
+                        }
+                        registers[b] = index;
+                        break;
+                }
+                case 9:
+                        if (registers[c] == 0 ||
+                            segment_mapped(mem, registers[c]) == 0) {
+                                vm->fault = "unmap of a segment that is "
+                                            "not mapped, or of segment 0";
+                                goto fault;
+                        }
+                        unmap_segment(mem, registers[c]);
+                        break;
+                case 10:
+                        /* like output(), a value over 255 is skipped */
+                        if (registers[c] > 255) {
+                                break;
+                        }
+                        if (vm->out_len == OUT_BUFFER_SIZE) {
+                                flush_output(vm);
+                        }
+                        vm->out[vm->out_len++] = registers[c];
+                        break;
+                case 11:
+                        byte = VM_INPUT_EOF;
+                        if (vm->callbacks.input != NULL) {
+                                byte = vm->callbacks.input(
+                                                vm->callbacks.context);
+                        }
+                        if (byte == VM_INPUT_BLOCKED) {
+                                status = VM_BLOCKED;
+                                goto stop;
+                        }
+                        registers[c] = byte < 0 ? UINT32_MAX
+                                                : (uint32_t) byte;
+                        break;
+                case 12:
+                        if (registers[b] != 0) {
+                                if (segment_mapped(mem, registers[b]) == 0) {
+                                        vm->fault = "load_program of a "
+                                                    "segment that is not "
+                                                    "mapped";
+                                        goto fault;
+                                }
+                                segments_load_program(mem, registers[b],
+                                                      registers[c]);
+                                code = decoded_program(mem, &length);
+                        }
+                        pc = registers[c];
+                        executed++;
+                        continue;
+                case 13:
+                        registers[a] = inst->value;
+                        break;
+                default:
+                        vm->fault = "invalid opcode";
+                        goto fault;
+                }
+                pc++;
+                executed++;
+        }
+        goto stop;
+fault:
+        status = VM_FAULT;
+stop:
+        memcpy(vm->registers, registers, sizeof(registers));
+        vm->pc = pc;
+        vm->instructions += executed;
+        vm->status = status;
+        flush_output(vm);
+        return status;
+}
+
+/* the limit belongs to the machine's memory */
+void vm_limit(UM_vm vm, uint64_t max_words)
+{
+        memory_limit(vm->mem, max_words);
+}
+
+/* counts every completed instruction, including halt */
+uint64_t vm_instructions(UM_vm vm)
+{
+        return vm->instructions;
+}
+
+/* the messages are string constants */
+const char *vm_fault(UM_vm vm)
+{
+        return vm->fault;
+}
+
+/****** private helper function definitions ******/
+
+/* without a callback the bytes are simply dropped */
+void flush_output(UM_vm vm)
+{
+        if (vm->out_len > 0 && vm->callbacks.output != NULL) {
+                vm->callbacks.output(vm->callbacks.context, vm->out,
+                                     vm->out_len);
+        }
+        vm->out_len = 0;
+}
+
+/* the segment must be mapped and the offset inside it */
+int in_bounds(UM_memory mem, uint32_t segment_index, uint32_t offset)
+{
+        return segment_mapped(mem, segment_index) &&
+               offset < segment_length(mem, segment_index);
+}
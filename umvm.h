@@ -0,0 +1,87 @@
+/*
+ * umvm.h
+ *      the interface for embedding the UM as a library
+ *      a UM_vm is one machine, created from a .um image in memory, that
+ *      runs for at most a given number of instructions at a time and then
+ *      returns, so a caller can share a few threads among many machines
+ *      nothing here exits the process or touches stdin and stdout: output
+ *      and input go through callbacks, and anything the other engines would
+ *      crash or exit on stops the machine with a fault instead
+ *      machines share no state, so different machines may run at the same
+ *      time on different threads; any one machine must only be used by one
+ *      thread at a time
+ *      uses an incomplete struct definition called UM_vm
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef UMVM_H_INCLUDED_
+#define UMVM_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "segments.h"
+
+typedef struct UM_vm *UM_vm;
+
+/* what vm_run stopped for -- halted and fault are final, and every later
+ * vm_run returns them straight away
+ */
+enum vm_status {
+        VM_HALTED,      /* halted, or ran off the end of its program */
+        VM_BUDGET,      /* ran the instructions it was given */
+        VM_BLOCKED,     /* wants input the input callback does not have yet */
+        VM_FAULT        /* did something the UM does not allow */
+};
+
+/* returned by the input callback instead of a byte */
+#define VM_INPUT_EOF (-1)
+#define VM_INPUT_BLOCKED (-2)
+
+/* how a machine talks to the outside -- either callback may be NULL, for
+ * output that is thrown away or input that is always at its end
+ */
+struct vm_callbacks {
+        /* takes n bytes of output; called whenever the machine's output
+           buffer fills and before every vm_run returns */
+        void (*output)(void *context, const unsigned char *bytes, size_t n);
+        /* returns the next byte of input (0 to 255), VM_INPUT_EOF, or
+           VM_INPUT_BLOCKED, in which case the input instruction is tried
+           again by the next vm_run */
+        int (*input)(void *context);
+        void *context;
+};
+
+/* creates a machine from a .um image of num_bytes bytes (big-endian words,
+ * as in a .um file), with registers zeroed and the program counter at 0 --
+ * the image is copied, so it is not needed afterwards
+ */
+UM_vm vm_new(const unsigned char *image, size_t num_bytes,
+             const struct vm_callbacks *callbacks);
+
+/* does the same for a program that has already been loaded, which many
+ * machines may share -- the program must outlive the machine
+ */
+UM_vm vm_from_program(UM_program program,
+                      const struct vm_callbacks *callbacks);
+
+/* frees the machine, whatever state it is in */
+void vm_free(UM_vm vm);
+
+/* limits the words in the segments the program maps to max_words at a
+ * time -- a map that would go over faults
+ */
+void vm_limit(UM_vm vm, uint64_t max_words);
+
+/* runs at most max_instructions instructions and says why it stopped */
+enum vm_status vm_run(UM_vm vm, uint64_t max_instructions);
+
+/* returns the number of instructions run so far */
+uint64_t vm_instructions(UM_vm vm);
+
+/* returns what went wrong once vm_run has returned VM_FAULT, or NULL */
+const char *vm_fault(UM_vm vm);
+
+#endif /* UMVM_H_INCLUDED_ */
@@ -16,6 +16,7 @@
 #include "unpack.h"
 #include "bitpack.h"
 #include "operations.h"
+#include "stats.h"
 
 #define REGISTER_WIDTH 3
 #define OPCODE_WIDTH 4
@@ -27,19 +28,30 @@
 /* calls the appropriate function in the operations module and passes it the
  * appropriate parameters
  */
-void determine_operation(UM_memory mem, uint32_t opcode, uint32_t *registers,
-                         uint32_t a, uint32_t b, uint32_t c);
+void determine_operation(UM_memory mem, UM_io io, uint32_t opcode,
+                         uint32_t *registers, uint32_t a, uint32_t b,
+                         uint32_t c);
 /**************************************************/
 
-/* initializes the registers array, and
- * while there are more instructions to read in the UM_memory, gets an
- * instruction, unpacks it, and calls a function to perform the operation
- */
-extern void unpack_instructions(UM_memory mem)
+/* initializes the registers array and runs the program from the start */
+extern void unpack_instructions(UM_memory mem, UM_io io)
 {
         /* create and initialize registers */
         uint32_t registers[8] = {0,0,0,0,0,0,0,0};
+        unpack_resume(mem, io, registers);
+}
+
+/* while there are more instructions to read in the UM_memory, gets an
+ * instruction, unpacks it, and calls a function to perform the operation
+ */
+extern void unpack_resume(UM_memory mem, UM_io io, uint32_t *registers)
+{
+        struct live_counters *live = memory_counters(mem);
+
+        /* an instruction counts once it has run, as in the other engines,
+           so one waiting for input is not counted yet */
         while (done_with_instructions(mem) == 0) {
+                live->pc = get_prog_counter(mem);
                 uint32_t word = get_instruction(mem);
                 uint32_t opcode = Bitpack_getu((uint64_t) word, OPCODE_WIDTH,
                                                OPCODE_LSB);
@@ -63,9 +75,12 @@ extern void unpack_instructions(UM_memory mem)
                                                   REGISTER_WIDTH,
                                                   REGISTER_WIDTH * 2);
 
-                        determine_operation(mem, opcode, registers, a, b, c);
+                        determine_operation(mem, io, opcode, registers, a, b,
+                                            c);
                  }
+                live->instructions++;
         }
+        io_free(io);
         free_memory(mem);
 }
 
@@ -73,10 +88,12 @@ extern void unpack_instructions(UM_memory mem)
 
 /* determines which function in the operations module to call given the opcode
  * checks for all opcodes 0-12 -- opcode 13 was previously checked
- * if opcode is invalid (14 or 15), the program exits
+ * if opcode is invalid (14 or 15), or a map goes over the memory's limit,
+ * the program exits
  */
-void determine_operation(UM_memory mem, uint32_t opcode, uint32_t *registers,
-                         uint32_t a, uint32_t b, uint32_t c)
+void determine_operation(UM_memory mem, UM_io io, uint32_t opcode,
+                         uint32_t *registers, uint32_t a, uint32_t b,
+                         uint32_t c)
 {
         switch (opcode) {
                 case 0:
@@ -101,26 +118,34 @@ void determine_operation(UM_memory mem, uint32_t opcode, uint32_t *registers,
                         nand(registers, a, b, c);
                         break;
                 case 7:
-                        halt(mem);
+                        halt(mem, io);
                 case 8:
-                        map(mem, registers, b, c);
+                        if (map(mem, registers, b, c) != 0) {
+                                fprintf(stderr, "Segment limit exceeded\n");
+                                io_free(io);
+                                free_memory(mem);
+                                exit(1);
+                        }
                         break;
                 case 9:
                         unmap(mem, registers, c);
                         break;
                 case 10:
-                        output(registers, c);
+                        output(io, registers, c);
                         break;
                 case 11:
-                        input(registers, c);
+                        input(io, registers, c);
                         break;
                 case 12:
+                        io_tick(io);
+                        memory_counters(mem)->load_programs++;
                         load_program(mem, registers, b, c);
                         break;
                 default:
                         /* op code must be 14 or 15 which is invalid so we must
                          * free memory and quit the program
                          */
+                        io_free(io);
                         free_memory(mem);
                         exit(1);
         }
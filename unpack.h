@@ -15,11 +15,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "segments.h"
+#include "umio.h"
 #include <stdint.h>
 
 /* Gets instructions from the given UM_memory and performs the operations
- * necessary
+ * necessary, doing all input and output through the given UM_io -- both are
+ * freed when the program ends
  */
-void unpack_instructions(UM_memory mem); 
+void unpack_instructions(UM_memory mem, UM_io io);
+
+/* does the same from the memory's program counter instead of the start,
+ * with the 8 given registers instead of zeroed ones -- the code um2c
+ * generates carries on here once it can no longer run natively
+ */
+void unpack_resume(UM_memory mem, UM_io io, uint32_t *registers);
 
 #endif /* UNPACK_H_INCLUDED */
@@ -0,0 +1,327 @@
+/*
+ * workloads.c
+ *      the implementation for the synthetic benchmark workloads
+ *      programs are assembled into a growable array of words; every
+ *      workload keeps register 0 at zero (so it can name segment 0 in
+ *      load_program), register 7 at all ones (so adding it decrements),
+ *      register 1 as the loop counter, and registers 5 and 6 for working
+ *      out branch targets -- registers 2, 3 and 4 are free for the work
+ *      itself
+ *      loops count register 1 down from size to 0, so the body sees size-1
+ *      down to 0, and end with a conditional load_program jump
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "workloads.h"
+
+#define R_ZERO 0
+#define R_COUNT 1
+#define R_ALT 5
+#define R_TARGET 6
+#define R_ONES 7
+
+#define OP_MOVE 0
+#define OP_LOAD 1
+#define OP_STORE 2
+#define OP_ADD 3
+#define OP_MULTIPLY 4
+#define OP_DIVIDE 5
+#define OP_NAND 6
+#define OP_HALT 7
+#define OP_MAP 8
+#define OP_UNMAP 9
+#define OP_OUTPUT 10
+#define OP_LOAD_PROGRAM 12
+#define OP_LOAD_VALUE 13
+
+#define LOAD_VAL_LIMIT (1u << 25)
+#define JUMP_CHAIN 4
+
+/* a program being assembled */
+struct program {
+        uint32_t *words;
+        uint32_t length;
+        uint32_t capacity;
+};
+
+/****** private helper function declarations ******/
+
+/* appends one word, growing the array as needed */
+void emit(struct program *p, uint32_t word);
+
+/* returns the word for a three register instruction */
+uint32_t instruction(uint32_t opcode, uint32_t a, uint32_t b, uint32_t c);
+
+/* returns the word for load_value of value (< 2^25) into register a */
+uint32_t load_value_word(uint32_t a, uint32_t value);
+
+/* loads any 32 bit value into reg, using scratch if it needs more than one
+ * load_value
+ */
+void emit_constant(struct program *p, uint32_t reg, uint32_t value,
+                   uint32_t scratch);
+
+/* sets up register 7 and the loop counter */
+void emit_preamble(struct program *p, uint32_t size);
+
+/* starts a loop counting the given register down, returning the address
+ * the loop jumps back to
+ */
+uint32_t loop_top(struct program *p, uint32_t counter);
+
+/* jumps back to top while the counter is not 0 */
+void loop_end(struct program *p, uint32_t counter, uint32_t top);
+
+/* outputs the low byte of reg -- uses registers 3 and 4 */
+void emit_output_low_byte(struct program *p, uint32_t reg);
+
+/* the workloads themselves, one per name */
+void build_arith(struct program *p, uint32_t size);
+void build_churn(struct program *p, uint32_t size);
+void build_bigseg(struct program *p, uint32_t size);
+void build_jumps(struct program *p, uint32_t size);
+void build_output(struct program *p, uint32_t size);
+
+/**************************************************/
+
+const char *const workload_names[] = {
+        "arith", "churn", "bigseg", "jumps", "output", NULL
+};
+
+static void (*const builders[])(struct program *p, uint32_t size) = {
+        build_arith, build_churn, build_bigseg, build_jumps, build_output
+};
+
+/* looks the name up and runs its builder -- a size of 0 is taken as 1 so
+ * that no loop starts by counting down from 0
+ */
+uint32_t *workload_build(const char *name, uint32_t size,
+                         uint32_t *num_words)
+{
+        struct program p = { NULL, 0, 0 };
+
+        if (size == 0) {
+                size = 1;
+        }
+        for (int i = 0; workload_names[i] != NULL; i++) {
+                if (strcmp(name, workload_names[i]) == 0) {
+                        builders[i](&p, size);
+                        *num_words = p.length;
+                        return p.words;
+                }
+        }
+        return NULL;
+}
+
+/* most significant byte first */
+int workload_write(FILE *out, const uint32_t *words, uint32_t num_words)
+{
+        for (uint32_t i = 0; i < num_words; i++) {
+                unsigned char bytes[4] = {
+                        words[i] >> 24, words[i] >> 16, words[i] >> 8,
+                        words[i]
+                };
+                if (fwrite(bytes, 1, sizeof(bytes), out) != sizeof(bytes)) {
+                        return -1;
+                }
+        }
+        return 0;
+}
+
+/****** private helper function definitions ******/
+
+/* doubles the capacity whenever it runs out */
+void emit(struct program *p, uint32_t word)
+{
+        if (p->length == p->capacity) {
+                p->capacity = p->capacity == 0 ? 64 : p->capacity * 2;
+                p->words = realloc(p->words,
+                                   p->capacity * sizeof(uint32_t));
+        }
+        p->words[p->length++] = word;
+}
+
+/* opcode in the top 4 bits, registers in the bottom 9 */
+uint32_t instruction(uint32_t opcode, uint32_t a, uint32_t b, uint32_t c)
+{
+        return opcode << 28 | a << 6 | b << 3 | c;
+}
+
+/* opcode 13, the register in bits 25-27, the value below it */
+uint32_t load_value_word(uint32_t a, uint32_t value)
+{
+        return (uint32_t) OP_LOAD_VALUE << 28 | a << 25 | value;
+}
+
+/* big values are built as high * 2^16 + low */
+void emit_constant(struct program *p, uint32_t reg, uint32_t value,
+                   uint32_t scratch)
+{
+        if (value < LOAD_VAL_LIMIT) {
+                emit(p, load_value_word(reg, value));
+                return;
+        }
+        emit(p, load_value_word(reg, value >> 16));
+        emit(p, load_value_word(scratch, 1 << 16));
+        emit(p, instruction(OP_MULTIPLY, reg, reg, scratch));
+        emit(p, load_value_word(scratch, value & 0xffff));
+        emit(p, instruction(OP_ADD, reg, reg, scratch));
+}
+
+/* register 0 starts at zero, so nand of it with itself is all ones */
+void emit_preamble(struct program *p, uint32_t size)
+{
+        emit(p, instruction(OP_NAND, R_ONES, R_ZERO, R_ZERO));
+        emit_constant(p, R_COUNT, size, 2);
+}
+
+/* the decrement comes first, so the body sees the counter already lowered */
+uint32_t loop_top(struct program *p, uint32_t counter)
+{
+        uint32_t top = p->length;
+        emit(p, instruction(OP_ADD, counter, counter, R_ONES));
+        return top;
+}
+
+/* target = exit, but move in the top address if the counter is not 0,
+ * then jump within segment 0 -- the exit address is patched in once known
+ */
+void loop_end(struct program *p, uint32_t counter, uint32_t top)
+{
+        uint32_t exit_at = p->length;
+        emit(p, 0);
+        emit(p, load_value_word(R_ALT, top));
+        emit(p, instruction(OP_MOVE, R_TARGET, R_ALT, counter));
+        emit(p, instruction(OP_LOAD_PROGRAM, 0, R_ZERO, R_TARGET));
+        p->words[exit_at] = load_value_word(R_TARGET, p->length);
+}
+
+/* and with 255 is two nands */
+void emit_output_low_byte(struct program *p, uint32_t reg)
+{
+        emit(p, load_value_word(3, 255));
+        emit(p, instruction(OP_NAND, 4, reg, 3));
+        emit(p, instruction(OP_NAND, 4, 4, 4));
+        emit(p, instruction(OP_OUTPUT, 0, 0, 4));
+}
+
+/* register 2 accumulates a value that depends on every iteration */
+void build_arith(struct program *p, uint32_t size)
+{
+        emit_preamble(p, size);
+        uint32_t top = loop_top(p, R_COUNT);
+        emit(p, instruction(OP_ADD, 2, 2, R_COUNT));
+        emit(p, instruction(OP_MULTIPLY, 3, 2, R_COUNT));
+        emit(p, load_value_word(4, 7));
+        emit(p, instruction(OP_DIVIDE, 3, 3, 4));
+        emit(p, instruction(OP_NAND, 4, 3, 2));
+        emit(p, instruction(OP_ADD, 2, 2, 4));
+        loop_end(p, R_COUNT, top);
+        emit_output_low_byte(p, 2);
+        emit(p, instruction(OP_HALT, 0, 0, 0));
+}
+
+/* segment sizes cycle through 1 to 64 words */
+void build_churn(struct program *p, uint32_t size)
+{
+        emit_preamble(p, size);
+        uint32_t top = loop_top(p, R_COUNT);
+        emit(p, load_value_word(3, 63));
+        emit(p, instruction(OP_NAND, 2, R_COUNT, 3));
+        emit(p, instruction(OP_NAND, 2, 2, 2));
+        emit(p, load_value_word(3, 1));
+        emit(p, instruction(OP_ADD, 2, 2, 3));
+        emit(p, instruction(OP_MAP, 0, 3, 2));
+        emit(p, instruction(OP_STORE, 3, R_ZERO, R_COUNT));
+        emit(p, instruction(OP_MAP, 0, 4, 2));
+        emit(p, instruction(OP_LOAD, 2, 3, R_ZERO));
+        emit(p, instruction(OP_STORE, 4, R_ZERO, 2));
+        emit(p, instruction(OP_UNMAP, 0, 0, 3));
+        emit(p, instruction(OP_UNMAP, 0, 0, 4));
+        loop_end(p, R_COUNT, top);
+        emit(p, load_value_word(3, 'c'));
+        emit(p, instruction(OP_OUTPUT, 0, 0, 3));
+        emit(p, instruction(OP_HALT, 0, 0, 0));
+}
+
+/* word i of the segment is set to i, then all the words are summed */
+void build_bigseg(struct program *p, uint32_t size)
+{
+        emit_preamble(p, size);
+        emit(p, instruction(OP_MAP, 0, 2, R_COUNT));
+        uint32_t fill = loop_top(p, R_COUNT);
+        emit(p, instruction(OP_STORE, 2, R_COUNT, R_COUNT));
+        loop_end(p, R_COUNT, fill);
+
+        emit_constant(p, R_COUNT, size, 3);
+        uint32_t sum = loop_top(p, R_COUNT);
+        emit(p, instruction(OP_LOAD, 3, 2, R_COUNT));
+        emit(p, instruction(OP_ADD, 4, 4, 3));
+        loop_end(p, R_COUNT, sum);
+
+        emit_output_low_byte(p, 4);
+        emit(p, instruction(OP_UNMAP, 0, 0, 2));
+        emit(p, instruction(OP_HALT, 0, 0, 0));
+}
+
+/* register 2 names a copy of the whole program, made once at the start;
+ * every iteration then jumps along a chain within segment 0 and reloads
+ * segment 0 from the copy, carrying on at the top of the loop
+ */
+void build_jumps(struct program *p, uint32_t size)
+{
+        emit_preamble(p, size);
+        uint32_t length_at = p->length;
+        emit(p, 0);
+        emit(p, instruction(OP_MAP, 0, 2, 4));
+
+        uint32_t copy_at = p->length;
+        emit(p, 0);
+        uint32_t copy = loop_top(p, 3);
+        emit(p, instruction(OP_LOAD, 4, R_ZERO, 3));
+        emit(p, instruction(OP_STORE, 2, 3, 4));
+        loop_end(p, 3, copy);
+
+        uint32_t top = loop_top(p, R_COUNT);
+        for (int i = 0; i < JUMP_CHAIN; i++) {
+                emit(p, load_value_word(R_TARGET, p->length + 2));
+                emit(p, instruction(OP_LOAD_PROGRAM, 0, R_ZERO, R_TARGET));
+        }
+        uint32_t exit_at = p->length;
+        emit(p, 0);
+        uint32_t cont_at = p->length;
+        emit(p, 0);
+        emit(p, instruction(OP_MOVE, R_TARGET, R_ALT, R_COUNT));
+        emit(p, instruction(OP_LOAD_PROGRAM, 0, R_ZERO, R_TARGET));
+        p->words[cont_at] = load_value_word(R_ALT, p->length);
+        emit(p, load_value_word(R_TARGET, top));
+        emit(p, instruction(OP_LOAD_PROGRAM, 0, 2, R_TARGET));
+        p->words[exit_at] = load_value_word(R_TARGET, p->length);
+        emit(p, load_value_word(3, 'j'));
+        emit(p, instruction(OP_OUTPUT, 0, 0, 3));
+        emit(p, instruction(OP_HALT, 0, 0, 0));
+
+        p->words[length_at] = load_value_word(4, p->length);
+        p->words[copy_at] = load_value_word(3, p->length);
+}
+
+/* the bytes cycle through 'a' to 'p' */
+void build_output(struct program *p, uint32_t size)
+{
+        emit_preamble(p, size);
+        uint32_t top = loop_top(p, R_COUNT);
+        emit(p, load_value_word(3, 'a'));
+        emit(p, load_value_word(4, 15));
+        emit(p, instruction(OP_NAND, 4, 4, R_COUNT));
+        emit(p, instruction(OP_NAND, 4, 4, 4));
+        emit(p, instruction(OP_ADD, 3, 3, 4));
+        emit(p, instruction(OP_OUTPUT, 0, 0, 3));
+        loop_end(p, R_COUNT, top);
+        emit(p, instruction(OP_HALT, 0, 0, 0));
+}
@@ -0,0 +1,42 @@
+/*
+ * workloads.h
+ *      the interface for the synthetic benchmark workloads of the UM
+ *      each workload is a UM program built in memory from a name and a size
+ *      parameter, so that benchmark runs are reproducible from the command
+ *      line alone:
+ *              arith   size iterations of an add/multiply/divide/nand loop
+ *              churn   size iterations that map two small segments, store
+ *                      and load through them, and unmap them again
+ *              bigseg  maps one segment of size words, fills it, and reads
+ *                      it all back
+ *              jumps   size iterations of a chain of load_program jumps
+ *                      within segment 0 followed by a replacement of the
+ *                      whole program with a copy of itself
+ *              output  writes size bytes
+ *
+ * Written by: Nathan Majumder (nmajum01) & Becky Cutler (rcutle01)
+ *
+ */
+
+#ifndef WORKLOADS_H_INCLUDED_
+#define WORKLOADS_H_INCLUDED_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* the names accepted by workload_build, ending with NULL */
+extern const char *const workload_names[];
+
+/* builds the named workload with the given size parameter, storing its
+ * length in *num_words -- returns a malloc'd array of instruction words, or
+ * NULL if there is no workload by that name
+ */
+uint32_t *workload_build(const char *name, uint32_t size,
+                         uint32_t *num_words);
+
+/* writes the words to the given stream as a big-endian .um image --
+ * returns 0 on success and -1 if the write failed
+ */
+int workload_write(FILE *out, const uint32_t *words, uint32_t num_words);
+
+#endif /* WORKLOADS_H_INCLUDED_ */